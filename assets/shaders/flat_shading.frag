@@ -2,15 +2,41 @@
 
 in vec3 color;
 in vec2 uvs;
+flat in uint material;
 
 layout(location = 0) out vec4 final_col;
 
 uniform int use_texture; // 0 if not. 1 else
 uniform sampler2D tex0;
 
+// Material table : 2 texels per material (color and shininess, layer or -1)
+uniform samplerBuffer materialData;
+uniform sampler2DArray materialLayers;
+uniform usampler2D materialSplat; // Material of each cell, for the splat materials (layer -2)
+
+vec3 materialColor()
+{
+	int m = int(material);
+	vec2 layer_uvs = uvs;
+	float layer = texelFetch(materialData,2*m+1).x;
+	if (layer < -1.5) {
+		// Splat material : the uvs span the grid, the material of the cell is tiled once per cell
+		ivec2 cells = textureSize(materialSplat,0);
+		layer_uvs = uvs*vec2(cells);
+		m = int(texelFetch(materialSplat,clamp(ivec2(layer_uvs),ivec2(0),cells-1),0).r);
+		layer = texelFetch(materialData,2*m+1).x;
+	}
+	vec4 base = texelFetch(materialData,2*m);
+	vec3 c = color*base.rgb;
+	if (layer >= 0.0) {
+		c *= texture(materialLayers,vec3(layer_uvs,layer)).rgb;
+	}
+	return c;
+}
+
 void main()
 {
-	final_col = vec4(color,1.0);
+	final_col = vec4(materialColor(),1.0);
 	if (use_texture == 1) {
 		//final_col = vec4(uvs,1.0,1.0);
 		final_col = texture(tex0,uvs);
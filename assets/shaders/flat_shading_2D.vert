@@ -3,12 +3,14 @@
 layout(location=0) in vec2 vx_pos; // Indice 0
 layout(location=2) in vec2 vx_uvs; // Indice 2
 layout(location=3) in vec3 vx_col; // Indice 3
+layout(location=8) in uint vx_mat; // Indice 8
 
 uniform mat4 projectionMat;
 uniform mat4 modelviewMat;
 
 out vec3 color;
 out vec2 uvs;
+flat out uint material;
 
 void main()
 {
@@ -17,5 +19,6 @@ void main()
 	//gl_Position = vec4(vx_pos,0.0,1.0);
 	color = vx_col;
 	uvs = vx_uvs;
+	material = vx_mat;
 	//color = vec3(1.0,1.0,0.0);
 }
@@ -3,18 +3,34 @@
 layout(location=0) in vec3 vx_pos; // Indice 0
 layout(location=2) in vec2 vx_uvs; // Indice 3
 layout(location=3) in vec3 vx_col; // Indice 3
+layout(location=4) in mat4 vx_inst; // Indices 4 a 7 (identite hors dessin instancie)
+layout(location=8) in uint vx_mat; // Indice 8 (materiau de l'instance, 0 par defaut)
+
+// Constantes de la frame, partagees par tous les programmes (std140, un seul buffer)
+layout(std140) uniform FrameUniforms {
+	mat4 projectionMat;
+	mat4 viewMatrix;
+	vec4 lightPos[6];
+	vec4 lightIntensity[6]; // w inutilise
+	vec4 attenuationFactor; // w inutilise
+	int numOfLight;
+	vec4 clusterDepth;    // z_near, z_far, log(z_far/z_near)
+	vec4 clusterViewport; // x, y, largeur, hauteur en pixels
+	ivec4 clusterDims;    // nx, ny, nz, nombre de lumieres ponctuelles
+};
 
-uniform mat4 projectionMat;
 uniform mat4 modelviewMat;
 
 uniform int use_texture; // 0 if not. 1 else
 
 out vec3 color;
 out vec2 uvs;
+flat out uint material;
 
 void main()
 {
-	gl_Position = projectionMat*modelviewMat*vec4(vx_pos,1.0);
+	gl_Position = projectionMat*modelviewMat*vx_inst*vec4(vx_pos,1.0);
 	color = vx_col;
 	uvs = vx_uvs;
+	material = vx_mat;
 }
@@ -0,0 +1,13 @@
+#version 400
+
+in vec2 uvs;
+
+layout(location = 0) out vec4 final_col;
+
+uniform sampler2D text; // 1 where a glyph pixel is lit, 0 elsewhere
+
+void main()
+{
+	float lit = texture(text, uvs).r;
+	final_col = mix(vec4(0.0, 0.0, 0.0, 0.6), vec4(1.0, 1.0, 0.6, 1.0), lit);
+}
@@ -0,0 +1,13 @@
+#version 400
+
+uniform vec4 rect; // Left, bottom, right, top in normalized device coordinates
+
+out vec2 uvs;
+
+void main()
+{
+	// Triangle strip of 4 vertices, no vertex buffer needed
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	uvs = vec2(corner.x, 1.0 - corner.y);
+	gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);
+}
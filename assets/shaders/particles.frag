@@ -0,0 +1,15 @@
+#version 400
+
+in vec2 offset;
+in vec4 color;
+
+layout(location = 0) out vec4 final_col;
+
+void main()
+{
+	// Soft disc : opaque at the center, transparent at the edge
+	float r2 = dot(offset, offset);
+	if (r2 > 1.0)
+		discard;
+	final_col = vec4(color.rgb, color.a * (1.0 - r2));
+}
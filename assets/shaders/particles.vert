@@ -0,0 +1,34 @@
+#version 400
+
+// One instance per particle, the 4 corners of its quad from gl_VertexID
+layout(location = 0) in vec4 position_age;  // xyz, age in seconds (negative : smoke not born yet)
+layout(location = 1) in vec4 velocity_life; // xyz (puffs : cloud speed, center, offset), lifetime (negative : cloud puff of radius -w)
+
+uniform mat4 view_proj;
+uniform vec3 camera_right; // Axes of the camera in world coordinates
+uniform vec3 camera_up;
+
+out vec2 offset; // From the center of the particle, in [-1, 1]
+out vec4 color;
+
+const vec4 CLOUD_COLOR = vec4(0.9, 0.9, 0.9, 0.35);
+
+void main()
+{
+	offset = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	float radius;
+	if (velocity_life.w < 0.0)
+	{
+		radius = -velocity_life.w;
+		color = CLOUD_COLOR;
+	}
+	else
+	{
+		// Smoke grows, lightens and fades; unborn particles are empty quads
+		float t = clamp(position_age.w / velocity_life.w, 0.0, 1.0);
+		radius = position_age.w < 0.0 ? 0.0 : mix(0.4, 3.0, t);
+		color = vec4(vec3(mix(0.2, 0.7, t)), 0.6 * (1.0 - t));
+	}
+	vec3 corner = position_age.xyz + (camera_right * offset.x + camera_up * offset.y) * radius;
+	gl_Position = view_proj * vec4(corner, 1.0);
+}
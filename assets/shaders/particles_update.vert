@@ -0,0 +1,76 @@
+#version 400
+
+// One particle per vertex : the outputs are captured in the other buffer by transform feedback
+layout(location = 0) in vec4 position_age;  // xyz, age in seconds (negative : smoke not born yet)
+layout(location = 1) in vec4 velocity_life; // xyz in units per second, lifetime (negative : cloud puff of radius -w)
+                                            // Puffs : speed of the cloud, x of its center, x offset from the center
+
+out vec4 out_position_age;
+out vec4 out_velocity_life;
+
+uniform float dt;
+uniform float extent;  // Side of the grid
+uniform float margin;  // Clouds leaving the grid by more than margin come back on the other side
+uniform vec3 emitter;  // Top of the chimney
+uniform bool emitting;
+uniform uint seed;     // Changes at every update
+
+// Wind pushing the smoke, in units per second
+const vec3 WIND = vec3(1.5, 0.4, 0.0);
+
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// Uniform in [0, 1), a different value for each n
+float random(uint n)
+{
+	return float(hash(seed ^ hash(uint(gl_VertexID) * 8u + n)) >> 8) / 16777216.0;
+}
+
+void main()
+{
+	vec3 position = position_age.xyz;
+	vec3 velocity = velocity_life.xyz;
+	float age = position_age.w + dt;
+	float life = velocity_life.w;
+
+	if (life < 0.0)
+	{
+		// Cloud puff : every puff of a cloud moves the same center by the same steps, so the
+		// whole cloud wraps around at once when its center leaves the grid
+		float center = velocity.y + velocity.x * dt;
+		if (center > extent + margin)
+			center -= extent + 2.0 * margin;
+		velocity.y = center;
+		position.x = center + velocity.z;
+	}
+	else if (age >= 0.0)
+	{
+		if (position_age.w < 0.0 || age >= life)
+		{
+			// Born or expired : leave the chimney again, or wait a lifetime without an emitter
+			age = age >= life ? age - life : age;
+			if (!emitting)
+				age = -life;
+			position = emitter + vec3(random(0u) - 0.5, random(1u) - 0.5, 0.0) * 0.4;
+			velocity = vec3(random(2u) - 0.5, random(3u) - 0.5, 0.0) * 0.8 + vec3(0.0, 0.0, 2.0 + random(4u));
+		}
+		else
+		{
+			// Rises less and less, carried further and further by the wind
+			velocity.xy += (WIND.xy - velocity.xy) * min(dt, 1.0);
+			velocity.z = max(velocity.z - 0.4 * dt, 0.3);
+			position += velocity * dt;
+		}
+	}
+
+	out_position_age = vec4(position, age);
+	out_velocity_life = vec4(velocity, life);
+}
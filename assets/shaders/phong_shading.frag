@@ -7,21 +7,63 @@ in vec3 color; // Couleur flat du point de l'objet (si existe)
 in vec2 uvs;   // Coordonnees de texture du point de l'object (dans le repere camera)
 in vec3 nml;   // Normale du point de l'object (dans le repere camera)
 in vec3 pos;   // Position dans le repere camera
+flat in uint material; // Indice dans la table des materiaux
 
 uniform sampler2D tex0;
 uniform int use_texture; // 0 if not. 1 else
 
 uniform vec3 c_spec;
-uniform float shininess;
+uniform float shininess; // Utilisee si le materiau n'en donne pas
 
-uniform vec3 attenuationFactor;
-uniform int numOfLight;
-uniform vec4 lightPos[6];
-uniform vec3 lightIntensity[6];
-uniform mat4 viewMatrix;
+// Table des materiaux : 2 texels par materiau (couleur et brillance, couche ou -1)
+uniform samplerBuffer materialData;
+uniform sampler2DArray materialLayers;
+uniform usampler2D materialSplat; // Materiau de chaque case, pour les materiaux "splat" (couche -2)
+
+// Lumieres ponctuelles : 2 texels par lumiere (position camera + rayon, intensite)
+uniform samplerBuffer lightData;
+// Par cluster : premier indice dans lightIndices, nombre de lumieres
+uniform usamplerBuffer clusterTable;
+uniform usamplerBuffer lightIndices;
+
+// Constantes de la frame, partagees par tous les programmes (std140, un seul buffer)
+layout(std140) uniform FrameUniforms {
+	mat4 projectionMat;
+	mat4 viewMatrix;
+	vec4 lightPos[6];
+	vec4 lightIntensity[6]; // w inutilise
+	vec4 attenuationFactor; // w inutilise
+	int numOfLight;
+	vec4 clusterDepth;    // z_near, z_far, log(z_far/z_near)
+	vec4 clusterViewport; // x, y, largeur, hauteur en pixels
+	ivec4 clusterDims;    // nx, ny, nz, nombre de lumieres ponctuelles
+};
 
 layout(location = 0) out vec4 final_col;
 
+// Couleur diffuse et brillance du materiau, lues une fois par fragment
+vec3 mat_dif;
+float mat_shininess;
+
+void loadMaterial() {
+	int m = int(material);
+	vec2 layer_uvs = uvs;
+	float layer = texelFetch(materialData,2*m+1).x;
+	if (layer < -1.5) {
+		// Materiau "splat" : les uvs couvrent la grille, le materiau de la case est repete une fois par case
+		ivec2 cells = textureSize(materialSplat,0);
+		layer_uvs = uvs*vec2(cells);
+		m = int(texelFetch(materialSplat,clamp(ivec2(layer_uvs),ivec2(0),cells-1),0).r);
+		layer = texelFetch(materialData,2*m+1).x;
+	}
+	vec4 base = texelFetch(materialData,2*m);
+	mat_dif = color*base.rgb;
+	if (layer >= 0.0) {
+		mat_dif *= texture(materialLayers,vec3(layer_uvs,layer)).rgb;
+	}
+	mat_shininess = base.a > 0.0 ? base.a : shininess;
+}
+
 
 vec4 objTexture() {
 	return texture(tex0,uvs);
@@ -32,10 +74,32 @@ float saturate(float val) {
 	return val;
 }
 
-vec4 lambert(int idLight) {
+vec3 shade(vec3 dir_illu,vec3 L) {
 	// Normal normalization
 	vec3 nml_cam = normalize(nml);
+	vec3 dir_illu_nml = normalize(dir_illu);
+	float cos_illu = saturate(dot(dir_illu_nml,nml_cam));
+
+	// Shininess
+	vec3 view_dir = normalize(-pos);
+	vec3 halfVector = normalize(view_dir + dir_illu_nml);
+	float spec_intensity = 0.0;
+	if (mat_shininess>0.0) {
+		spec_intensity = pow(saturate(dot(nml_cam,halfVector)),mat_shininess);
+	}
 
+	// Final color computation
+	vec4 c_dif;
+	if (use_texture == 1) {
+		c_dif  = texture(tex0,uvs);
+	}
+	else {
+		c_dif = vec4(mat_dif,1.0f);
+	}
+	return c_dif.rgb*L*cos_illu + spec_intensity*L*c_spec;
+}
+
+vec4 lambert(int idLight) {
 	// Computing vector PL and setting lambert term
 	vec3 dir_illu;
 	if (lightPos[idLight].w > 0.0) {
@@ -46,10 +110,8 @@ vec4 lambert(int idLight) {
 		dir_illu = vec3(viewMatrix*lightPos[idLight]);
 	}
 	float dist = length(dir_illu);
-	vec3 dir_illu_nml = normalize(dir_illu);
-	float cos_illu = saturate(dot(dir_illu_nml,nml_cam));
 
-	vec3 L = lightIntensity[idLight];
+	vec3 L = lightIntensity[idLight].xyz;
 	float attenuation;
 	if (lightPos[idLight].w > 0.0) {
 		attenuation = 1.0f/(attenuationFactor.x+attenuationFactor.y*dist+attenuationFactor.z*dist*dist);
@@ -57,31 +119,41 @@ vec4 lambert(int idLight) {
 	else {
 		attenuation = attenuationFactor.x;
 	}
+	return vec4(shade(dir_illu,L*attenuation),1.0);
+}
 
-	// Shininess
-	vec3 view_dir = normalize(-pos);
-	vec3 halfVector = normalize(view_dir + dir_illu_nml);
-	float spec_intensity = 0.0;
-	if (shininess>0.0) {
-		spec_intensity = pow(saturate(dot(nml_cam,halfVector)),shininess);
-	}
-	//spec_intensity = saturate(dot(nml,halfVector));
+// Indice du cluster du fragment : tuile ecran puis tranche de profondeur exponentielle
+int clusterIndex() {
+	ivec2 tile = ivec2((gl_FragCoord.xy-clusterViewport.xy)/clusterViewport.zw*vec2(clusterDims.xy));
+	tile = clamp(tile,ivec2(0),clusterDims.xy-1);
+	float depth = max(-pos.z,clusterDepth.x);
+	int slice = int(log(depth/clusterDepth.x)/clusterDepth.z*float(clusterDims.z));
+	slice = clamp(slice,0,clusterDims.z-1);
+	return tile.x+clusterDims.x*(tile.y+clusterDims.y*slice);
+}
 
-	// Final color computation
-	vec4 c_dif;
-	if (use_texture == 1) {
-		c_dif  = texture(tex0,uvs);
-	}
-	else {
-		c_dif = vec4(color,1.0f);
-	}
-	return vec4(c_dif.rgb*(L*attenuation)*cos_illu + spec_intensity*(L*attenuation)*c_spec,1.0);
+vec3 pointLight(int idLight) {
+	vec4 light = texelFetch(lightData,2*idLight);
+	vec3 L = texelFetch(lightData,2*idLight+1).rgb;
+	vec3 dir_illu = light.xyz - pos;
+	float dist2 = dot(dir_illu,dir_illu);
+	// Fenetre qui annule la contribution au dela du rayon de la lumiere
+	float window = saturate(1.0-dist2/(light.w*light.w));
+	float attenuation = window*window/(attenuationFactor.x+attenuationFactor.y*sqrt(dist2)+attenuationFactor.z*dist2);
+	return shade(dir_illu,L*attenuation);
 }
 
 void main()
 {
+	loadMaterial();
 	final_col = vec4(0.0,0.0,0.0,1.0);
 	for(int i=0;i<numOfLight;i++) {
 		final_col += lambert(i);
 	}
+	if (clusterDims.w > 0) {
+		uvec2 cluster = texelFetch(clusterTable,clusterIndex()).xy;
+		for(uint k=0u;k<cluster.y;k++) {
+			final_col.rgb += pointLight(int(texelFetch(lightIndices,int(cluster.x+k)).x));
+		}
+	}
 }
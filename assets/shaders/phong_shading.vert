@@ -4,8 +4,22 @@ layout(location=0) in vec3 vx_pos; // Coordonnee du sommet
 layout(location=1) in vec3 vx_nml; // Normale du sommet
 layout(location=2) in vec2 vx_uvs; // Coordonnee de texture du sommet
 layout(location=3) in vec3 vx_col; // Couleur du sommet (ou couleur de l'objet)
+layout(location=4) in mat4 vx_inst; // Transformation de l'instance (identite hors dessin instancie)
+layout(location=8) in uint vx_mat; // Materiau de l'instance (0 par defaut)
+
+// Constantes de la frame, partagees par tous les programmes (std140, un seul buffer)
+layout(std140) uniform FrameUniforms {
+	mat4 projectionMat;
+	mat4 viewMatrix;
+	vec4 lightPos[6];
+	vec4 lightIntensity[6]; // w inutilise
+	vec4 attenuationFactor; // w inutilise
+	int numOfLight;
+	vec4 clusterDepth;    // z_near, z_far, log(z_far/z_near)
+	vec4 clusterViewport; // x, y, largeur, hauteur en pixels
+	ivec4 clusterDims;    // nx, ny, nz, nombre de lumieres ponctuelles
+};
 
-uniform mat4 projectionMat;
 uniform mat4 modelviewMat;
 uniform mat4 normalMat;
 
@@ -13,13 +27,16 @@ out vec3 color;
 out vec2 uvs;
 out vec3 nml;
 out vec3 pos;
+flat out uint material;
 
 void main()
 {
-	gl_Position = projectionMat*modelviewMat*vec4(vx_pos,1.0);
+	mat4 mv = modelviewMat*vx_inst;
+	gl_Position = projectionMat*mv*vec4(vx_pos,1.0);
 	uvs = vx_uvs;
 	color = vx_col;
-	nml = vec3(normalMat*vec4(vx_nml,0.0));	
-	vec4 pos_t = modelviewMat*vec4(vx_pos,1.0);
+	material = vx_mat;
+	nml = vec3(normalMat*vx_inst*vec4(vx_nml,0.0));	
+	vec4 pos_t = mv*vec4(vx_pos,1.0);
 	pos = pos_t.xyz/pos_t.w;
 }
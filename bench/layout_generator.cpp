@@ -0,0 +1,75 @@
+#include "layout_generator.hpp"
+
+#include <iostream>
+#include <vector>
+
+nlohmann::json generateLayout(long cells, int size_grid)
+{
+    if (size_grid < 10 || cells < 4 || cells % 2 != 0)
+    {
+        std::cerr << "ERROR: A loop needs an even number of cells (at least 4) and a grid of at least 10" << std::endl;
+        return {};
+    }
+
+    /* Loop length : 2 * width + sum over the pairs of rows of 2 + 2 * (width - turn) */
+    long width = std::min<long>(size_grid, cells / 2);
+    long remaining = cells - 2 * width;
+    if (remaining == 2)
+    {
+        /* A pair of rows adds at least 4 cells : narrow the loop instead */
+        width--;
+        remaining += 2;
+    }
+    std::vector<long> pairs{};
+    while (remaining > 0)
+    {
+        long pair = std::min(remaining, 2 * width);
+        if (remaining - pair == 2)
+            pair -= 2;
+        pairs.push_back(pair);
+        remaining -= pair;
+    }
+    const long top = 2 * pairs.size() + 1;
+    if (top >= size_grid)
+    {
+        std::cerr << "ERROR: " << cells << " cells do not fit on a " << size_grid << " grid" << std::endl;
+        return {};
+    }
+
+    nlohmann::json path = nlohmann::json::array();
+    for (long x = 0; x < width; x++)
+        path.push_back({x, 0});
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        long y = 2 * i + 1;
+        long turn = width - (pairs[i] - 2) / 2;
+        for (long x = width - 1; x >= turn; x--)
+            path.push_back({x, y});
+        for (long x = turn; x < width; x++)
+            path.push_back({x, y + 1});
+    }
+    for (long x = width - 1; x >= 1; x--)
+        path.push_back({x, top});
+    for (long y = top; y >= 1; y--)
+        path.push_back({0, y});
+
+    /* Station next to the loop, on a free cell if the loop leaves one */
+    nlohmann::json origin{0, 0};
+    if (width < size_grid)
+        origin = {width, 0};
+    else if (top + 1 < size_grid)
+        origin = {0, top + 1};
+    else
+    {
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            if (width - (pairs[i] - 2) / 2 > 1)
+            {
+                origin = {1, 2 * i + 1};
+                break;
+            }
+        }
+    }
+
+    return {{"size_grid", size_grid}, {"origin", origin}, {"path", path}};
+}
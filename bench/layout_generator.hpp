@@ -0,0 +1,11 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+/*
+ * Build a valid closed loop of exactly cells cells on a size_grid x size_grid grid.
+ * The loop snakes over the grid (bottom row, pairs of rows going back and forth,
+ * return along the first column), so any even length from 4 to about size_grid²
+ * can be reached. Returns an empty json (and prints why) if it does not fit.
+ */
+nlohmann::json generateLayout(long cells, int size_grid);
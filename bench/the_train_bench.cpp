@@ -0,0 +1,341 @@
+#define GLFW_INCLUDE_NONE
+
+#include "GLFW/glfw3.h"
+#include "glad/glad.h"
+#include "nlohmann/json.hpp"
+#include "draw_scene.hpp"
+#include "layout_generator.hpp"
+#include "frame_capture.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Benchmark of the loading and rendering pipeline on generated layouts.
+ * Each stage is run several times per layout size; the results (cells vs. ms)
+ * are written as json so that scaling curves can be compared across releases.
+ * GL stages use a hidden window and are skipped if no context can be created.
+ * Run it from bin/ like the_train (shaders and textures are loaded from ../assets).
+ */
+
+static const int BENCH_WIDTH = 1000;
+static const int BENCH_HEIGHT = 800;
+static const int MAX_GRID = 10000;
+static const uint32_t BENCH_SEED = 1;
+/* Route queries run by each routing stage */
+static const int ROUTE_QUERIES = 1000;
+/* Edits of the track run by the editing stage */
+static const int TRACK_EDITS = 1000;
+
+struct BenchOptions
+{
+    std::vector<long> cells{1000, 10000, 100000, 1000000};
+    int repeat = 5;
+    std::string out_file;
+    std::string capture_file; /* Y4M video of the render_scene_capture stage */
+    bool gl = true;
+};
+
+void usage()
+{
+    std::cerr << "Usage: ./the_train_bench [--cells N,N,...] [--repeat R] [--out FILE] [--no-gl] [--capture FILE.y4m]" << std::endl
+              << "       ./the_train_bench --generate CELLS SIZE_GRID > layout.json" << std::endl;
+}
+
+/* Smallest grid (at least 10) the generator can fit cells in */
+int gridFor(long cells)
+{
+    int size = std::max(10, int(std::ceil(std::sqrt(2.0 * cells))) + 2);
+    return std::min(size, MAX_GRID);
+}
+
+/* Run stage repeat times and add min and median times (ms) to results */
+template <typename Stage>
+void measure(nlohmann::json &results, long cells, int size_grid, const std::string &name, int repeat, Stage stage)
+{
+    std::vector<double> times{};
+    for (int i = 0; i < repeat; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    double median = times[times.size() / 2];
+    results.push_back({{"cells", cells}, {"size_grid", size_grid}, {"stage", name}, {"min_ms", times.front()}, {"median_ms", median}});
+    std::cerr << cells << " cells, " << name << ": " << median << " ms" << std::endl;
+}
+
+/* Routes between random track cells : A* and reads of the station tree */
+void measureRoutes(nlohmann::json &results, long cells, int size_grid, int repeat)
+{
+    if (track_graph.nodeCount() == 0)
+        return;
+    seedRandom(BENCH_SEED);
+    std::vector<std::pair<int, int>> queries{};
+    for (int i = 0; i < ROUTE_QUERIES; i++)
+        queries.push_back({randomInt(0, track_graph.nodeCount() - 1), randomInt(0, track_graph.nodeCount() - 1)});
+    std::vector<int> path{};
+    long total = 0;
+
+    measure(results, cells, size_grid, "route_astar_x" + std::to_string(ROUTE_QUERIES), repeat, [&]()
+            { for (const auto &q : queries)
+              {
+                  track_graph.route(q.first, q.second, path);
+                  total += path.size();
+              } });
+    /* The tree of the station is built by its first query, before the timing */
+    track_graph.nextHop(0, 0);
+    measure(results, cells, size_grid, "route_station_next_hop_x" + std::to_string(ROUTE_QUERIES), repeat, [&]()
+            { for (const auto &q : queries)
+                  total += track_graph.nextHop(q.first, 0); });
+    /* Keep the queries from being optimized away */
+    if (total == -1)
+        std::cerr << total << std::endl;
+}
+
+/* Takes a track of the path out of cell and puts it back : two edits, the layout is unchanged */
+void editTrack(const Vector2D &cell)
+{
+    const Vector2D prev = layout.track(cell)->prev;
+    removeTrackFromScene(cell);
+    insertTrackInScene(cell, prev);
+}
+
+/* Edits of the track as made from the window, on random tracks of the path : layout, track
+   graph, regions and picking. Returns the edited cells */
+std::vector<Vector2D> measureEdits(nlohmann::json &results, long cells, int size_grid, int repeat)
+{
+    std::vector<Vector2D> edited{};
+    if (layout.allTracks().size() < 4)
+        return edited;
+    /* The first cell is kept : the train would move to the next one */
+    std::vector<Vector2D> path{};
+    path.reserve(layout.allTracks().size());
+    for (const auto &t : layout.allTracks())
+    {
+        if (!(t.first == layout.first()))
+            path.push_back(t.first);
+    }
+    seedRandom(BENCH_SEED);
+    for (int i = 0; i < TRACK_EDITS / 2; i++)
+        edited.push_back(path[randomInt(0, path.size() - 1)]);
+
+    buildRegions();
+    measure(results, cells, size_grid, "edit_track_x" + std::to_string(TRACK_EDITS), repeat, [&]()
+            { for (const auto &cell : edited)
+                  editTrack(cell); });
+    return edited;
+}
+
+GLFWwindow *createHiddenContext()
+{
+    if (!glfwInit())
+        return NULL;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(BENCH_WIDTH, BENCH_HEIGHT, "The Train bench", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        glfwTerminate();
+        return NULL;
+    }
+    myEngine.mode2D = false;
+    myEngine.initGL((GLADloadproc)glfwGetProcAddress);
+    glViewport(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+    myEngine.set3DProjection(60.0, BENCH_WIDTH / float(BENCH_HEIGHT), Z_NEAR, Z_FAR);
+    if (!initMaterials())
+    {
+        glfwTerminate();
+        return NULL;
+    }
+    return window;
+}
+
+/* Same camera setup as the main loop, default orientation */
+void setupFrame()
+{
+    const float yaw = 90.0f, pitch = 25.0f;
+    camera_front = Vector3D(cos(deg2rad(yaw)) * cos(deg2rad(pitch)), sin(deg2rad(yaw)) * cos(deg2rad(pitch)), sin(deg2rad(pitch)));
+    camera_front.normalize();
+    myEngine.mvMatrixStack.loadIdentity();
+    myEngine.setViewMatrix(Matrix4D::lookAt(camera_pos, camera_pos + camera_front, camera_up));
+    myEngine.updateLightClusters();
+    myEngine.updateFrameUniforms();
+    myEngine.updateMvMatrix();
+}
+
+bool parseOptions(int argc, char **argv, BenchOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-gl")
+            options.gl = false;
+        else if (i + 1 >= argc)
+            return false;
+        else if (arg == "--cells")
+        {
+            options.cells.clear();
+            std::stringstream list(argv[++i]);
+            std::string value;
+            while (std::getline(list, value, ','))
+                options.cells.push_back(std::atol(value.c_str()));
+        }
+        else if (arg == "--repeat")
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--out")
+            options.out_file = argv[++i];
+        else if (arg == "--capture")
+            options.capture_file = argv[++i];
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 4 && std::string(argv[1]) == "--generate")
+    {
+        nlohmann::json data = generateLayout(std::atol(argv[2]), std::atoi(argv[3]));
+        if (data.is_null())
+            return 1;
+        std::cout << data.dump() << std::endl;
+        return 0;
+    }
+
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    GLFWwindow *window = options.gl ? createHiddenContext() : NULL;
+    if (options.gl && !window)
+        std::cerr << "WARNING: No GL context, GL stages skipped" << std::endl;
+
+    nlohmann::json results = nlohmann::json::array();
+    for (long cells : options.cells)
+    {
+        /* Loops have an even length */
+        cells += cells % 2;
+        const int size_grid = gridFor(cells);
+        nlohmann::json generated = generateLayout(cells, size_grid);
+        if (generated.is_null())
+            continue;
+        const std::string text = generated.dump();
+        nlohmann::json data;
+
+        measure(results, cells, size_grid, "json_parse", options.repeat, [&]()
+                { data = nlohmann::json::parse(text); });
+        measure(results, cells, size_grid, "layout_load", options.repeat, [&]()
+                { layout.load(data); });
+        measure(results, cells, size_grid, "place_scenery", options.repeat, [&]()
+                { seedRandom(BENCH_SEED);
+                  layout.load(data);
+                  init_set_positions(); });
+        measure(results, cells, size_grid, "graph_build", options.repeat, [&]()
+                { track_graph.build(layout); });
+        measureRoutes(results, cells, size_grid, options.repeat);
+        const std::vector<Vector2D> edited = measureEdits(results, cells, size_grid, options.repeat);
+
+        if (!window)
+            continue;
+        /* Each initScene starts from the loaded layout, without scenery, and without the meshes
+           of the previous one */
+        auto resetScene = [&]()
+        {
+            freeMeshes();
+            seedRandom(BENCH_SEED);
+            layout.load(data);
+        };
+        /* Without and with the meshes of the geometry cache file */
+        resetScene();
+        measure(results, cells, size_grid, "init_scene_cold", 1, [&]()
+                { std::remove(GEOMETRY_CACHE_FILE);
+                  initScene(data); });
+        resetScene();
+        measure(results, cells, size_grid, "init_scene", 1, [&]()
+                { initScene(data); });
+        setupFrame();
+        /* One thread, then one per core : the gain of the parallel region recording */
+        setRecordThreads(1);
+        measure(results, cells, size_grid, "record_scene_serial", options.repeat, [&]()
+                { recordScene(); });
+        setRecordThreads(0);
+        measure(results, cells, size_grid, "record_scene", options.repeat, [&]()
+                { recordScene(); });
+        /* Compared to record_scene, the cost of the regions built again after an edit */
+        size_t next_edit = 0;
+        if (!edited.empty())
+            measure(results, cells, size_grid, "edit_record_scene", options.repeat, [&]()
+                    { editTrack(edited[next_edit++ % edited.size()]);
+                      recordScene(); });
+        measure(results, cells, size_grid, "render_scene", options.repeat, [&]()
+                { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                  glEnable(GL_DEPTH_TEST);
+                  renderScene();
+                  glFinish(); });
+        /* Four cameras in viewports : compared to render_scene, the cost of the extra views */
+        const std::vector<SceneView> views = tileViews({ViewCamera::Free, ViewCamera::Overview, ViewCamera::Station, ViewCamera::Chase},
+                                                       BENCH_WIDTH, BENCH_HEIGHT);
+        measure(results, cells, size_grid, "render_4_views", options.repeat, [&]()
+                { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                  glEnable(GL_DEPTH_TEST);
+                  renderViews(views);
+                  glFinish(); });
+        glViewport(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+        myEngine.set3DProjection(60.0, BENCH_WIDTH / float(BENCH_HEIGHT), Z_NEAR, Z_FAR);
+        setupFrame();
+
+        /* Same frame, read back and written to a video : the difference is the cost of the capture */
+        FrameCapture capture;
+        if (!options.capture_file.empty() && capture.open(CaptureFormat::Y4m, options.capture_file, BENCH_WIDTH, BENCH_HEIGHT, 30))
+        {
+            measure(results, cells, size_grid, "render_scene_capture", options.repeat, [&]()
+                    { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                      glEnable(GL_DEPTH_TEST);
+                      renderScene();
+                      capture.capture();
+                      glFinish(); });
+            capture.close();
+        }
+    }
+
+    nlohmann::json report = {{"benchmark", "the_train_bench"}, {"repeat", options.repeat}, {"gl", window != NULL}, {"results", results}};
+    if (options.out_file.empty())
+        std::cout << report.dump(2) << std::endl;
+    else
+    {
+        std::ofstream out(options.out_file);
+        if (!out)
+        {
+            std::cerr << "ERROR: Cannot write " << options.out_file << std::endl;
+            return 1;
+        }
+        out << report.dump(2) << std::endl;
+    }
+
+    if (window)
+    {
+        freeScene();
+        glfwTerminate();
+    }
+    return 0;
+}
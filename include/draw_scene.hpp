@@ -3,8 +3,11 @@
 #include "glbasimac/glbi_engine.hpp"
 #include "glbasimac/glbi_set_of_points.hpp"
 #include "glbasimac/glbi_convex_2D_shape.hpp"
+#include "glbasimac/glbi_render_queue.hpp"
 #include "tools/basic_mesh.hpp"
 #include "nlohmann/json.hpp"
+#include "layout.hpp"
+#include "track_graph.hpp"
 
 using namespace glbasimac;
 
@@ -19,10 +22,131 @@ extern bool animate;
 /* OpenGL Engine */
 extern GLBI_Engine myEngine;
 
+/* Track layout (loaded from the json file) */
+extern Layout layout;
+/* Track network of the layout, rebuilt when the layout changes */
+extern TrackGraph track_graph;
+
+/* Meshes generated from constants, kept between runs (in the working directory) */
+static const char GEOMETRY_CACHE_FILE[] = "geometry_cache.bin";
+
 void initScene(const nlohmann::json &);
 
-bool initGrassTexture();
+/* Place the scenery of the layout, with counts scaled to its area */
+void init_set_positions();
+
+/* Apply a reloaded layout to the scene, only rebuilding what changed */
+void reloadScene(const Layout &, const nlohmann::json &);
+
+/* Switch to Phong shading with nbLights random point lights over the grid */
+void initBenchmarkLights(const nlohmann::json &, int nbLights);
+
+/* Register the scene materials and load their textures. Needs the engine to be initialised */
+bool initMaterials();
+
+/* Sort the track, stations and scenery by region (blocks of cells recorded together) and index
+   them for picking. The scene graph is built again by the next recordScene. Done by initScene */
+void buildRegions();
+
+/* Follow an edit of the layout and of the track graph on cells (may repeat) : only the regions
+   of these cells are sorted again, and only their nodes are added to the scene graph by the
+   next recordScene */
+void updateRegions(const std::vector<Vector2D> &cells);
+
+/* Index the track, stations, scenery and train for picking. Done with the regions */
+void buildPickGrid();
+/* Replace the pick objects of cells, and the train. Done by updateRegions */
+void updatePickGrid(const std::vector<Vector2D> &cells);
+
+/* Threads recording the regions of the grid (0 : one per core) */
+void setRecordThreads(unsigned int nb_threads);
+
+/* Fill the render queue from the scene graph, without drawing. The graph is built on the first
+   call after a layout change; then only the nodes that moved are updated. Regions of the
+   grid are culled against the view frustum and copied in parallel */
+void recordScene();
+
+/* Draw the scene, then advance the clouds and the chimney smoke and draw them over it */
+void renderScene();
+
+/* Clouds made of nb_puffs puffs, and nb_smoke smoke particles, updated and drawn by the GPU.
+   Without this call, the scene has no clouds. Errors are printed on std::cerr */
+bool initParticles(int nb_puffs, int nb_smoke);
+
+/* Delete the meshes made by initScene, before it is called again */
+void freeMeshes();
+
+/* Delete the GL objects of the scene and of the engine, before the context is destroyed.
+   The globals holding them are destroyed after glfwTerminate */
+void freeScene();
+
+/* What is under a pixel */
+enum class PickKind
+{
+    None,
+    Ground,
+    Track,
+    Station,
+    Tree,
+    Building,
+    Train
+};
+
+struct PickResult
+{
+    PickKind kind = PickKind::None;
+    Vector2D cell{0, 0};
+    float distance = 0.0f;          /* From the near plane */
+    unsigned int cells_visited = 0; /* Grid cells walked by the ray */
+};
+
+/* First object under pixel (x, y) of a width x height viewport (y down, as the cursor), seen
+   through view_proj. The ray is walked across the grid cells and only tests the objects of
+   the cells it crosses */
+PickResult pickAt(const Matrix4D &view_proj, double x, double y, int width, int height);
+
+/* One line describing a pick result */
+std::string pickDetails(const PickResult &pick);
+
+/* Edits of the path from the window : the layout is edited, then the track graph, the regions
+   and the picking follow as for a reload, and the scene graph at the next recordScene.
+   False if the layout refuses the edit (see Layout::insertTrack, ...) */
+bool insertTrackInScene(const Vector2D &cell, const Vector2D &after);
+bool removeTrackFromScene(const Vector2D &cell);
+bool moveTrackInScene(const Vector2D &from, const Vector2D &to);
+
+/* Cameras that can be shown side by side in the window */
+enum class ViewCamera
+{
+    Free,     /* The user camera (camera_pos, camera_front) */
+    Overview, /* The whole grid */
+    Station,  /* Close-up of the first station */
+    Chase     /* Behind the train */
+};
+
+/* One camera drawn in a rectangle of the framebuffer (GL viewport coordinates) */
+struct SceneView
+{
+    ViewCamera camera;
+    int x, y, width, height;
+};
+
+/* Comma separated camera names : free, overview, station, chase */
+bool parseViewCameras(const std::string &list, std::vector<ViewCamera> &cameras);
+
+/* View matrix of a camera for the current layout */
+Matrix4D cameraView(ViewCamera camera);
+
+/* Projection times view matrix of a view, as renderViews draws it */
+Matrix4D viewProjection(const SceneView &view);
+
+/* Split the framebuffer in a grid of viewports, one per camera, in reading order */
+std::vector<SceneView> tileViews(const std::vector<ViewCamera> &cameras, int width, int height);
 
-void freeGrassTexture();
+/* Render the scene once per view, each with its own camera and projection. The scene graph,
+   the culling and the instance data are shared : a region is recorded if one view sees it,
+   and each view only costs its own draw calls. Leaves the viewport of the last view */
+void renderViews(const std::vector<SceneView> &views);
 
-void renderScene(const nlohmann::json &);
+/* Statistics of the last rendered frame */
+const GLBI_Queue_Stats &renderStats();
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "glad/glad.h"
+
+/* Timer queries in flight : the GPU time of a frame is read up to this many frames later */
+static const int RESOLUTION_QUERIES = 4;
+
+/*
+ * Render the scene offscreen at a resolution that follows the GPU time of the frames,
+ * to hold a frame time budget where fill rate is the limit (software rasterizers,
+ * integrated GPUs).
+ * The scene is drawn in the bottom left part of a framebuffer object as large as the
+ * window, then stretched over the window with a bilinear blit. The GPU time of the scene
+ * is measured with GL_TIME_ELAPSED queries, read back without waiting a few frames later.
+ * The scale drops at once, in proportion to the excess, when the frames stay over budget,
+ * and only rises by small steps after a long run well under it : between the two bounds
+ * nothing changes, so the resolution does not oscillate.
+ */
+class DynamicResolution
+{
+public:
+    ~DynamicResolution();
+
+    /* Keep the GPU time of the scene under target_ms, with a scale of the window size in
+       [min_scale, 1]. Errors are printed on std::cerr */
+    bool init(double target_ms, float min_scale);
+    void free();
+    bool enabled() const { return fbo != 0; }
+
+    /* Bind the offscreen framebuffer for a window of width x height pixels, set the
+       viewport to the scaled size (returned in render_width, render_height) and start timing */
+    void begin(int width, int height, int &render_width, int &render_height);
+    /* Stop timing, stretch the image over the window framebuffer and bind it back */
+    void end();
+
+    /* Fraction of the window size rendered by the last frame */
+    float scale() const { return current_scale; }
+    /* Smoothed GPU time of the scene, 0 until the first query is read */
+    double gpuMs() const { return gpu_ms; }
+
+private:
+    /* (Re)allocate the buffers for a window of width x height pixels */
+    bool resize(int width, int height);
+    /* Read the queries that are done, oldest first, and adapt the scale */
+    void readQueries();
+    void adapt(double sample_ms);
+
+    double target_ms = 0.0;
+    float min_scale = 0.5f;
+    float current_scale = 1.0f;
+    double gpu_ms = 0.0;
+    int frames_over = 0;  /* Consecutive samples over the budget */
+    int frames_under = 0; /* Consecutive samples well under the budget */
+    int cooldown = 0;     /* Samples ignored after a change : they were rendered at the old scale */
+
+    unsigned int fbo = 0;
+    unsigned int color = 0;
+    unsigned int depth = 0;
+    int fbo_width = 0, fbo_height = 0;
+    int window_width = 0, window_height = 0;
+    int render_width = 0, render_height = 0;
+
+    unsigned int queries[RESOLUTION_QUERIES] = {0};
+    bool pending[RESOLUTION_QUERIES] = {false};
+    int next_query = 0;
+    int oldest_query = 0;
+    bool timing = false;
+};
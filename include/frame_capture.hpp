@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "glad/glad.h"
+
+/* Pixel buffers the frames go through : a frame is read back two frames after its capture */
+static const int CAPTURE_PBOS = 3;
+
+enum class CaptureFormat
+{
+    Png, /* One numbered PNG file per frame */
+    Y4m  /* Raw YUV 4:2:0 video in one file */
+};
+
+/*
+ * Record the rendered frames without stalling the render loop.
+ * capture() starts an asynchronous glReadPixels of the back buffer into a ring of pixel
+ * buffer objects; each one is mapped two frames later, once the GPU is done with it, and
+ * the pixels are handed to a background thread that converts and writes them.
+ * The render thread only waits if the GPU or the writer fall behind; these waits are
+ * counted and printed by close() with the time spent per frame.
+ */
+class FrameCapture
+{
+public:
+    ~FrameCapture();
+
+    /*
+     * Start recording frames of width x height pixels.
+     * Png : path is a prefix, frames are written as path000000.png, path000001.png, ...
+     * Y4m : path is the video file. Odd sizes are rounded down (4:2:0 needs even sizes)
+     */
+    bool open(CaptureFormat format, const std::string &path, int width, int height, int fps);
+    bool isOpen() const { return opened; }
+    /* Read back the current frame. Call after drawing, before swapping the buffers */
+    void capture();
+    /* Read the frames still in flight, wait for the writer and print a summary */
+    void close();
+
+private:
+    /* Map the pixel buffer of slot and queue its pixels for the writer */
+    void readBack(int slot);
+    void writerLoop();
+    bool writePng(const std::vector<unsigned char> &pixels, long index);
+    bool writeY4m(const std::vector<unsigned char> &pixels);
+
+    CaptureFormat format = CaptureFormat::Png;
+    std::string path;
+    int width = 0;
+    int height = 0;
+    bool opened = false;
+    std::ofstream video;
+    std::vector<unsigned char> yuv; /* Conversion buffer of the writer */
+
+    unsigned int pbos[CAPTURE_PBOS] = {0};
+    GLsync fences[CAPTURE_PBOS] = {NULL};
+    long frames_captured = 0;
+
+    /* Frames waiting for the writer, and buffers it gave back */
+    std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    std::deque<std::vector<unsigned char>> queue;
+    std::vector<std::vector<unsigned char>> free_buffers;
+    bool stopping = false;
+    std::thread writer;
+    long frames_written = 0;
+    bool write_failed = false;
+
+    /* Cost on the render thread */
+    double capture_seconds = 0.0;
+    long gpu_waits = 0;
+    long writer_waits = 0;
+};
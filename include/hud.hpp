@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "glbasimac/glbi_stats.hpp"
+#include "glbasimac/glbi_render_queue.hpp"
+
+/*
+ * Text overlay in the top left corner of the window.
+ * The lines are rasterised on the CPU with a built-in 5x7 pixel font into a one channel
+ * texture, which is drawn as a single quad over the scene. The texture is only rebuilt
+ * by setText(), so drawing the HUD costs one draw call per frame.
+ * Only digits, letters (shown in upper case) and " .:/%-(),=" are drawn.
+ */
+class Hud
+{
+public:
+    /* Load the shaders. Errors are printed on std::cerr */
+    bool init();
+    void free();
+    void setText(const std::vector<std::string> &lines);
+    /* Draw over the current frame, for a framebuffer of width x height pixels */
+    void draw(int width, int height);
+
+private:
+    unsigned int program = 0;
+    unsigned int vao = 0;
+    unsigned int texture = 0;
+    int texture_width = 0;
+    int texture_height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+/* Counters of one frame, one line per group, for the HUD and the --stats output */
+std::vector<std::string> statsLines(const glbasimac::GLBI_Stats &stats, const glbasimac::GLBI_Queue_Stats &queue,
+                                    double frame_ms);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "tools/vector3d.hpp"
+
+using namespace STP3D;
+
+/* Camera and animation state of one frame, after the user input has been applied */
+struct FrameInput
+{
+    Vector3D camera_pos;
+    float yaw;
+    float pitch;
+    bool animate;
+};
+
+/*
+ * Binary log of a run : a 12 bytes header (magic, version, seed) then 21 bytes per frame
+ * (camera position, yaw, pitch, flags). Written in the byte order of the machine.
+ */
+class InputRecorder
+{
+public:
+    bool open(const std::string &path, uint32_t seed);
+    void write(const FrameInput &input);
+
+private:
+    std::ofstream out;
+};
+
+class InputReplayer
+{
+public:
+    bool open(const std::string &path);
+    /* Seed of the recorded run */
+    uint32_t seed() const { return run_seed; }
+    /* False at the end of the log */
+    bool read(FrameInput &input);
+
+private:
+    std::ifstream in;
+    uint32_t run_seed = 0;
+};
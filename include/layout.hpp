@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "vector2d.hpp"
+
+/*
+ * Shape of the track on a cell, deduced from its neighbours on the path.
+ * Switch (3 connections) and Crossing (4) only come from the track graph.
+ */
+enum class PieceKind
+{
+    Straight,
+    Curve,
+    Switch,
+    Crossing
+};
+
+enum class SceneryKind
+{
+    Tree,
+    Building
+};
+
+/* Surface of a ground cell */
+enum class TerrainKind : unsigned char
+{
+    Grass,
+    Gravel,
+    Platform,
+    Water,
+    Count
+};
+
+/* Name of a terrain in the layout file, e.g. "gravel" */
+const char *terrainName(TerrainKind kind);
+
+/* Why a layout file was rejected */
+enum class LayoutErrorKind
+{
+    None,
+    InvalidFormat,
+    GridTooSmall,
+    DuplicateCell,
+    NotAdjacent
+};
+
+struct LayoutError
+{
+    LayoutErrorKind kind = LayoutErrorKind::None;
+    Vector2D cell; /* Offending cell of the path, if any */
+    std::string message;
+
+    explicit operator bool() const { return kind != LayoutErrorKind::None; }
+};
+
+/* Short name of an error kind, e.g. "duplicate_cell" */
+const char *layoutErrorName(LayoutErrorKind kind);
+
+/* Changes applied by Layout::applyChanges */
+struct LayoutDiff
+{
+    int added = 0;
+    int removed = 0;
+    int relinked = 0; /* Cells kept but whose neighbours on the path changed */
+    bool origin_changed = false;
+    bool network_changed = false; /* Branches or extra stations changed */
+    bool rebuilt = false; /* size_grid changed : everything was replaced */
+    std::vector<Vector2D> terrain_changed; /* Cells whose terrain changed (not filled when rebuilt) */
+    /* Cells whose track, station or scenery changed, or whose track was relinked (may repeat,
+       not filled when rebuilt) */
+    std::vector<Vector2D> cells;
+};
+
+/* One cell of the path. The path is a ring: the first cell follows the last one */
+struct TrackCell
+{
+    Vector2D prev;
+    Vector2D next;
+    PieceKind kind;
+};
+
+/*
+ * Track layout of the scene : grid, stations, path, branches and scenery.
+ * The path is stored as a linked ring in a hash map, so every edit only touches the
+ * edited cell and its two neighbours on the path : duplicates are found with one lookup,
+ * adjacency and piece kinds are re-checked locally and scenery is only moved if the
+ * edit puts a track on it.
+ * Edits may leave the path temporarily broken (e.g. removing a cell in the middle);
+ * broken links are tracked so that isValid() stays O(1).
+ * Branches are extra lines (sidings, junctions to other lines) given as open chains of
+ * adjacent cells; their end cells may lie on the path or on another branch to make a
+ * junction. The animated train only follows the path; the whole network is routed by
+ * TrackGraph.
+ * Cells are grass unless the optional terrain map of the file gives them another surface;
+ * only those cells are stored, so the memory follows the map and not the size of the grid.
+ */
+class Layout
+{
+public:
+    /* Check the json file and build the layout. Errors are printed on std::cerr */
+    bool load(const nlohmann::json &data);
+    /* Same as load, but the error is returned instead of printed. Thread safe */
+    LayoutError parse(const nlohmann::json &data);
+    /*
+     * Randomly place scenery on the cells left free by the station and the path.
+     * Cells are drawn at random and rejected if occupied, so the cost depends on the
+     * number of objects placed, not on the grid size. Stops early on a nearly full grid.
+     */
+    void placeScenery(int treeCount, int buildingCount);
+    /*
+     * Turn this layout into target (e.g. a reloaded file) by only applying the differences.
+     * Scenery is kept unless a track or the station now covers it.
+     * Everything is replaced if size_grid changed : scenery then has to be placed again.
+     */
+    LayoutDiff applyChanges(const Layout &target);
+
+    /* ---EDITING--- */
+
+    /* The edits of the path append the cells whose track or scenery changed to changed,
+       like LayoutDiff::cells. A track is never put on a track or a station : the scenery of
+       its cell is moved to a free cell */
+
+    /* Add a track on cell, after the track on cell after (ignored if the path is empty) */
+    bool insertTrack(const Vector2D &cell, const Vector2D &after, std::vector<Vector2D> &changed);
+    bool removeTrack(const Vector2D &cell, std::vector<Vector2D> &changed);
+    bool moveTrack(const Vector2D &from, const Vector2D &to, std::vector<Vector2D> &changed);
+    /* Change the surface of a cell of the grid */
+    bool setTerrain(const Vector2D &cell, TerrainKind kind);
+
+    /* ---QUERIES--- */
+
+    /* True if every cell of the path is adjacent to the next one (except last to first) */
+    bool isValid() const { return broken_links.empty(); }
+    /* Cells whose link to the next cell of the path is not an adjacency */
+    const std::unordered_set<Vector2D, Vector2DHash> &brokenLinks() const { return broken_links; }
+
+    int sizeGrid() const { return size_grid; }
+    const Vector2D &origin() const { return station; }
+    /* Every station, the origin first */
+    const std::vector<Vector2D> &allStations() const { return stations; }
+    const std::vector<std::vector<Vector2D>> &allBranches() const { return branches; }
+    /* True if a track of the path or of a branch is on cell */
+    bool isTrack(const Vector2D &cell) const { return tracks.count(cell) || branch_cells.count(cell); }
+    bool isStation(const Vector2D &cell) const { return station_cells.count(cell); }
+    /* Sides of cell joined to the adjacent cell by the path or a branch, one sideBit() each */
+    uint8_t links(const Vector2D &cell) const;
+    bool empty() const { return tracks.empty(); }
+    /* First cell of the path, where the train starts */
+    const Vector2D &first() const { return first_cell; }
+    const TrackCell *track(const Vector2D &cell) const;
+    const std::unordered_map<Vector2D, TrackCell, Vector2DHash> &allTracks() const { return tracks; }
+    const std::unordered_map<Vector2D, SceneryKind, Vector2DHash> &allScenery() const { return scenery; }
+    TerrainKind terrainAt(const Vector2D &cell) const;
+    /* Surface of the cells that are not grass */
+    const std::unordered_map<Vector2D, TerrainKind, Vector2DHash> &allTerrain() const { return terrain; }
+
+private:
+    bool inGrid(const Vector2D &cell) const;
+    bool isFree(const Vector2D &cell) const;
+    /* Re-check the link from cell to the next cell of the path */
+    void updateLink(const Vector2D &cell);
+    void updateKind(const Vector2D &cell);
+    /* Move the scenery of cell (if any) to a random free cell. Both cells are appended to changed */
+    void relocateScenery(const Vector2D &cell, std::vector<Vector2D> &changed);
+    /* Draw random cells until a free one is found. False after too many occupied cells */
+    bool randomFreeCell(Vector2D &cell);
+    /* Last cell of the path, if any */
+    bool lastCell(Vector2D &cell) const;
+    /* Read the optional branches and stations, once the path is loaded */
+    LayoutError parseNetwork(const nlohmann::json &data);
+    /* Read the optional terrain map, once the grid size is known */
+    LayoutError parseTerrain(const nlohmann::json &data);
+
+    int size_grid = 0;
+    Vector2D station;
+    std::vector<Vector2D> stations;
+    std::unordered_set<Vector2D, Vector2DHash> station_cells; /* Cells of stations, for lookups */
+    Vector2D first_cell;
+    std::unordered_map<Vector2D, TrackCell, Vector2DHash> tracks;
+    std::unordered_set<Vector2D, Vector2DHash> broken_links;
+    std::vector<std::vector<Vector2D>> branches;
+    std::unordered_set<Vector2D, Vector2DHash> branch_cells; /* Cells of the branches not on the path */
+    std::unordered_map<Vector2D, uint8_t, Vector2DHash> branch_links; /* Sides of a cell joined by a branch, one bit each */
+    std::unordered_map<Vector2D, SceneryKind, Vector2DHash> scenery;
+    std::unordered_map<Vector2D, TerrainKind, Vector2DHash> terrain; /* Cells that are not grass */
+};
+
+bool isCorner(const Vector2D &prev, const Vector2D &current, const Vector2D &next);
+/* Bit of the side of cell from where the adjacent cell to is */
+uint8_t sideBit(const Vector2D &from, const Vector2D &to);
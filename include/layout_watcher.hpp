@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "nlohmann/json.hpp"
+#include "layout.hpp"
+
+/*
+ * Watch a layout file and parse it again in the background when it is saved.
+ * Only versions that pass the layout checks are kept; the render loop picks
+ * them up with poll() at a frame boundary and applies them to the live layout.
+ * Uses inotify on the directory of the file, so editors that save through a
+ * temporary file and a rename are handled. Does nothing on other systems.
+ */
+class LayoutWatcher
+{
+public:
+    explicit LayoutWatcher(const std::string &path);
+    ~LayoutWatcher();
+
+    /* If a new valid version was parsed since the last call, move it in layout and data */
+    bool poll(Layout &layout, nlohmann::json &data);
+
+private:
+    void run();
+    /* Read, parse and check the file. Errors are printed and the file ignored */
+    void parse();
+
+    std::string file_path;
+    std::string directory;
+    std::string file_name;
+    int inotify_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    /* Last valid version, waiting for the render loop */
+    std::mutex pending_mutex;
+    bool has_pending = false;
+    Layout pending_layout;
+    nlohmann::json pending_data;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Runtime metrics of the application.
+ * Counters, gauges and histograms are registered once (at startup, or when a loader first
+ * needs them) and then updated with relaxed atomics only : no lock, no allocation, so the
+ * render loop and the loader threads can update them every frame. A MetricsExporter thread
+ * reads them periodically.
+ */
+class Counter
+{
+public:
+    void add(uint64_t n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> count{0};
+};
+
+class Gauge
+{
+public:
+    void set(double v) { current.store(v, std::memory_order_relaxed); }
+    double value() const { return current.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> current{0.0};
+};
+
+/* Distribution of values (durations in seconds) in fixed buckets */
+class Histogram
+{
+public:
+    /* Upper bounds of the buckets, increasing. Values above the last one go in a +Inf bucket */
+    explicit Histogram(const std::vector<double> &bounds);
+
+    void observe(double v);
+
+    const std::vector<double> &bounds() const { return upper_bounds; }
+    /* Number of values in bucket i (not cumulative), i in [0, bounds().size()] */
+    uint64_t bucket(size_t i) const { return buckets[i].load(std::memory_order_relaxed); }
+    uint64_t count() const { return nb_values.load(std::memory_order_relaxed); }
+    double sum() const { return 1e-9 * sum_ns.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<double> upper_bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> nb_values{0};
+    /* Sum kept in integer nanoseconds so that it is a single atomic add */
+    std::atomic<uint64_t> sum_ns{0};
+};
+
+/* Bucket bounds for frame times, and for loads that take from a millisecond to seconds */
+extern const std::vector<double> FRAME_TIME_BUCKETS;
+extern const std::vector<double> LOAD_TIME_BUCKETS;
+
+class MetricsRegistry
+{
+public:
+    /* Register a metric, or return the one already registered with this name.
+       Names follow the Prometheus conventions (the_train_..._total, ..._seconds) */
+    Counter &counter(const std::string &name, const std::string &help);
+    Gauge &gauge(const std::string &name, const std::string &help);
+    Histogram &histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds);
+
+    /* Current values in the Prometheus text format, and as one line of JSON (no newline) */
+    std::string prometheusText();
+    std::string jsonLine();
+
+private:
+    enum class Kind
+    {
+        Counter,
+        Gauge,
+        Histogram
+    };
+    struct Entry
+    {
+        std::string name;
+        std::string help;
+        Kind kind;
+        Counter counter;
+        Gauge gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+    Entry &entry(const std::string &name, const std::string &help, Kind kind);
+
+    /* Only taken to register and to export : entries never move once added */
+    std::mutex mutex;
+    std::deque<Entry> entries;
+};
+
+extern MetricsRegistry metrics;
+
+/*
+ * Publish the registry every period seconds, from a background thread :
+ *  - as a JSON line sent to every client connected to a Unix domain socket
+ *    (e.g. socat - UNIX-CONNECT:path). Slow clients miss lines instead of blocking.
+ *  - as a Prometheus text file, rewritten through a temporary file and a rename so that
+ *    the textfile collector of node-exporter never reads a partial file.
+ * Also samples the resident memory of the process. Empty paths disable an output; the
+ * socket is only available on Linux.
+ */
+class MetricsExporter
+{
+public:
+    MetricsExporter(const std::string &socket_path, const std::string &file_path, double period);
+    ~MetricsExporter();
+
+private:
+    void run();
+    void acceptClients();
+    void sendLine(const std::string &line);
+    void writeFile(const std::string &text);
+
+    std::string socket_path;
+    std::string file_path;
+    double period;
+    int listen_fd = -1;
+    std::vector<int> clients;
+    std::atomic<bool> running{false};
+    std::thread worker;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "tools/matrix4d.hpp"
+#include "tools/vector3d.hpp"
+
+using namespace STP3D;
+
+/*
+ * Cloud puffs and chimney smoke simulated on the GPU.
+ * Each particle is two vec4 in a vertex buffer : position and age, velocity and lifetime.
+ * update() runs the particles through a vertex shader with the rasterizer off and captures
+ * the result with transform feedback in a second buffer, which becomes the current one; the
+ * CPU never reads or writes a particle after spawn(). draw() expands every particle into a
+ * camera facing quad with one instanced draw of the current buffer.
+ * The first particles are cloud puffs, grouped in clouds that drift with the wind across the
+ * grid. A cloud that leaves the grid comes back whole on the other side : its puffs wrap on
+ * the center of the cloud they carry, not on their own position. The others are smoke,
+ * respawned at the emitter when their lifetime is over.
+ */
+class ParticleSystem
+{
+public:
+    /* Load the shaders and allocate nb_puffs cloud puffs and nb_smoke smoke particles.
+       Errors are printed on std::cerr */
+    bool init(int nb_puffs, int nb_smoke);
+    void free();
+    bool enabled() const { return update_program != 0; }
+
+    /* Place the clouds at random over a square grid of side extent, and the smoke unborn.
+       Draws from the seeded random engine */
+    void spawn(float extent);
+    /* Top of the chimney. Without an emitter, expired smoke stays hidden */
+    void setEmitter(const Vector3D &position) { emitter = position; emitting = true; }
+    void clearEmitter() { emitting = false; }
+
+    /* Advance all the particles by dt seconds, on the GPU */
+    void update(float dt);
+    /* Draw the particles over the current frame, seen through view (depth tested, not written) */
+    void draw(const Matrix4D &view_proj, const Matrix4D &view);
+
+    int count() const { return nb_puffs + nb_smoke; }
+
+private:
+    unsigned int update_program = 0;
+    unsigned int draw_program = 0;
+    /* Two states : buffers[current] is read, the other one receives the update */
+    unsigned int buffers[2] = {0, 0};
+    unsigned int update_vaos[2] = {0, 0};
+    unsigned int draw_vaos[2] = {0, 0};
+    unsigned int feedback = 0;
+    int current = 0;
+
+    int nb_puffs = 0;
+    int nb_smoke = 0;
+    float extent = 0.0f;
+    Vector3D emitter{0.0f, 0.0f, 0.0f};
+    bool emitting = false;
+    unsigned int seed = 0;
+    unsigned int step = 0; /* Updates since spawn(), seeds the respawns */
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "tools/vector3d.hpp"
+
+using namespace STP3D;
+
+/*
+ * Objects of the scene sorted by the grid cells their bounding box overlaps, in compressed
+ * sparse row form : the objects of cell c are in objects from offsets[c].
+ * cast() walks the cells crossed by a ray with a DDA traversal, from the nearest one, and only
+ * tests the boxes registered in them. It stops at the first cell that holds a hit, so a pick
+ * costs the cells between the camera and the object, whatever the size of the grid.
+ * The grid has one layer of cells, as high as the tallest object : the ray is clipped to
+ * that slab and the 3D traversal only steps in x and y.
+ * Objects can be added and removed after build(), without sorting again : build() leaves a
+ * free slot in every cell for the objects added later (the few that do not fit are kept apart,
+ * in a hash map by cell), and the slots and indices of removed objects are reused.
+ */
+class PickGrid
+{
+public:
+    /* Empty grid of size x size square cells, from (0, 0) */
+    void reset(int size, float cell_size);
+    /* Register an object by its bounding box. Returns its index : 0, 1, ... in the order of the
+       calls, or the index of a removed object */
+    int add(const Vector3D &min, const Vector3D &max);
+    /* The object is never hit again */
+    void remove(int object);
+    /* Sort the objects by cell */
+    void build();
+
+    /* Nearest object hit by the ray (direction normalized) within max_distance, -1 if none.
+       distance receives the distance of the hit; cells_visited, if given, the cells walked */
+    int cast(const Vector3D &origin, const Vector3D &direction, float max_distance, float &distance,
+             unsigned int *cells_visited = NULL) const;
+
+    int objectCount() const { return boxes.size() - free_objects.size(); }
+
+private:
+    struct Box
+    {
+        Vector3D min, max;
+    };
+    /* Distance at which the ray enters the box, if it does before max_distance */
+    static bool hitBox(const Box &box, const Vector3D &origin, const Vector3D &inverse, float max_distance, float &distance);
+    /* Cells overlapped by a box, clamped to the grid */
+    void cellRange(const Box &box, int &x0, int &y0, int &x1, int &y1) const;
+    /* List the object in the cells of its box, or take it out of them */
+    void insert(int object);
+    void erase(int object);
+
+    int size = 0;
+    float cell_size = 1.0f;
+    float top = 0.0f; /* Height of the tallest object */
+    std::vector<Box> boxes;
+    std::vector<unsigned char> removed;
+    std::vector<int> free_objects; /* Indices of the removed objects */
+    bool built = false;
+    /* Slots of cell c : offsets[c] to offsets[c + 1] - 1, the first counts[c] used */
+    std::vector<int> offsets;
+    std::vector<int> counts;
+    std::vector<int> objects;
+    std::unordered_map<int, std::vector<int>> overflow; /* Objects added to full cells, by cell */
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+/*
+ * Random numbers of the whole run, drawn from one seeded engine.
+ * Two runs with the same seed place the same scenery and move the clouds the same way.
+ * Not thread safe : only use it from the render thread.
+ */
+
+/* Reset the engine with seed */
+void seedRandom(uint32_t seed);
+/* Seed of the run. Drawn from std::random_device if seedRandom was never called */
+uint32_t randomSeed();
+std::mt19937 &randomEngine();
+
+float randomFloat(float min, float max);
+int randomInt(int min, int max);
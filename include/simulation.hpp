@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "layout.hpp"
+
+/* Parameters of a simulation run */
+struct SimulationSettings
+{
+    int trains = 4;
+    double hours = 1000.0;      /* Simulated time */
+    double dwell = 30.0;        /* Stop at the origin station, in seconds */
+    double speed = 60.0;        /* Mean top speed, km/h. Each train gets +-10% */
+    int block_cells = 1;        /* Cells per signalling block */
+    unsigned int nb_threads = 0; /* 0 : one per core, if there are enough trains */
+};
+
+/* Aggregate results of a run */
+struct SimulationStats
+{
+    double simulated_hours = 0.0;
+    double wall_seconds = 0.0;
+    long arrivals = 0;           /* Stops at the origin station */
+    double headway_mean = 0.0;   /* Seconds between two arrivals at the station */
+    double headway_min = 0.0;
+    double headway_max = 0.0;
+    long laps = 0;
+    double mean_speed = 0.0;     /* km/h, stops and waits included */
+    double blocked_ratio = 0.0;  /* Share of train time spent waiting for a free block */
+    double dwell_ratio = 0.0;    /* Share of train time spent at the station */
+};
+
+/*
+ * Timetable simulation of trains running around the path of a layout, without any GL.
+ * The path is cut in fixed signalling blocks : a train only enters a block if it is free,
+ * and stops for a dwell time at the track cell next to the origin station.
+ * Train state is stored as parallel arrays (one per field) and every step runs in two
+ * phases over contiguous ranges of trains, one range per thread:
+ *  1. each train moves, reading block occupancy from the previous step only
+ *  2. each train updates the blocks it left and entered
+ * A block can only be entered from the block behind it, so no two trains ever write the
+ * same entry and the result does not depend on the number of threads.
+ * Branches are ignored : trains only follow the path.
+ */
+class Simulation
+{
+public:
+    /* Place the trains evenly on the path. Errors are printed on std::cerr */
+    bool init(const Layout &layout, const SimulationSettings &settings);
+    /* Run settings.hours of simulated time */
+    SimulationStats run();
+    /* Most trains the path can hold and still move : one per block, with one block free */
+    int maxTrains() const { return nb_blocks - 1; }
+
+private:
+    /* Phase 1 for trains [begin, end) */
+    void moveTrains(int begin, int end);
+    /* Phase 2 for trains [begin, end) */
+    void updateBlocks(int begin, int end);
+    /* Position where block ends on the path, in cells */
+    double blockEnd(int block) const;
+
+    SimulationSettings settings;
+    int path_length = 0; /* In cells */
+    int nb_blocks = 0;
+    int station_cell = -1; /* Index on the path, -1 if the origin is not next to it */
+    std::vector<int> occupant; /* Train in each block, -1 if free */
+
+    /* Trains, one entry each */
+    std::vector<double> position;  /* Cells from the first cell of the path */
+    std::vector<double> speed;     /* Cells per second */
+    std::vector<double> dwell_left;
+    std::vector<int> block;
+    std::vector<int> next_block;
+    std::vector<double> distance;
+    std::vector<double> blocked_time;
+    std::vector<double> dwell_time;
+    std::vector<long> laps;
+
+    /* Station arrivals : at most one per step (one train per block), written by its thread */
+    long arrivals = 0;
+    double last_arrival = -1.0;
+    double headway_sum = 0.0;
+    double headway_min = 0.0;
+    double headway_max = 0.0;
+    double now = 0.0;
+};
+
+/* Command line front end : ./the_train --simulate file.json [options]. Returns the exit code */
+int simulateLayout(int argc, char **argv);
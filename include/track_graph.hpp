@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "layout.hpp"
+#include "vector2d.hpp"
+
+/*
+ * Track network of a layout : every track cell (path and branches) is a node and every
+ * link between two adjacent tracks an edge. A cell has at most 4 neighbours, so each node
+ * has 4 slots of edges : the neighbours of node n are targets[4n] to targets[4n + degree(n) - 1],
+ * lower row first then left to right, and edge 4n + k goes from n to its k-th neighbour.
+ * build() sorts the nodes by row then column, so cells close on the grid are close in memory.
+ * update() only relinks the nodes around edited cells : new nodes are appended and the last
+ * node takes the place of a removed one, so an edit costs the same on any size of network.
+ *
+ * A train can not take every pair of connections of a node:
+ *  - a switch is a node with 3 connections : the trunk, opposite the straight leg, and the
+ *    diverging leg, perpendicular to them (as drawn). A train goes between the trunk and
+ *    either leg, never from one leg to the other
+ *  - a crossing is a node with 4 connections, only crossed straight
+ *  - a buffer stop (1 connection) is the only place where a train reverses
+ * Routes are therefore searched over the directed edges : edge e, from u to v, is the state
+ * of a train on v that came from u.
+ *
+ * Routes are answered in two ways:
+ *  - route() runs A* between any two nodes, with the Manhattan distance as heuristic
+ *  - nextHop() and routeToStation() read the shortest-path tree of each station over the
+ *    directed edges, so each step of a route is a single array read. A tree spans the whole
+ *    network : it is only built on the first query of its station, and build() and update()
+ *    drop them all
+ * The state of a switch is the leg joined to its trunk; alignSwitches() sets the switches
+ * along a route.
+ */
+class TrackGraph
+{
+public:
+    /* Rebuild everything from the path and branches of layout */
+    void build(const Layout &layout);
+    /* Follow an edit of layout that added, removed or relinked tracks on cells (may repeat).
+       Node numbers change : the last node takes the number of a removed one */
+    void update(const Layout &layout, const std::vector<Vector2D> &cells);
+
+    int nodeCount() const { return cells.size(); }
+    /* Node on cell, -1 if there is no track */
+    int node(const Vector2D &cell) const;
+    const Vector2D &cell(int node) const { return cells[node]; }
+    int degree(int node) const { return degrees[node]; }
+    const int *neighbours(int node) const { return targets.data() + MAX_DEGREE * node; }
+    /* Piece to draw on node, deduced from its connections */
+    PieceKind pieceKind(int node) const;
+    /* Whether a train entering node from neighbours(node)[in] may leave by neighbours(node)[out] */
+    bool canPass(int node, int in, int out) const;
+
+    /* ---SWITCHES--- */
+
+    /* Index in neighbours(node) of the trunk of a switch */
+    int switchTrunk(int node) const { return switch_trunk[node]; }
+    /* Index in neighbours(node) of the leg joined to the trunk */
+    int switchState(int node) const { return switch_state[node]; }
+    /* Join leg (not the trunk) to the trunk */
+    bool setSwitch(int node, int leg);
+    /* Set the switches on route so that a train follows it. Returns how many changed */
+    int alignSwitches(const std::vector<int> &route);
+
+    /* ---ROUTES--- */
+
+    /* Shortest route a train standing on from can drive to to (both included), leaving in
+       any direction. Not thread safe : work buffers are shared */
+    bool route(int from, int to, std::vector<int> &path);
+
+    int stationCount() const { return station_nodes.size(); }
+    /* Track node serving station s (next to it), -1 if there is none */
+    int stationNode(int s) const { return station_nodes[s]; }
+    /* Next node towards station s of a train on node that came from node previous (-1 : standing,
+       any direction). node itself once there, -1 if the station cannot be reached.
+       These queries build the tree of s if an update dropped it : not thread safe */
+    int nextHop(int node, int s, int previous = -1);
+    /* Number of moves to station s, -1 if it cannot be reached */
+    int distanceToStation(int node, int s, int previous = -1);
+    /* Route to station s of a train standing on from */
+    bool routeToStation(int from, int s, std::vector<int> &path);
+
+private:
+    /* One slot per side of a cell */
+    static const int MAX_DEGREE = 4;
+
+    int addNode(const Vector2D &cell);
+    /* The last node takes the number of node */
+    void removeNode(int node);
+    /* Edges of node to the adjacent tracks linked to its cell */
+    void linkNode(const Layout &layout, int node);
+    /* Reverse of the edges of node, both ways */
+    void linkReverse(int node);
+    /* Trunk and straight leg of node, if it is a switch */
+    void findSwitchTrunk(int node);
+    /* Track next to each station */
+    void findStationNodes(const Layout &layout);
+    /* Tree of station s, built on the first query after a change of the network */
+    void prepareStationTree(int s);
+    /* Edge from node from to node to, -1 if they are not linked */
+    int edge(int from, int to) const;
+    /* Edge of station s a train on node and leaving in any direction should take (the
+       shortest way), -1 if none leads to the station */
+    int bestEdge(int node, int s) const;
+    /* Breadth-first search, backwards over the directed edges, from the node of station s */
+    void buildStationTree(int s);
+
+    std::vector<Vector2D> cells;
+    std::unordered_map<Vector2D, int, Vector2DHash> index;
+    std::vector<uint8_t> degrees;
+    std::vector<int> targets;
+    std::vector<int> reverse; /* Edge v -> u of each edge u -> v */
+    std::vector<uint8_t> switch_trunk;
+    std::vector<uint8_t> switch_state;
+
+    std::vector<int> station_nodes;
+    /* Tree of each station, empty until its first query : per directed edge, the next edge
+       towards the station (the edge itself once on the station node) and the moves left */
+    std::vector<std::vector<int>> tree_next;
+    std::vector<std::vector<int>> tree_dist;
+    std::vector<uint8_t> tree_built;
+
+    /* A* work buffers, per directed edge, kept between queries : an entry is only valid if its stamp is current */
+    std::vector<uint32_t> visit_stamp;
+    std::vector<int> cost;
+    std::vector<int> parent;
+    std::vector<std::pair<int, int>> open; /* (-estimated length, edge) heap */
+    uint32_t stamp = 0;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * Check layout files without any GL initialisation.
+ * paths may contain files and directories (their *.json files are checked).
+ * Files are spread over nb_threads workers (0 : one per core). One line is printed
+ * per file, in the order given, then a summary.
+ * Returns the exit code of the program : 0 if every file is valid.
+ */
+int validateLayouts(const std::vector<std::string> &paths, unsigned int nb_threads = 0);
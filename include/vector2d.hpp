@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
+#include <vector>
 
 struct Vector2D
 {
@@ -40,6 +43,11 @@ struct Vector2DHash
 {
     std::size_t operator()(const Vector2D &c) const
     {
-        return std::hash<int>()(c.x) ^ (std::hash<int>()(c.y) << 1);
+        /* Pack both coordinates and mix them, so that neighbouring cells spread over the buckets */
+        uint64_t h = (uint64_t(uint32_t(c.x)) << 32) | uint32_t(c.y);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
     }
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of threads running batches of independent tasks.
+ * run(count, task) gives each worker a contiguous share of the task indices; a worker
+ * takes its own tasks from the front of its queue and, once it has none left, steals
+ * from the back of the others, so uneven tasks are balanced without a shared counter.
+ * The calling thread is worker 0 and the threads sleep between batches.
+ */
+class WorkPool
+{
+public:
+    /* nb_threads workers, calling thread included (0 : one per core) */
+    explicit WorkPool(unsigned int nb_threads = 0);
+    ~WorkPool();
+
+    /* Call task(index, worker) for every index in [0, count) and wait for all of them.
+     * worker is in [0, size()) : tasks of one worker never run at the same time */
+    void run(size_t count, const std::function<void(size_t, unsigned int)> &task);
+    unsigned int size() const { return nb_workers; }
+    /* Tasks taken from the queue of another worker, since the pool was created */
+    unsigned long steals() const { return nb_steals; }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void threadLoop(unsigned int worker);
+    /* Run tasks until every queue is empty */
+    void work(unsigned int worker);
+    bool pop(unsigned int worker, size_t &index);
+
+    unsigned int nb_workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+
+    /* Current batch, published under batch_mutex */
+    std::mutex batch_mutex;
+    std::condition_variable batch_changed;
+    const std::function<void(size_t, unsigned int)> *batch_task = NULL;
+    unsigned long batch_id = 0;
+    std::condition_variable batch_done;
+    unsigned int active = 0; /* Threads still working on the current batch */
+    bool stopping = false;
+    std::atomic<unsigned long> nb_steals{0};
+};
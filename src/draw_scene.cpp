@@ -3,21 +3,20 @@
 #include <functional>
 #include "draw_scene.hpp"
 #include "vector2d.hpp"
-#include "glbasimac/glbi_texture.hpp"
+#include "random.hpp"
+#include "glbasimac/glbi_render_queue.hpp"
+#include "glbasimac/glbi_geometry_cache.hpp"
+#include "glbasimac/glbi_scene_graph.hpp"
+#include "work_pool.hpp"
+#include "pick_grid.hpp"
+#include "particles.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "tools/stb_image.h"
 #include <utility>
 #include <algorithm>
-#include <random>
-#include <unordered_set>
-
-struct PairHash
-{
-    std::size_t operator()(const std::pair<int, int> &p) const
-    {
-        return std::hash<int>()(p.first) ^ (std::hash<int>()(p.second) << 1);
-    }
-};
+#include <memory>
+#include <sstream>
+#include <unordered_map>
 
 /* Camera */
 Vector3D camera_pos;
@@ -35,6 +34,7 @@ StandardMesh *ground = NULL;
 static const float SR = 0.5f;
 static const float POS_X_RAIL1 = 3.0f;
 static const float POS_X_RAIL2 = 7.0f;
+static const Vector3D RAIL_COLOR{0.2f, 0.2f, 0.2f};
 
 /* Straight rail */
 static const int STRAIGHT_TRACK_BALLAST_COUNT = 5;
@@ -42,6 +42,7 @@ GLBI_Convex_2D_Shape straightRail{3};
 
 /* Curved rail */
 static const int CURVED_TRACK_BALLAST_COUNT = 3;
+static const int CURVE_SUBDIVISION = 10;
 GLBI_Convex_2D_Shape iternalCurvedRail{3};
 GLBI_Convex_2D_Shape externalCurvedRail{3};
 
@@ -49,6 +50,7 @@ GLBI_Convex_2D_Shape externalCurvedRail{3};
 static const float RR = 0.25f;
 static const float BALLAST_X_START = 2.0f;
 static const float BALLAST_X_END = 8.0f;
+static const Vector3D BALLAST_COLOR{0.4f, 0.2f, 0.0f};
 IndexedMesh *ballast = NULL;
 StandardMesh *ballast_side = NULL;
 
@@ -71,6 +73,7 @@ static const float TRAIN_X_START = 2.0f;
 static const float TRAIN_X_END = 8.0f;
 GLBI_Convex_2D_Shape train{3};
 static const float TRAIN_WHEEL_RADIUS = 1.0f;
+static const Vector3D WHEEL_COLOR{0.6f, 0.0f, 0.0f};
 IndexedMesh *train_wheel = NULL;
 StandardMesh *train_wheel_side = NULL;
 static const float TRAIN_CHIMNEY_HEIGHT = 2.5f;
@@ -85,7 +88,6 @@ GLBI_Convex_2D_Shape trunk{3};
 static const float LEAF_WIDTH = 7.0f;
 static const float LEAF_HEIGHT = 9.0f;
 GLBI_Convex_2D_Shape leaf{3};
-std::vector<std::pair<int, int>> tree_pos{};
 
 /* Building */
 static const int BUILDING_SIZE = 7;
@@ -94,41 +96,128 @@ static const float BLACK_BUILDING_WIDTH = 6.0f;
 GLBI_Convex_2D_Shape black_building{3};
 static const float GRAY_BUILDING_WIDTH = 10.0f;
 GLBI_Convex_2D_Shape gray_building{3};
-std::vector<std::pair<int, int>> building_pos{};
 
-/* Clouds */
-Vector3D cloud_1_pos{};
-float cloud_1_anim = 0.0f;
-float cloud_1_speed;
-float cloud_1_max_y_pos;
-GLBI_Convex_2D_Shape cloud_1{3};
+/* Scenery counts are given for this many cells and scaled with the grid area */
+static const float SCENERY_REFERENCE_AREA = 100.0f;
 
-Vector3D cloud_2_pos{};
-float cloud_2_anim = 0.0f;
-float cloud_2_speed;
-float cloud_2_max_y_pos;
-GLBI_Convex_2D_Shape cloud_2{3};
+/* Clouds and chimney smoke, simulated on the GPU */
+ParticleSystem particles;
+/* Simulated time of a frame : fixed, so that a replay moves the clouds the same way */
+static const float PARTICLE_STEP = 1.0f / 30.0f;
+/* Height of the smoke source above the base of the chimney hat */
+static const float SMOKE_SOURCE_HEIGHT = 1.0f;
 
-stbi_uc *img;
-GLBI_Texture grass_texture;
+/* Materials of the scene, registered in the material table of the engine by initMaterials */
+enum SceneMaterial
+{
+    MAT_GROUND,
+    MAT_RAIL,
+    MAT_BALLAST,
+    MAT_STATION_GROUND,
+    MAT_PLATFORM,
+    MAT_BENCH,
+    MAT_STRIP,
+    MAT_WHEEL,
+    MAT_TRAIN,
+    MAT_CHIMNEY,
+    MAT_CHIMNEY_HAT,
+    MAT_TRUNK,
+    MAT_LEAF,
+    MAT_BLACK_BUILDING,
+    MAT_GRAY_BUILDING,
+    MAT_COUNT
+};
+/* The ground takes the material of each cell from the splat map */
+static const Vector3D MATERIAL_COLORS[MAT_COUNT] = {
+    Vector3D{1.0f, 1.0f, 1.0f}, RAIL_COLOR, BALLAST_COLOR, Vector3D{0.2f, 0.2f, 0.2f},
+    Vector3D{0.25f, 0.25f, 0.25f}, Vector3D{0.4f, 0.2f, 0.0f}, Vector3D{0.6f, 0.5f, 0.0f}, WHEEL_COLOR,
+    Vector3D{0.1f, 0.1f, 0.1f}, Vector3D{0.2f, 0.2f, 0.2f}, Vector3D{0.1f, 0.1f, 0.1f}, Vector3D{0.3f, 0.15f, 0.15f},
+    Vector3D{0.0f, 0.4f, 0.0f}, Vector3D{0.1f, 0.1f, 0.1f}, Vector3D{0.4f, 0.4f, 0.4f}};
+/* Index of every scene material in the table */
+unsigned int material_ids[MAT_COUNT];
+
+/* Surfaces of the ground cells, by TerrainKind. Grass is modulated by its texture, gravel and
+   water by a generated noise layer, platforms are plain */
+static const int TERRAIN_COUNT = int(TerrainKind::Count);
+static const Vector3D TERRAIN_COLORS[TERRAIN_COUNT] = {
+    Vector3D{1.0f, 1.0f, 1.0f}, Vector3D{0.55f, 0.5f, 0.45f}, Vector3D{0.35f, 0.35f, 0.35f}, Vector3D{0.2f, 0.35f, 0.6f}};
+/* Side of the noise layer, in pixels */
+static const int NOISE_LAYER_SIZE = 64;
+/* Index of every terrain material in the table, once initMaterials has registered them */
+unsigned int terrain_material_ids[TERRAIN_COUNT];
+bool terrain_materials_ready = false;
 
 GLBI_Engine myEngine;
 
-float randomFloat(float min, float max)
+/* Track layout, edited in place */
+Layout layout;
+TrackGraph track_graph;
+
+/* Draws of the frame, sorted and submitted at the end of renderScene */
+GLBI_Render_Queue render_queue;
+
+/* Transform hierarchy of the scene, in world coordinates. Built once by buildSceneGraph,
+   through builder, then only the moving nodes are updated every frame */
+GLBI_Scene_Graph scene_graph;
+GLBI_Scene_Builder *builder = NULL;
+bool scene_graph_dirty = true;
+int built_shader = -1;
+
+/* Nodes and draws added to the scene graph by one part of the scene */
+struct GraphRange
 {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> dist(min, max);
-    return dist(gen);
-}
+    int first_node, last_node;
+    int first_draw, last_draw;
+};
+GraphRange ground_range{}, train_range{};
+/* Node of the chimney hat, where the smoke comes out (-1 without a train) */
+int chimney_node = -1;
+/* Nodes left behind by the parts of the scene built again at the end of the graph */
+int orphan_nodes = 0;
+bool train_dirty = false;
+
+/* Square blocks of cells, each recorded by one task of the work pool */
+static const int REGION_CELLS = 16;
+/* Top of the tallest scenery (buildings), for the bounds of a region */
+static const float REGION_HEIGHT = BUILDING_SIZE * 2.0f * BUILDING_HEIGHT;
+
+struct Region
+{
+    Vector2D first; /* Lowest cell */
+    std::vector<Vector2D> tracks; /* Cells, as node numbers change with the edits of the network */
+    std::vector<Vector2D> stations;
+    std::vector<std::pair<Vector2D, SceneryKind>> scenery;
+    GraphRange range;
+    GLBI_Draw_List list; /* Draws of the last frame, reused while the region is visible and unchanged */
+    bool recorded = false;
+    bool dirty = false; /* Sorted again since its nodes were built */
+};
+std::vector<Region> regions;
+std::vector<int> dirty_regions;
 
-int randomInt(int min, int max)
+/* Objects that can be picked, indexed by the cells they overlap. Built with the regions, then
+   updated with them */
+struct PickObject
 {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dist(min, max);
-    return dist(gen);
-}
+    PickKind kind;
+    Vector2D cell;
+};
+PickGrid pick_grid;
+std::vector<PickObject> pick_objects;
+/* Pick objects on each cell, but the train */
+std::unordered_multimap<Vector2D, int, Vector2DHash> pick_cells;
+int pick_train = -1;
+
+unsigned int record_threads = 0;
+std::unique_ptr<WorkPool> record_pool;
+
+/* Meshes that only depend on the constants above, kept between runs */
+GLBI_Geometry_Cache geometry_cache;
+/* Divisions around basicCylinder and basicCone meshes */
+static const unsigned int ROUND_DIVISIONS = 64;
+/* Cylinders and cones are a few units large : half coordinates keep them within a hundredth,
+   and their normals and texture coordinates never need more than 10 and 16 bits */
+static const VertexLayout ROUND_MESH_LAYOUT = VertexLayout::compact();
 
 void add_triangle(std::vector<float> &in_coord, Vector3D a, Vector3D b, Vector3D c)
 {
@@ -172,89 +261,30 @@ void add_rectangle_triangles(std::vector<float> &in_coord, const Vector3D &origi
     add_triangle(in_coord, {origin.x, origin.y + length, origin.z + height}, {origin.x + width, origin.y + length, origin.z + height}, {origin.x + width, origin.y, origin.z + height});
 }
 
-/* ---INITIALIZATION--- */
-
-void init_set_positions(const nlohmann::json &data)
-{
-    const auto sizeGrid = data["size_grid"].get<int>();
-    std::vector<std::pair<int, int>> set_pos{};
-    for (auto y = 0; y < sizeGrid; y++)
-        for (auto x = 0; x < sizeGrid; x++)
-            set_pos.emplace_back(x, y);
-
-    auto origin = data["origin"].get<std::pair<int, int>>();
-    const auto path = data["path"].get<std::unordered_set<std::pair<int, int>, PairHash>>();
-    set_pos.erase(
-        std::remove_if(set_pos.begin(), set_pos.end(), [&origin, &path](const std::pair<int, int> &p)
-                       { return p == origin || path.find(p) != path.end(); }),
-        set_pos.end());
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::shuffle(set_pos.begin(), set_pos.end(), gen);
-
-    int tree_count = randomInt(2, 7);
-    for (int i = 0; i < tree_count && !set_pos.empty(); i++)
-    {
-        tree_pos.push_back(set_pos.back());
-        set_pos.pop_back();
-    }
-
-    int building_count = randomInt(1, 3);
-    for (int i = 0; i < building_count && !set_pos.empty(); i++)
-    {
-        building_pos.push_back(set_pos.back());
-        set_pos.pop_back();
-    }
-}
-
-void initCamera(const nlohmann::json &data)
-{
-    float sizeGrid = data["size_grid"].get<int>() * CELL_SIZE;
-    camera_pos = Vector3D{sizeGrid / 2.0f, sizeGrid / 2.0f, 27.0f};
-}
-
-void initGround(const nlohmann::json &data)
-{
-    float sizeGrid = data["size_grid"].get<int>() * CELL_SIZE;
-    ground = basicRect(sizeGrid, sizeGrid);
-    ground->createVAO();
-}
-
-void initStraightRail()
-{
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{0.0f, 0.0f, 0.0f}, SR, SR, CELL_SIZE);
-    straightRail.initShape(in_coord);
-    straightRail.changeNature(GL_TRIANGLES);
-}
-
-void initInternalCurvedRail()
+/* Quarter circle rail of the given radius, around the corner of the cell */
+void add_curved_rail_triangles(std::vector<float> &in_coord, float radius)
 {
-    const int subdivision = 10;
-    std::vector<float> in_coord{};
-
-    for (auto i = 0; i < subdivision; i++)
+    for (auto i = 0; i < CURVE_SUBDIVISION; i++)
     {
-        float angle1 = (M_PI / 2.0f) * i / subdivision;
-        float angle2 = (M_PI / 2.0f) * (i + 1) / subdivision;
+        float angle1 = (M_PI / 2.0f) * i / CURVE_SUBDIVISION;
+        float angle2 = (M_PI / 2.0f) * (i + 1) / CURVE_SUBDIVISION;
 
         /* Left face */
-        float x1 = (POS_X_RAIL1 - SR / 2.0f) * std::cos(angle1);
-        float y1 = (POS_X_RAIL1 - SR / 2.0f) * std::sin(angle1);
+        float x1 = (radius - SR / 2.0f) * std::cos(angle1);
+        float y1 = (radius - SR / 2.0f) * std::sin(angle1);
 
-        float x2 = (POS_X_RAIL1 - SR / 2.0f) * std::cos(angle2);
-        float y2 = (POS_X_RAIL1 - SR / 2.0f) * std::sin(angle2);
+        float x2 = (radius - SR / 2.0f) * std::cos(angle2);
+        float y2 = (radius - SR / 2.0f) * std::sin(angle2);
 
         add_triangle(in_coord, {x1, y1, 0.0f}, {x1, y1, SR}, {x2, y2, 0.0f});
         add_triangle(in_coord, {x1, y1, SR}, {x2, y2, SR}, {x2, y2, 0.0f});
 
         /* Right face */
-        float x3 = (POS_X_RAIL1 + SR / 2.0f) * std::cos(angle1);
-        float y3 = (POS_X_RAIL1 + SR / 2.0f) * std::sin(angle1);
+        float x3 = (radius + SR / 2.0f) * std::cos(angle1);
+        float y3 = (radius + SR / 2.0f) * std::sin(angle1);
 
-        float x4 = (POS_X_RAIL1 + SR / 2.0f) * std::cos(angle2);
-        float y4 = (POS_X_RAIL1 + SR / 2.0f) * std::sin(angle2);
+        float x4 = (radius + SR / 2.0f) * std::cos(angle2);
+        float y4 = (radius + SR / 2.0f) * std::sin(angle2);
 
         add_triangle(in_coord, {x3, y3, 0.0f}, {x3, y3, SR}, {x4, y4, 0.0f});
         add_triangle(in_coord, {x3, y3, SR}, {x4, y4, SR}, {x4, y4, 0.0f});
@@ -275,234 +305,294 @@ void initInternalCurvedRail()
         }
 
         /* Back face */
-        if (i == subdivision - 1)
+        if (i == CURVE_SUBDIVISION - 1)
         {
             add_triangle(in_coord, {x2, y2, 0.0f}, {x2, y2, SR}, {x4, y4, 0.0f});
             add_triangle(in_coord, {x4, y4, 0.0f}, {x2, y2, SR}, {x4, y4, SR});
         }
     }
-
-    iternalCurvedRail.initShape(in_coord);
-    iternalCurvedRail.changeNature(GL_TRIANGLES);
 }
 
-void initExternalCurvedRail()
-{
-    const int subdivision = 10;
-    std::vector<float> in_coord{};
-
-    for (auto i = 0; i < subdivision; i++)
-    {
-        float angle1 = (M_PI / 2.0f) * i / subdivision;
-        float angle2 = (M_PI / 2.0f) * (i + 1) / subdivision;
+/* ---GEOMETRY CACHE--- */
 
-        /* Left face */
-        float x1 = (POS_X_RAIL2 - SR / 2.0f) * std::cos(angle1);
-        float y1 = (POS_X_RAIL2 - SR / 2.0f) * std::sin(angle1);
+/* Box of add_rectangle_triangles */
+struct Box
+{
+    Vector3D origin;
+    float width, height, length;
+};
 
-        float x2 = (POS_X_RAIL2 - SR / 2.0f) * std::cos(angle2);
-        float y2 = (POS_X_RAIL2 - SR / 2.0f) * std::sin(angle2);
+/* Fill shape with the triangles of generate, or with the ones it made in an earlier run */
+void initCachedShape(GLBI_Convex_2D_Shape &shape, const GLBI_Geometry_Key &key, const std::function<void(std::vector<float> &)> &generate)
+{
+    shape.initShape(geometry_cache.fetch(key, [&]()
+                                         { std::vector<float> in_coord{};
+                                           generate(in_coord);
+                                           return GLBI_Geometry_Data(GL_TRIANGLES, std::move(in_coord)); }));
+}
 
-        add_triangle(in_coord, {x1, y1, 0.0f}, {x1, y1, SR}, {x2, y2, 0.0f});
-        add_triangle(in_coord, {x1, y1, SR}, {x2, y2, SR}, {x2, y2, 0.0f});
+/* Shape made of boxes. The key is made of the boxes, so any change of their sizes regenerates it */
+void initBoxShape(GLBI_Convex_2D_Shape &shape, const std::vector<Box> &boxes)
+{
+    GLBI_Geometry_Key key{"boxes"};
+    for (const auto &box : boxes)
+        key.add(box.origin.x).add(box.origin.y).add(box.origin.z).add(box.width).add(box.height).add(box.length);
+    initCachedShape(shape, key, [&](std::vector<float> &in_coord)
+                    { for (const auto &box : boxes)
+                          add_rectangle_triangles(in_coord, box.origin, box.width, box.height, box.length); });
+}
 
-        /* Right face */
-        float x3 = (POS_X_RAIL2 + SR / 2.0f) * std::cos(angle1);
-        float y3 = (POS_X_RAIL2 + SR / 2.0f) * std::sin(angle1);
+IndexedMesh *cachedCylinder(float height, float radius)
+{
+    GLBI_Geometry_Key key{"basic_cylinder"};
+    key.add(height).add(radius).add(ROUND_DIVISIONS);
+    return geometry_cache.fetch(key, [&]()
+                                { std::unique_ptr<IndexedMesh> mesh(basicCylinder(height, radius, ROUND_DIVISIONS));
+                                  return GLBI_Geometry_Data(*mesh); })
+        .createIndexedMesh(ROUND_MESH_LAYOUT);
+}
 
-        float x4 = (POS_X_RAIL2 + SR / 2.0f) * std::cos(angle2);
-        float y4 = (POS_X_RAIL2 + SR / 2.0f) * std::sin(angle2);
+StandardMesh *cachedCone(float height, float radius)
+{
+    GLBI_Geometry_Key key{"basic_cone"};
+    key.add(height).add(radius).add(ROUND_DIVISIONS);
+    return geometry_cache.fetch(key, [&]()
+                                { std::unique_ptr<StandardMesh> mesh(basicCone(height, radius, 0.0f, ROUND_DIVISIONS));
+                                  return GLBI_Geometry_Data(*mesh); })
+        .createStandardMesh(ROUND_MESH_LAYOUT);
+}
 
-        add_triangle(in_coord, {x3, y3, 0.0f}, {x3, y3, SR}, {x4, y4, 0.0f});
-        add_triangle(in_coord, {x3, y3, SR}, {x4, y4, SR}, {x4, y4, 0.0f});
+/* ---INITIALIZATION--- */
 
-        /* Bottom face */
-        add_triangle(in_coord, {x1, y1, 0.0f}, {x3, y3, 0.0f}, {x2, y2, 0.0f});
-        add_triangle(in_coord, {x3, y3, 0.0f}, {x4, y4, 0.0f}, {x2, y2, 0.0f});
+void init_set_positions()
+{
+    /* Same density as 2-7 trees and 1-3 buildings on the smallest (10x10) grid */
+    const float area = layout.sizeGrid() * layout.sizeGrid() / SCENERY_REFERENCE_AREA;
+    layout.placeScenery(randomInt(2, 7) * area, randomInt(1, 3) * area);
+}
 
-        /* Top face */
-        add_triangle(in_coord, {x1, y1, SR}, {x3, y3, SR}, {x2, y2, SR});
-        add_triangle(in_coord, {x3, y3, SR}, {x4, y4, SR}, {x2, y2, SR});
+/* Index of the region holding cell. Cells out of the grid go to the nearest region */
+int regionOf(const Vector2D &cell)
+{
+    const int per_side = (layout.sizeGrid() + REGION_CELLS - 1) / REGION_CELLS;
+    int rx = std::min(std::max(cell.x / REGION_CELLS, 0), per_side - 1);
+    int ry = std::min(std::max(cell.y / REGION_CELLS, 0), per_side - 1);
+    return ry * per_side + rx;
+}
 
-        /* Front face */
-        if (i == 0)
+void buildRegions()
+{
+    const int per_side = (layout.sizeGrid() + REGION_CELLS - 1) / REGION_CELLS;
+    regions.resize(per_side * per_side);
+    for (int ry = 0; ry < per_side; ry++)
+    {
+        for (int rx = 0; rx < per_side; rx++)
         {
-            add_triangle(in_coord, {x1, y1, 0.0f}, {x1, y1, SR}, {x3, y3, 0.0f});
-            add_triangle(in_coord, {x3, y3, 0.0f}, {x1, y1, SR}, {x3, y3, SR});
+            Region &region = regions[ry * per_side + rx];
+            region.first = Vector2D{rx * REGION_CELLS, ry * REGION_CELLS};
+            region.tracks.clear();
+            region.stations.clear();
+            region.scenery.clear();
         }
+    }
 
-        /* Back face */
-        if (i == subdivision - 1)
+    for (int node = 0; node < track_graph.nodeCount(); node++)
+        regions[regionOf(track_graph.cell(node))].tracks.push_back(track_graph.cell(node));
+    for (const auto &station : layout.allStations())
+        regions[regionOf(station)].stations.push_back(station);
+    for (const auto &s : layout.allScenery())
+        regions[regionOf(s.first)].scenery.push_back(s);
+    scene_graph_dirty = true;
+    buildPickGrid();
+}
+
+/* Sort the cells of one region again, from the layout and the track graph */
+void fillRegion(Region &region)
+{
+    region.tracks.clear();
+    region.stations.clear();
+    region.scenery.clear();
+    const int x_end = std::min(region.first.x + REGION_CELLS, layout.sizeGrid());
+    const int y_end = std::min(region.first.y + REGION_CELLS, layout.sizeGrid());
+    for (int y = region.first.y; y < y_end; y++)
+    {
+        for (int x = region.first.x; x < x_end; x++)
         {
-            add_triangle(in_coord, {x2, y2, 0.0f}, {x2, y2, SR}, {x4, y4, 0.0f});
-            add_triangle(in_coord, {x4, y4, 0.0f}, {x2, y2, SR}, {x4, y4, SR});
+            const Vector2D cell{x, y};
+            if (track_graph.node(cell) >= 0)
+                region.tracks.push_back(cell);
+            if (layout.isStation(cell))
+                region.stations.push_back(cell);
+            auto it = layout.allScenery().find(cell);
+            if (it != layout.allScenery().end())
+                region.scenery.push_back(*it);
         }
     }
-
-    externalCurvedRail.initShape(in_coord);
-    externalCurvedRail.changeNature(GL_TRIANGLES);
 }
 
-void initBallast()
+void updateRegions(const std::vector<Vector2D> &cells)
 {
-    ballast = basicCylinder(BALLAST_X_END - BALLAST_X_START, RR);
-    ballast->createVAO();
+    /* The piece drawn on a track depends on its neighbours, which may be in the next region */
+    static const Vector2D AROUND[] = {Vector2D{0, 0}, Vector2D{1, 0}, Vector2D{-1, 0}, Vector2D{0, 1}, Vector2D{0, -1}};
+    std::vector<int> touched{};
+    for (const auto &cell : cells)
+    {
+        for (const auto &side : AROUND)
+            touched.push_back(regionOf(cell + side));
+        /* The train stands on the first cell, turned towards the next one */
+        if (cell.manhattanDistance(layout.first()) <= 1 || (pick_train >= 0 && cell.manhattanDistance(pick_objects[pick_train].cell) <= 1))
+            train_dirty = true;
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (int r : touched)
+    {
+        fillRegion(regions[r]);
+        if (!regions[r].dirty)
+            dirty_regions.push_back(r);
+        regions[r].dirty = true;
+    }
+    updatePickGrid(cells);
 }
 
-void initBallastSide()
+void initCamera(const nlohmann::json &data)
 {
-    ballast_side = basicCone(0.0f, RR);
-    ballast_side->createVAO();
+    float sizeGrid = data["size_grid"].get<int>() * CELL_SIZE;
+    camera_pos = Vector3D{sizeGrid / 2.0f, sizeGrid / 2.0f, 27.0f};
 }
 
-void initStationGround1()
+/* Send the material of every cell to the splat map of the ground */
+void uploadTerrain()
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{0.0f, 0.0f, 0.0f}, CELL_SIZE, STATION_GROUND_HEIGHT_1, CELL_SIZE);
-    station_ground_1.initShape(in_coord);
-    station_ground_1.changeNature(GL_TRIANGLES);
+    const int size = layout.sizeGrid();
+    if (!terrain_materials_ready || size <= 0)
+        return;
+    std::vector<unsigned char> cells(size_t(size) * size, terrain_material_ids[int(TerrainKind::Grass)]);
+    for (const auto &t : layout.allTerrain())
+        cells[size_t(t.first.y) * size + t.first.x] = terrain_material_ids[int(t.second)];
+    myEngine.materials.setSplatMap(size, size, cells);
 }
 
-void initStationGround2()
+/* Cells changed in place : one texel each */
+void uploadTerrainCells(const std::vector<Vector2D> &cells)
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{0.0f, 0.0f, 0.0f}, CELL_SIZE, STATION_GROUND_HEIGHT_2, CELL_SIZE);
-    station_ground_2.initShape(in_coord);
-    station_ground_2.changeNature(GL_TRIANGLES);
+    if (!terrain_materials_ready)
+        return;
+    for (const auto &cell : cells)
+        myEngine.materials.setSplatCell(cell.x, cell.y, terrain_material_ids[int(layout.terrainAt(cell))]);
 }
 
-void initBench()
+/* The ground is one quad whose texture coordinates span the grid : every cell is drawn by
+   the same draw, with the material of its terrain */
+void initGround(const nlohmann::json &data)
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{0.0f, 0.0f, 0.0f}, 0.25, BENCH_HEIGHT - 0.25, BENCH_LENGTH);               // Left foot
-    add_rectangle_triangles(in_coord, Vector3D{BENCH_WIDTH - 0.25, 0.0f, 0.0f}, 0.25, BENCH_HEIGHT - 0.25, BENCH_LENGTH); // Right foot
-    add_rectangle_triangles(in_coord, Vector3D{0.0f, 0.0f, BENCH_HEIGHT - 0.25}, BENCH_WIDTH, 0.25, BENCH_LENGTH);        // Top plank
-    bench.initShape(in_coord);
-    bench.changeNature(GL_TRIANGLES);
+    float sizeGrid = data["size_grid"].get<int>() * CELL_SIZE;
+    ground = basicRect(sizeGrid, sizeGrid);
+    ground->createVAO();
+    uploadTerrain();
 }
 
-void initStrip()
+void initStraightRail()
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{0.0f, 0.0f, 0.0f}, STRIP_WIDTH, STRIP_HEIGHT, STRIP_LENGTH);
-    strip.initShape(in_coord);
-    strip.changeNature(GL_TRIANGLES);
+    initBoxShape(straightRail, {{Vector3D{0.0f, 0.0f, 0.0f}, SR, SR, CELL_SIZE}});
 }
 
-void initTrain()
+void initInternalCurvedRail()
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{0.0f, 0.0f, 0.0f}, TRAIN_X_END - TRAIN_X_START, 4.0f, CELL_SIZE);
-    add_rectangle_triangles(in_coord, Vector3D{((TRAIN_X_END - TRAIN_X_START) - (TRAIN_X_END - TRAIN_X_START - 2.0f)) / 2.0f, 0.0f, 4.0f}, TRAIN_X_END - TRAIN_X_START - 2.0f, 2.0f, 2.0f * CELL_SIZE / 3.0f);
-    train.initShape(in_coord);
-    train.changeNature(GL_TRIANGLES);
+    GLBI_Geometry_Key key{"curved_rail"};
+    key.add(POS_X_RAIL1).add(SR).add(CURVE_SUBDIVISION);
+    initCachedShape(iternalCurvedRail, key, [](std::vector<float> &in_coord)
+                    { add_curved_rail_triangles(in_coord, POS_X_RAIL1); });
 }
 
-void initTrainWheel()
+void initExternalCurvedRail()
 {
-    train_wheel = basicCylinder(SR, TRAIN_WHEEL_RADIUS);
-    train_wheel->createVAO();
+    GLBI_Geometry_Key key{"curved_rail"};
+    key.add(POS_X_RAIL2).add(SR).add(CURVE_SUBDIVISION);
+    initCachedShape(externalCurvedRail, key, [](std::vector<float> &in_coord)
+                    { add_curved_rail_triangles(in_coord, POS_X_RAIL2); });
 }
 
-void initTrainWheelSide()
+void initBallast()
 {
-    train_wheel_side = basicCone(0.0f, TRAIN_WHEEL_RADIUS);
-    train_wheel_side->createVAO();
+    ballast = cachedCylinder(BALLAST_X_END - BALLAST_X_START, RR);
 }
 
-void initTrainChimney()
+void initBallastSide()
 {
-    train_chimney = basicCylinder(TRAIN_CHIMNEY_HEIGHT, TRAIN_CHIMNEY_RADIUS);
-    train_chimney->createVAO();
+    ballast_side = cachedCone(0.0f, RR);
 }
 
-void initTrainChimneyHat()
+void initStationGround1()
 {
-    train_chimney_hat = basicCone(1.0f, TRAIN_CHIMNEY_RADIUS * 2.0f);
-    train_chimney_hat->createVAO();
+    initBoxShape(station_ground_1, {{Vector3D{0.0f, 0.0f, 0.0f}, CELL_SIZE, STATION_GROUND_HEIGHT_1, CELL_SIZE}});
 }
 
-void initTrunk()
+void initStationGround2()
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{CELL_SIZE / 2.0f - TRUNK_WIDTH / 2.0f, CELL_SIZE / 2.0f - TRUNK_WIDTH / 2.0f, 0.0f}, TRUNK_WIDTH, TRUNK_HEIGHT, TRUNK_WIDTH);
-    trunk.initShape(in_coord);
-    trunk.changeNature(GL_TRIANGLES);
+    initBoxShape(station_ground_2, {{Vector3D{0.0f, 0.0f, 0.0f}, CELL_SIZE, STATION_GROUND_HEIGHT_2, CELL_SIZE}});
 }
 
-void initLeaf()
+void initBench()
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{CELL_SIZE / 2.0f - LEAF_WIDTH / 2.0f, CELL_SIZE / 2.0f - LEAF_WIDTH / 2.0f, TRUNK_HEIGHT}, LEAF_WIDTH, LEAF_HEIGHT, LEAF_WIDTH);
-    leaf.initShape(in_coord);
-    leaf.changeNature(GL_TRIANGLES);
+    initBoxShape(bench, {
+                     {Vector3D{0.0f, 0.0f, 0.0f}, 0.25, BENCH_HEIGHT - 0.25, BENCH_LENGTH}, // Left foot
+                     {Vector3D{BENCH_WIDTH - 0.25, 0.0f, 0.0f}, 0.25, BENCH_HEIGHT - 0.25, BENCH_LENGTH}, // Right foot
+                     {Vector3D{0.0f, 0.0f, BENCH_HEIGHT - 0.25}, BENCH_WIDTH, 0.25, BENCH_LENGTH} // Top plank
+                 });
 }
 
-void initBlackBuilding()
+void initStrip()
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{CELL_SIZE / 2.0f - BLACK_BUILDING_WIDTH / 2.0f, CELL_SIZE / 2.0f - BLACK_BUILDING_WIDTH / 2.0f, 0.0f}, BLACK_BUILDING_WIDTH, BUILDING_HEIGHT, BLACK_BUILDING_WIDTH);
-    black_building.initShape(in_coord);
-    black_building.changeNature(GL_TRIANGLES);
+    initBoxShape(strip, {{Vector3D{0.0f, 0.0f, 0.0f}, STRIP_WIDTH, STRIP_HEIGHT, STRIP_LENGTH}});
 }
 
-void initGrayBuilding()
+void initTrain()
 {
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{CELL_SIZE / 2.0f - GRAY_BUILDING_WIDTH / 2.0f, CELL_SIZE / 2.0f - GRAY_BUILDING_WIDTH / 2.0f, 0.0f}, GRAY_BUILDING_WIDTH, BUILDING_HEIGHT, GRAY_BUILDING_WIDTH);
-    gray_building.initShape(in_coord);
-    gray_building.changeNature(GL_TRIANGLES);
+    initBoxShape(train, {
+                     {Vector3D{0.0f, 0.0f, 0.0f}, TRAIN_X_END - TRAIN_X_START, 4.0f, CELL_SIZE},
+                     {Vector3D{((TRAIN_X_END - TRAIN_X_START) - (TRAIN_X_END - TRAIN_X_START - 2.0f)) / 2.0f, 0.0f, 4.0f}, TRAIN_X_END - TRAIN_X_START - 2.0f, 2.0f, 2.0f * CELL_SIZE / 3.0f}
+                 });
 }
 
-void randomCloud1Pos(const nlohmann::json &data)
+void initTrainWheel()
 {
-    const auto sizeGrid = data["size_grid"].get<int>();
-    cloud_1_pos = Vector3D{0.0f, randomFloat(0.0f, CELL_SIZE * sizeGrid - 15.0f), 0.0f};
+    train_wheel = cachedCylinder(SR, TRAIN_WHEEL_RADIUS);
 }
 
-void randomCloud1Speed()
+void initTrainWheelSide()
 {
-    cloud_1_speed = randomFloat(0.1f, 0.4f);
+    train_wheel_side = cachedCone(0.0f, TRAIN_WHEEL_RADIUS);
 }
 
-void initCloud1(const nlohmann::json &data)
+void initTrainChimney()
 {
-    const auto sizeGrid = data["size_grid"].get<int>();
-
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{-15.0f, 0.0f, 36.5f}, 15.0f, 1.5f, 15.0f);
-    cloud_1.initShape(in_coord);
-    cloud_1.changeNature(GL_TRIANGLES);
-
-    cloud_1_max_y_pos = CELL_SIZE * sizeGrid + 15.0f;
-    randomCloud1Pos(data);
-    randomCloud1Speed();
+    train_chimney = cachedCylinder(TRAIN_CHIMNEY_HEIGHT, TRAIN_CHIMNEY_RADIUS);
 }
 
-void randomCloud2Pos(const nlohmann::json &data)
+void initTrainChimneyHat()
 {
-    const auto sizeGrid = data["size_grid"].get<int>();
-    cloud_2_pos = Vector3D{0.0f, randomFloat(0.0f, CELL_SIZE * sizeGrid - 25.0f - CELL_SIZE), 0.0f};
+    train_chimney_hat = cachedCone(1.0f, TRAIN_CHIMNEY_RADIUS * 2.0f);
 }
 
-void randomCloud2Speed()
+void initTrunk()
 {
-    cloud_2_speed = randomFloat(0.1f, 0.2f);
+    initBoxShape(trunk, {{Vector3D{CELL_SIZE / 2.0f - TRUNK_WIDTH / 2.0f, CELL_SIZE / 2.0f - TRUNK_WIDTH / 2.0f, 0.0f}, TRUNK_WIDTH, TRUNK_HEIGHT, TRUNK_WIDTH}});
 }
 
-void initCloud2(const nlohmann::json &data)
+void initLeaf()
 {
-    const auto sizeGrid = data["size_grid"].get<int>();
+    initBoxShape(leaf, {{Vector3D{CELL_SIZE / 2.0f - LEAF_WIDTH / 2.0f, CELL_SIZE / 2.0f - LEAF_WIDTH / 2.0f, TRUNK_HEIGHT}, LEAF_WIDTH, LEAF_HEIGHT, LEAF_WIDTH}});
+}
 
-    std::vector<float> in_coord{};
-    add_rectangle_triangles(in_coord, Vector3D{-25.0f, 0.0f, 35.0f}, 25.0f, 1.5f, 25.0f);
-    add_rectangle_triangles(in_coord, Vector3D{-CELL_SIZE, 25.0f, 35.0f}, 20.0f, 1.5f, CELL_SIZE);
-    cloud_2.initShape(in_coord);
-    cloud_2.changeNature(GL_TRIANGLES);
+void initBlackBuilding()
+{
+    initBoxShape(black_building, {{Vector3D{CELL_SIZE / 2.0f - BLACK_BUILDING_WIDTH / 2.0f, CELL_SIZE / 2.0f - BLACK_BUILDING_WIDTH / 2.0f, 0.0f}, BLACK_BUILDING_WIDTH, BUILDING_HEIGHT, BLACK_BUILDING_WIDTH}});
+}
 
-    cloud_2_max_y_pos = CELL_SIZE * sizeGrid + -25.0f;
-    randomCloud2Pos(data);
-    randomCloud2Speed();
+void initGrayBuilding()
+{
+    initBoxShape(gray_building, {{Vector3D{CELL_SIZE / 2.0f - GRAY_BUILDING_WIDTH / 2.0f, CELL_SIZE / 2.0f - GRAY_BUILDING_WIDTH / 2.0f, 0.0f}, GRAY_BUILDING_WIDTH, BUILDING_HEIGHT, GRAY_BUILDING_WIDTH}});
 }
 
 void initScene(const nlohmann::json &data)
@@ -510,11 +600,16 @@ void initScene(const nlohmann::json &data)
     /* Camera */
     initCamera(data);
 
-    init_set_positions(data);
+    init_set_positions();
+    track_graph.build(layout);
+    buildRegions();
 
     /* Ground */
     initGround(data);
 
+    /* Meshes that only depend on constants are read from the cache file when it has them */
+    geometry_cache.open(GEOMETRY_CACHE_FILE);
+
     /* Rails */
     initStraightRail();
     initInternalCurvedRail();
@@ -545,158 +640,222 @@ void initScene(const nlohmann::json &data)
     initBlackBuilding();
     initGrayBuilding();
 
-    /* Clouds */
-    initCloud1(data);
-    initCloud2(data);
+    geometry_cache.close();
+}
+
+void initBenchmarkLights(const nlohmann::json &data, int nbLights)
+{
+    const float sizeGrid = data["size_grid"].get<int>() * CELL_SIZE;
+    /* Each point of the ground is reached by about 8 lights, whatever their number */
+    const float radius = std::sqrt(8.0f * sizeGrid * sizeGrid / (M_PI * nbLights));
+
+    myEngine.switchToPhongShading();
+    /* Shapes and meshes have no normal array : light them as seen from above */
+    myEngine.setNormalForConvex2DShape(Vector3D{0.0f, 0.0f, 1.0f});
+    myEngine.setLightPosition(Vector4D{0.3f, 0.2f, 1.0f, 0.0f});
+    myEngine.setLightIntensity(Vector3D{0.2f, 0.2f, 0.2f});
+    myEngine.setAttenuationFactor(Vector3D{1.0f, 0.0f, 0.0f});
+    myEngine.clearPointLights();
+    for (int i = 0; i < nbLights; ++i)
+        myEngine.addPointLight(Vector3D{randomFloat(0.0f, sizeGrid), randomFloat(0.0f, sizeGrid), 3.0f},
+                               Vector3D{randomFloat(0.2f, 1.0f), randomFloat(0.2f, 1.0f), randomFloat(0.2f, 1.0f)}, radius);
+}
+
+void reloadScene(const Layout &reloaded, const nlohmann::json &data)
+{
+    LayoutDiff diff = layout.applyChanges(reloaded);
+    if (diff.rebuilt)
+    {
+        /* The grid size changed : ground, scenery and clouds depend on it */
+        track_graph.build(layout);
+        delete ground;
+        initGround(data);
+        init_set_positions();
+        particles.spawn(CELL_SIZE * layout.sizeGrid());
+        buildRegions();
+        std::cout << "Layout reloaded: rebuilt (" << diff.added << " tracks)" << std::endl;
+    }
+    else
+    {
+        track_graph.update(layout, diff.cells);
+        updateRegions(diff.cells);
+        uploadTerrainCells(diff.terrain_changed);
+        std::cout << "Layout reloaded: " << diff.added << " added, " << diff.removed << " removed, "
+                  << diff.relinked << " relinked" << (diff.origin_changed ? ", station moved" : "")
+                  << (diff.network_changed ? ", branches or stations changed" : "") << std::endl;
+    }
 }
 
-bool initGrassTexture()
+bool initMaterials()
 {
     int x, y, comp;
-    img = stbi_load("../assets/textures/grass.jpg", &x, &y, &comp, 0);
+    stbi_uc *img = stbi_load("../assets/textures/grass.jpg", &x, &y, &comp, 0);
     if (img == NULL)
     {
         std::cerr << "ERROR: Can't load ../assets/textures/grass.jpg" << std::endl;
         return false;
     }
-    grass_texture.createTexture();
-    grass_texture.attachTexture();
-    grass_texture.setParameters(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    grass_texture.loadImage(x, y, comp, img);
-    grass_texture.detachTexture();
+    /* The table keeps its own resampled copy of the image */
+    int grass_layer = myEngine.materials.addLayer(x, y, comp, img);
+    stbi_image_free(img);
+    if (grass_layer < 0)
+        return false;
+
+    /* Light speckles, the same in every run */
+    std::vector<unsigned char> noise(NOISE_LAYER_SIZE * NOISE_LAYER_SIZE * 3);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < noise.size(); i += 3)
+    {
+        state = state * 1664525u + 1013904223u;
+        noise[i] = noise[i + 1] = noise[i + 2] = 170 + (state >> 24) % 86;
+    }
+    int noise_layer = myEngine.materials.addLayer(NOISE_LAYER_SIZE, NOISE_LAYER_SIZE, 3, noise.data());
+    if (noise_layer < 0)
+        return false;
+
+    for (int m = 0; m < MAT_COUNT; m++)
+        material_ids[m] = myEngine.materials.material(MATERIAL_COLORS[m], m == MAT_GROUND ? GLBI_MATERIAL_SPLAT : -1);
+    const int terrain_layers[TERRAIN_COUNT] = {grass_layer, noise_layer, -1, noise_layer};
+    for (int t = 0; t < TERRAIN_COUNT; t++)
+    {
+        terrain_material_ids[t] = myEngine.materials.material(TERRAIN_COLORS[t], terrain_layers[t]);
+        /* The splat map holds one byte per cell */
+        if (terrain_material_ids[t] > 255)
+        {
+            std::cerr << "ERROR: Too many materials for the terrain splat map" << std::endl;
+            return false;
+        }
+    }
+    terrain_materials_ready = true;
+    uploadTerrain();
     return true;
 }
 
-void freeGrassTexture()
+/* ---SCENE GRAPH--- */
+
+/* Items are drawn with the shader selected when the graph is built */
+GLBI_Material sceneMaterial(SceneMaterial material)
+{
+    return GLBI_Material{material_ids[material], myEngine.currentShader};
+}
+
+/* Draw at the current node of the builder */
+void placeShape(const GLBI_Convex_2D_Shape &shape, SceneMaterial material)
 {
-    stbi_image_free(img);
+    builder->addShape(shape, sceneMaterial(material));
+}
+
+void placeMesh(const StandardMesh &mesh, SceneMaterial material)
+{
+    builder->addMesh(mesh, sceneMaterial(material));
+}
+
+void placeMesh(const IndexedMesh &mesh, SceneMaterial material)
+{
+    builder->addMesh(mesh, sceneMaterial(material));
+}
+
+GraphRange beginRange()
+{
+    return GraphRange{scene_graph.nbNodes(), 0, scene_graph.nbDraws(), 0};
+}
+
+void endRange(GraphRange &range)
+{
+    range.last_node = scene_graph.nbNodes();
+    range.last_draw = scene_graph.nbDraws();
+}
+
+void recordRange(const GraphRange &range)
+{
+    scene_graph.record(render_queue, range.first_draw, range.last_draw);
 }
 
 /* ---GROUND--- */
 
 void drawGround()
 {
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{-1.0f, 0.0f, 0.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addRotation(M_PI / 2.0f, Vector3D{-1.0f, 0.0f, 0.0f});
 
-    myEngine.activateTexturing(true);
-    grass_texture.attachTexture();
-    ground->draw();
-    grass_texture.detachTexture();
-    myEngine.activateTexturing(false);
+    placeMesh(*ground, MAT_GROUND);
 
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 }
 
 /* ---TRACKS--- */
 
 void drawBallast()
 {
-    ballast_side->draw();
-    ballast->draw();
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.updateMvMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, BALLAST_X_END - BALLAST_X_START, 0.0f});
-    myEngine.updateMvMatrix();
-    ballast_side->draw();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    placeMesh(*ballast_side, MAT_BALLAST);
+    placeMesh(*ballast, MAT_BALLAST);
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{0.0f, BALLAST_X_END - BALLAST_X_START, 0.0f});
+    placeMesh(*ballast_side, MAT_BALLAST);
+    builder->popMatrix();
 }
 
 void drawStraightTrack()
 {
     /* Rails */
-    myEngine.setFlatColor(0.2f, 0.2f, 0.2f);
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{POS_X_RAIL1 - (SR / 2.0f), 0.0f, RR * 2.0f});
-    myEngine.updateMvMatrix();
-    straightRail.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{POS_X_RAIL2 - (SR / 2.0f), 0.0f, RR * 2.0f});
-    myEngine.updateMvMatrix();
-    straightRail.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{POS_X_RAIL1 - (SR / 2.0f), 0.0f, RR * 2.0f});
+    placeShape(straightRail, MAT_RAIL);
+    builder->popMatrix();
 
-    /* Balasts */
-    myEngine.setFlatColor(0.4f, 0.2f, 0.0f);
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{POS_X_RAIL2 - (SR / 2.0f), 0.0f, RR * 2.0f});
+    placeShape(straightRail, MAT_RAIL);
+    builder->popMatrix();
 
+    /* Balasts */
     const float SX = (CELL_SIZE - (RR * 2.0f) * STRAIGHT_TRACK_BALLAST_COUNT) / 10.0f;
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, BALLAST_X_START, RR});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
+    builder->addTranslation(Vector3D{0.0f, BALLAST_X_START, RR});
     for (auto i = 0; i < STRAIGHT_TRACK_BALLAST_COUNT; i++)
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{-(SX + RR) * (i == 0 ? 1.0f : 2.0f), 0.0f, 0.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{-(SX + RR) * (i == 0 ? 1.0f : 2.0f), 0.0f, 0.0f});
         drawBallast();
     }
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 }
 
 void drawCurvedTrack()
 {
     /* Rails */
-    myEngine.setFlatColor(0.2f, 0.2f, 0.2f);
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, 0.0f, RR * 2.0f});
-    myEngine.updateMvMatrix();
-    iternalCurvedRail.drawShape();
-    externalCurvedRail.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{0.0f, 0.0f, RR * 2.0f});
+    placeShape(iternalCurvedRail, MAT_RAIL);
+    placeShape(externalCurvedRail, MAT_RAIL);
+    builder->popMatrix();
 
     /* Balasts */
-    myEngine.setFlatColor(0.4f, 0.2f, 0.0f);
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{BALLAST_X_START * std::cos(5.0f * M_PI / 12.0f), BALLAST_X_START * std::sin(5.0f * M_PI / 12.0f), RR});
-    myEngine.mvMatrixStack.addRotation(M_PI / 12.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{BALLAST_X_START * std::cos(5.0f * M_PI / 12.0f), BALLAST_X_START * std::sin(5.0f * M_PI / 12.0f), RR});
+    builder->addRotation(M_PI / 12.0f, Vector3D{0.0f, 0.0f, -1.0f});
     drawBallast();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{BALLAST_X_START * std::cos(3.0f * M_PI / 12.0f), BALLAST_X_START * std::sin(3.0f * M_PI / 12.0f), RR});
-    myEngine.mvMatrixStack.addRotation(3.0f * M_PI / 12.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{BALLAST_X_START * std::cos(3.0f * M_PI / 12.0f), BALLAST_X_START * std::sin(3.0f * M_PI / 12.0f), RR});
+    builder->addRotation(3.0f * M_PI / 12.0f, Vector3D{0.0f, 0.0f, -1.0f});
     drawBallast();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{BALLAST_X_START * std::cos(M_PI / 12.0f), BALLAST_X_START * std::sin(M_PI / 12.0f), RR});
-    myEngine.mvMatrixStack.addRotation(5.0f * M_PI / 12.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{BALLAST_X_START * std::cos(M_PI / 12.0f), BALLAST_X_START * std::sin(M_PI / 12.0f), RR});
+    builder->addRotation(5.0f * M_PI / 12.0f, Vector3D{0.0f, 0.0f, -1.0f});
     drawBallast();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
-}
-
-bool isCorner(const Vector2D &prev, const Vector2D &current, const Vector2D &next)
-{
-    auto A = current - prev;
-    auto B = next - current;
-    return (A.x * B.y - A.y * B.x) != 0;
+    builder->popMatrix();
 }
 
 void rotateStraightTrack(const Vector2D &current, const Vector2D &other)
 {
     if (other.x != current.x)
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
-        myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
+        builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     }
 }
 
@@ -708,9 +867,8 @@ void rotateCurvedTrack(const Vector2D &prev, const Vector2D &current, const Vect
     */
     if ((prev.x == current.x - 1 || next.x == current.x - 1) && (prev.y == current.y + 1 || next.y == current.y + 1))
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
-        myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
+        builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     }
     /*
     +-
@@ -718,9 +876,8 @@ void rotateCurvedTrack(const Vector2D &prev, const Vector2D &current, const Vect
     */
     else if ((prev.y == current.y - 1 || next.y == current.y - 1) && (prev.x == current.x + 1 || next.x == current.x + 1))
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE, 0.0f, 0.0f});
-        myEngine.mvMatrixStack.addRotation(3.0f * M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{CELL_SIZE, 0.0f, 0.0f});
+        builder->addRotation(3.0f * M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     }
     /*
     |
@@ -728,49 +885,68 @@ void rotateCurvedTrack(const Vector2D &prev, const Vector2D &current, const Vect
     */
     else if ((prev.y == current.y + 1 || next.y == current.y + 1) && (prev.x == current.x + 1 || next.x == current.x + 1))
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE, CELL_SIZE, 0.0f});
-        myEngine.mvMatrixStack.addRotation(M_PI, Vector3D{0.0f, 0.0f, 1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{CELL_SIZE, CELL_SIZE, 0.0f});
+        builder->addRotation(M_PI, Vector3D{0.0f, 0.0f, 1.0f});
     }
 }
 
-void drawTracks(const nlohmann::json &data)
+void drawStraightPiece(const Vector2D &current, const Vector2D &other)
+{
+    builder->pushMatrix();
+    rotateStraightTrack(current, other);
+    drawStraightTrack();
+    builder->popMatrix();
+}
+
+void drawCurvedPiece(const Vector2D &prev, const Vector2D &current, const Vector2D &next)
 {
-    auto path = data["path"].get<std::vector<std::vector<int>>>();
-    for (auto i = 0; i < path.size(); i++)
+    builder->pushMatrix();
+    rotateCurvedTrack(prev, current, next);
+    drawCurvedTrack();
+    builder->popMatrix();
+}
+
+/* Straight through the two opposite connections, curve from the third one */
+void drawSwitch(const Vector2D &current, const int *neighbours)
+{
+    for (int side = 0; side < 3; side++)
     {
-        auto current = Vector2D{path[i]};
-        myEngine.mvMatrixStack.pushMatrix();
-        myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE * current.x, CELL_SIZE * current.y, 0.0f});
-        myEngine.updateMvMatrix();
-
-        if (path.size() == 1)
-            drawStraightTrack();
-        else if (path.size() == 2)
-        {
-            auto other = Vector2D{path[i == 0 ? 1 : 0]};
-            rotateStraightTrack(current, other);
-            drawStraightTrack();
-        }
-        else
-        {
-            auto prev = Vector2D{path[i == 0 ? path.size() - 1 : i - 1]};
-            auto next = Vector2D{path[i == path.size() - 1 ? 0 : i + 1]};
-            if (current.isNeighbor(prev) && current.isNeighbor(next) && isCorner(prev, current, next))
-            {
-                rotateCurvedTrack(prev, current, next);
-                drawCurvedTrack();
-            }
-            else
-            {
-                rotateStraightTrack(current, current.isNeighbor(prev) ? prev : next);
-                drawStraightTrack();
-            }
-        }
+        const Vector2D &a = track_graph.cell(neighbours[(side + 1) % 3]);
+        const Vector2D &b = track_graph.cell(neighbours[(side + 2) % 3]);
+        if (isCorner(a, current, b))
+            continue;
+        drawStraightPiece(current, a);
+        drawCurvedPiece(track_graph.cell(neighbours[side]), current, a);
+        return;
+    }
+}
 
-        myEngine.mvMatrixStack.popMatrix();
-        myEngine.updateMvMatrix();
+/* The piece of each cell depends on its connections in the track network */
+void drawTrackNode(int node)
+{
+    const Vector2D &current = track_graph.cell(node);
+    const int *neighbours = track_graph.neighbours(node);
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{CELL_SIZE * current.x, CELL_SIZE * current.y, 0.0f});
+
+    switch (track_graph.pieceKind(node))
+    {
+    case PieceKind::Curve:
+        drawCurvedPiece(track_graph.cell(neighbours[0]), current, track_graph.cell(neighbours[1]));
+        break;
+    case PieceKind::Switch:
+        drawSwitch(current, neighbours);
+        break;
+    case PieceKind::Crossing:
+        drawStraightPiece(current, current + Vector2D{1, 0});
+        drawStraightPiece(current, current + Vector2D{0, 1});
+        break;
+    case PieceKind::Straight:
+        drawStraightPiece(current, track_graph.degree(node) > 0 ? track_graph.cell(neighbours[0]) : current);
+        break;
     }
+
+    builder->popMatrix();
 }
 
 /* ---STATION--- */
@@ -779,107 +955,84 @@ void rotateStation(const Vector2D &origin, const Vector2D &track)
 {
     if (track.x == origin.x + 1)
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
-        myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
+        builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     }
     else if (track.x == origin.x - 1)
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE, 0.0f, 0.0f});
-        myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, 1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{CELL_SIZE, 0.0f, 0.0f});
+        builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, 1.0f});
     }
     else if (track.y == origin.y - 1)
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE, CELL_SIZE, 0.0f});
-        myEngine.mvMatrixStack.addRotation(M_PI, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{CELL_SIZE, CELL_SIZE, 0.0f});
+        builder->addRotation(M_PI, Vector3D{0.0f, 0.0f, -1.0f});
     }
 }
 
-void drawStation(const nlohmann::json &data)
+void drawStation(const Vector2D &origin)
 {
-    auto origin = Vector2D{data["origin"].get<std::vector<int>>()};
-    auto path = data["path"].get<std::vector<std::vector<int>>>();
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE * origin.x, CELL_SIZE * origin.y, 0.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{CELL_SIZE * origin.x, CELL_SIZE * origin.y, 0.0f});
 
     /* Turn the station towards the track */
-    auto it = std::find_if(path.begin(), path.end(), [&origin](const std::vector<int> &pos)
-                           { return origin.isNeighbor(pos); });
-    if (it != path.end())
-        rotateStation(origin, *it);
-
-    myEngine.setFlatColor(0.2f, 0.2f, 0.2f);
-    station_ground_1.drawShape();
-
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, 0.0f, STATION_GROUND_HEIGHT_1});
-    myEngine.updateMvMatrix();
-    myEngine.setFlatColor(0.25f, 0.25f, 0.25f);
-    station_ground_2.drawShape();
-
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, 0.0f, STATION_GROUND_HEIGHT_2});
-    myEngine.updateMvMatrix();
-
-    myEngine.setFlatColor(0.4f, 0.2f, 0.0f);
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.25f, 0.0f, 0.0f});
-    myEngine.updateMvMatrix();
-    bench.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE / 2.0f + 0.25f, 0.0f, 0.0f});
-    myEngine.updateMvMatrix();
-    bench.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.25f, CELL_SIZE - STRIP_LENGTH - 0.25f, 0.0f});
-    myEngine.updateMvMatrix();
-    myEngine.setFlatColor(0.6f, 0.5f, 0.0f);
-    strip.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
-
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    for (const auto &side : {Vector2D{1, 0}, Vector2D{-1, 0}, Vector2D{0, 1}, Vector2D{0, -1}})
+    {
+        if (layout.isTrack(origin + side))
+        {
+            rotateStation(origin, origin + side);
+            break;
+        }
+    }
+
+    placeShape(station_ground_1, MAT_STATION_GROUND);
+
+    builder->addTranslation(Vector3D{0.0f, 0.0f, STATION_GROUND_HEIGHT_1});
+    placeShape(station_ground_2, MAT_PLATFORM);
+
+    builder->addTranslation(Vector3D{0.0f, 0.0f, STATION_GROUND_HEIGHT_2});
+
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{0.25f, 0.0f, 0.0f});
+    placeShape(bench, MAT_BENCH);
+    builder->popMatrix();
+
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{CELL_SIZE / 2.0f + 0.25f, 0.0f, 0.0f});
+    placeShape(bench, MAT_BENCH);
+    builder->popMatrix();
+
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{0.25f, CELL_SIZE - STRIP_LENGTH - 0.25f, 0.0f});
+    placeShape(strip, MAT_STRIP);
+    builder->popMatrix();
+
+    builder->popMatrix();
 }
 
 /* ---TRAIN--- */
 
 void drawTrainWheel()
 {
-    myEngine.setFlatColor(0.6f, 0.0f, 0.0f);
+    placeMesh(*train_wheel_side, MAT_WHEEL);
+    placeMesh(*train_wheel, MAT_WHEEL);
 
-    train_wheel_side->draw();
-    train_wheel->draw();
-
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, SR, 0.0f});
-    myEngine.updateMvMatrix();
-    train_wheel_side->draw();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{0.0f, SR, 0.0f});
+    placeMesh(*train_wheel_side, MAT_WHEEL);
+    builder->popMatrix();
 }
 
 void rotateTrainOnStraightTrack(const Vector2D &current, const Vector2D &next)
 {
     if (next.x == current.x + 1)
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
-        myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{0.0f, CELL_SIZE, 0.0f});
+        builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     }
     else if (next.x == current.x - 1)
     {
-        myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, 1.0f});
-        myEngine.updateMvMatrix();
+        builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, 1.0f});
     }
 }
 
@@ -892,9 +1045,8 @@ void rotateTrainOnCurvedTrack(const Vector2D &prev, const Vector2D &current, con
     if ((prev.x == current.x - 1 || next.x == current.x - 1) && (prev.y == current.y + 1 || next.y == current.y + 1))
     {
         float angle = M_PI / 4.0f;
-        myEngine.mvMatrixStack.addTranslation(Vector3D{-CELL_SIZE / 2.0f, CELL_SIZE / 2.0f, 0.0f});
-        myEngine.mvMatrixStack.addRotation(angle, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{-CELL_SIZE / 2.0f, CELL_SIZE / 2.0f, 0.0f});
+        builder->addRotation(angle, Vector3D{0.0f, 0.0f, -1.0f});
     }
     /*
     +-
@@ -903,8 +1055,7 @@ void rotateTrainOnCurvedTrack(const Vector2D &prev, const Vector2D &current, con
     else if ((prev.y == current.y - 1 || next.y == current.y - 1) && (prev.x == current.x + 1 || next.x == current.x + 1))
     {
         float angle = M_PI / 4.0f;
-        myEngine.mvMatrixStack.addRotation(angle, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addRotation(angle, Vector3D{0.0f, 0.0f, -1.0f});
     }
     /*
     |
@@ -912,9 +1063,8 @@ void rotateTrainOnCurvedTrack(const Vector2D &prev, const Vector2D &current, con
     */
     else if ((prev.y == current.y + 1 || next.y == current.y + 1) && (prev.x == current.x + 1 || next.x == current.x + 1))
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE / 2.0f, CELL_SIZE + CELL_SIZE / 2.0f, 0.0f});
-        myEngine.mvMatrixStack.addRotation(3.0f * M_PI / 4.0f, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{CELL_SIZE / 2.0f, CELL_SIZE + CELL_SIZE / 2.0f, 0.0f});
+        builder->addRotation(3.0f * M_PI / 4.0f, Vector3D{0.0f, 0.0f, -1.0f});
     }
     /*
     -+
@@ -922,224 +1072,655 @@ void rotateTrainOnCurvedTrack(const Vector2D &prev, const Vector2D &current, con
     */
     else
     {
-        myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE / 2.0f, CELL_SIZE, 0.0f});
-        myEngine.mvMatrixStack.addRotation(3.0f * M_PI / 4.0f, Vector3D{0.0f, 0.0f, -1.0f});
-        myEngine.updateMvMatrix();
+        builder->addTranslation(Vector3D{CELL_SIZE / 2.0f, CELL_SIZE, 0.0f});
+        builder->addRotation(3.0f * M_PI / 4.0f, Vector3D{0.0f, 0.0f, -1.0f});
     }
 }
 
-void rotateTrain(const std::vector<std::vector<int>> &path, const Vector2D &current)
+void rotateTrain(const Vector2D &current)
 {
-    if (path.size() == 2)
-        rotateTrainOnStraightTrack(current, Vector2D{path[1]});
-    else if (path.size() > 2)
-    {
-        auto prev = Vector2D{path[path.size() - 1]};
-        auto next = Vector2D{path[1]};
-        if (current.isNeighbor(prev) && current.isNeighbor(next) && isCorner(prev, current, next))
-            rotateTrainOnCurvedTrack(prev, current, next);
-        else
-            rotateTrainOnStraightTrack(current, next);
-    }
+    const TrackCell *cell = layout.track(current);
+    if (cell->kind == PieceKind::Curve)
+        rotateTrainOnCurvedTrack(cell->prev, current, cell->next);
+    else if (!(cell->next == current))
+        rotateTrainOnStraightTrack(current, cell->next);
 }
 
-void drawTrain(const nlohmann::json &data)
+void drawTrain()
 {
-    auto path = data["path"].get<std::vector<std::vector<int>>>();
-    if (path.size() == 0)
+    if (layout.empty())
         return;
-    auto position = Vector2D{path[0]};
+    auto position = layout.first();
 
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE * position.x, CELL_SIZE * position.y, RR * 2.0f + SR});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{CELL_SIZE * position.x, CELL_SIZE * position.y, RR * 2.0f + SR});
 
-    rotateTrain(path, position);
+    rotateTrain(position);
 
     /* Bottom left wheel */
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{POS_X_RAIL1 - SR / 2.0f, TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{POS_X_RAIL1 - SR / 2.0f, TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
+    builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     drawTrainWheel();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 
     /* Bottom right wheel */
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{POS_X_RAIL2 - SR / 2.0f, TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{POS_X_RAIL2 - SR / 2.0f, TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
+    builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     drawTrainWheel();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 
     /* Top left wheel */
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{POS_X_RAIL1 - SR / 2.0f, CELL_SIZE - TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{POS_X_RAIL1 - SR / 2.0f, CELL_SIZE - TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
+    builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     drawTrainWheel();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 
     /* Top right wheel */
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{POS_X_RAIL2 - SR / 2.0f, CELL_SIZE - TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{POS_X_RAIL2 - SR / 2.0f, CELL_SIZE - TRAIN_WHEEL_RADIUS, TRAIN_WHEEL_RADIUS});
+    builder->addRotation(M_PI / 2.0f, Vector3D{0.0f, 0.0f, -1.0f});
     drawTrainWheel();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 
     /* Train */
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{TRAIN_X_START, 0.0f, TRAIN_WHEEL_RADIUS * 2.0f});
-    myEngine.updateMvMatrix();
-    myEngine.setFlatColor(0.1f, 0.1f, 0.1f);
-    train.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{TRAIN_X_START, 0.0f, TRAIN_WHEEL_RADIUS * 2.0f});
+    placeShape(train, MAT_TRAIN);
+    builder->popMatrix();
 
     /* Train chimney */
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE / 2.0f, TRAIN_CHIMNEY_RADIUS + 4.0f, 4.0f + TRAIN_X_END - TRAIN_X_START - 2.0f});
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{1.0f, 0.0f, 0.0f});
-    myEngine.updateMvMatrix();
-    myEngine.setFlatColor(0.2f, 0.2f, 0.2f);
-    train_chimney->draw();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{CELL_SIZE / 2.0f, TRAIN_CHIMNEY_RADIUS + 4.0f, 4.0f + TRAIN_X_END - TRAIN_X_START - 2.0f});
+    builder->addRotation(M_PI / 2.0f, Vector3D{1.0f, 0.0f, 0.0f});
+    placeMesh(*train_chimney, MAT_CHIMNEY);
+    builder->popMatrix();
 
     /* Train chimney hat */
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{CELL_SIZE / 2.0f, TRAIN_CHIMNEY_RADIUS + 4.0f, 4.0f + TRAIN_X_END - TRAIN_X_START - 2.0f + TRAIN_CHIMNEY_HEIGHT});
-    myEngine.mvMatrixStack.addRotation(M_PI / 2.0f, Vector3D{1.0f, 0.0f, 0.0f});
-    myEngine.updateMvMatrix();
-    myEngine.setFlatColor(0.1f, 0.1f, 0.1f);
-    train_chimney_hat->draw();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
-
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{CELL_SIZE / 2.0f, TRAIN_CHIMNEY_RADIUS + 4.0f, 4.0f + TRAIN_X_END - TRAIN_X_START - 2.0f + TRAIN_CHIMNEY_HEIGHT});
+    builder->addRotation(M_PI / 2.0f, Vector3D{1.0f, 0.0f, 0.0f});
+    chimney_node = builder->currentNode();
+    placeMesh(*train_chimney_hat, MAT_CHIMNEY_HAT);
+    builder->popMatrix();
+
+    builder->popMatrix();
 }
 
 void draw_tree()
 {
-    myEngine.setFlatColor(0.3f, 0.15f, 0.15f);
-    trunk.drawShape();
-    myEngine.setFlatColor(0.0f, 0.4f, 0.0f);
-    leaf.drawShape();
+    placeShape(trunk, MAT_TRUNK);
+    placeShape(leaf, MAT_LEAF);
 }
 
 void draw_building()
 {
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.updateMvMatrix();
+    builder->pushMatrix();
     for (auto i = 0; i < BUILDING_SIZE; i++)
     {
-        myEngine.setFlatColor(0.1f, 0.1f, 0.1f);
-        black_building.drawShape();
-        myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, 0.0f, BUILDING_HEIGHT});
-        myEngine.updateMvMatrix();
-        myEngine.setFlatColor(0.4f, 0.4f, 0.4f);
-        gray_building.drawShape();
-        myEngine.mvMatrixStack.addTranslation(Vector3D{0.0f, 0.0f, BUILDING_HEIGHT});
-        myEngine.updateMvMatrix();
+        placeShape(black_building, MAT_BLACK_BUILDING);
+        builder->addTranslation(Vector3D{0.0f, 0.0f, BUILDING_HEIGHT});
+        placeShape(gray_building, MAT_GRAY_BUILDING);
+        builder->addTranslation(Vector3D{0.0f, 0.0f, BUILDING_HEIGHT});
     }
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    builder->popMatrix();
 }
 
-void draw_trees()
+void draw_set(const Vector2D &cell, SceneryKind kind)
 {
-    for (auto pos : tree_pos)
-    {
-        myEngine.mvMatrixStack.pushMatrix();
-        myEngine.mvMatrixStack.addTranslation(Vector3D{pos.first * CELL_SIZE, pos.second * CELL_SIZE, 0.0f});
-        myEngine.updateMvMatrix();
+    builder->pushMatrix();
+    builder->addTranslation(Vector3D{cell.x * CELL_SIZE, cell.y * CELL_SIZE, 0.0f});
+    if (kind == SceneryKind::Tree)
         draw_tree();
-        myEngine.mvMatrixStack.popMatrix();
-        myEngine.updateMvMatrix();
-    }
+    else
+        draw_building();
+    builder->popMatrix();
 }
 
-void draw_buildings()
+/* ---REGIONS--- */
+
+/* False if the box of the region is entirely outside one plane of the view frustum */
+bool regionVisible(const Region &region, const Matrix4D &view_proj)
 {
-    for (auto pos : building_pos)
+    /* One cell of margin : stations and curves overhang the cell they belong to */
+    const float x0 = (region.first.x - 1) * CELL_SIZE, x1 = (region.first.x + REGION_CELLS + 1) * CELL_SIZE;
+    const float y0 = (region.first.y - 1) * CELL_SIZE, y1 = (region.first.y + REGION_CELLS + 1) * CELL_SIZE;
+    int outside[6] = {0, 0, 0, 0, 0, 0};
+    for (int corner = 0; corner < 8; corner++)
     {
-        myEngine.mvMatrixStack.pushMatrix();
-        myEngine.mvMatrixStack.addTranslation(Vector3D{pos.first * CELL_SIZE, pos.second * CELL_SIZE, 0.0f});
-        myEngine.updateMvMatrix();
-        draw_building();
-        myEngine.mvMatrixStack.popMatrix();
-        myEngine.updateMvMatrix();
+        Vector4D p = view_proj * Vector4D{corner & 1 ? x1 : x0, corner & 2 ? y1 : y0, corner & 4 ? REGION_HEIGHT : 0.0f, 1.0f};
+        outside[0] += p.x < -p.w;
+        outside[1] += p.x > p.w;
+        outside[2] += p.y < -p.w;
+        outside[3] += p.y > p.w;
+        outside[4] += p.z < -p.w;
+        outside[5] += p.z > p.w;
     }
+    for (int plane = 0; plane < 6; plane++)
+        if (outside[plane] == 8)
+            return false;
+    return true;
+}
+
+/* Tracks, stations and scenery of the region, under their own roots */
+void buildRegion(Region &region)
+{
+    GLBI_Scene_Builder region_builder(scene_graph);
+    builder = &region_builder;
+    region.range = beginRange();
+    for (const auto &cell : region.tracks)
+        drawTrackNode(track_graph.node(cell));
+    for (const auto &station : region.stations)
+        drawStation(station);
+    for (const auto &s : region.scenery)
+        draw_set(s.first, s.second);
+    endRange(region.range);
+    region.recorded = false;
+    region.dirty = false;
 }
 
-void draw_sets()
+void buildTrain()
 {
-    draw_trees();
-    draw_buildings();
+    GLBI_Scene_Builder train_builder(scene_graph);
+    builder = &train_builder;
+    chimney_node = -1;
+    train_range = beginRange();
+    drawTrain();
+    endRange(train_range);
+    train_dirty = false;
 }
 
-void drawCloud1(const nlohmann::json &data)
+/* Build the whole hierarchy. Nodes of a region, and of its subtrees, are contiguous */
+void buildSceneGraph()
 {
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{cloud_1_pos.x + cloud_1_anim, cloud_1_pos.y, cloud_1_pos.z});
-    myEngine.updateMvMatrix();
-    myEngine.setFlatColor(0.9f, 0.9f, 0.9f);
-    cloud_1.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    scene_graph.clear();
+    GLBI_Scene_Builder root_builder(scene_graph);
+
+    builder = &root_builder;
+    ground_range = beginRange();
+    drawGround();
+    endRange(ground_range);
+
+    for (auto &region : regions)
+        buildRegion(region);
+    buildTrain();
+
+    builder = NULL;
+    built_shader = myEngine.currentShader;
+    scene_graph_dirty = false;
+    dirty_regions.clear();
+    orphan_nodes = 0;
+}
 
-    if (!animate)
+/* Build the regions sorted again, and the train if it moved, at the end of the graph. Their
+   old nodes stay unused, so the whole graph is built again once they outnumber the others */
+void buildDirtyRegions()
+{
+    for (int r : dirty_regions)
+        orphan_nodes += regions[r].range.last_node - regions[r].range.first_node;
+    if (train_dirty)
+        orphan_nodes += train_range.last_node - train_range.first_node;
+    if (2 * orphan_nodes > scene_graph.nbNodes())
+    {
+        buildSceneGraph();
         return;
+    }
+    for (int r : dirty_regions)
+        buildRegion(regions[r]);
+    if (train_dirty)
+        buildTrain();
+    builder = NULL;
+    dirty_regions.clear();
+}
 
-    cloud_1_anim += cloud_1_speed;
-    if (cloud_1_anim > cloud_1_max_y_pos)
+/* Copy the draws of a region visible in one of the views, unless its last list is still valid */
+void recordRegion(Region &region, const std::vector<Matrix4D> &view_projs)
+{
+    bool visible = false;
+    for (size_t v = 0; v < view_projs.size() && !visible; v++)
+        visible = regionVisible(region, view_projs[v]);
+    if (!visible)
     {
-        cloud_1_anim = 0.0f;
-        randomCloud1Pos(data);
-        randomCloud1Speed();
+        region.list.clear();
+        region.recorded = false;
+        return;
     }
+    if (region.recorded && !scene_graph.changed(region.range.first_node, region.range.last_node))
+        return;
+    region.list.clear();
+    scene_graph.record(region.list, region.range.first_draw, region.range.last_draw);
+    region.recorded = true;
 }
 
-void drawCloud2(const nlohmann::json &data)
+void setRecordThreads(unsigned int nb_threads)
 {
-    myEngine.mvMatrixStack.pushMatrix();
-    myEngine.mvMatrixStack.addTranslation(Vector3D{cloud_2_pos.x + cloud_2_anim, cloud_2_pos.y, cloud_2_pos.z});
-    myEngine.updateMvMatrix();
-    myEngine.setFlatColor(0.9f, 0.9f, 0.9f);
-    cloud_2.drawShape();
-    myEngine.mvMatrixStack.popMatrix();
-    myEngine.updateMvMatrix();
+    record_threads = nb_threads;
+    record_pool.reset();
+}
 
-    if (!animate)
-        return;
+/* Record the scene for all the views at once : the draws of a region are recorded once if any
+   view sees it, and the views share the world matrices and the instance data */
+void recordViews(const std::vector<Matrix4D> &view_projs)
+{
+    if (scene_graph_dirty || built_shader != myEngine.currentShader)
+        buildSceneGraph();
+    else if (!dirty_regions.empty() || train_dirty)
+        buildDirtyRegions();
+    /* Only the subtrees whose transform changed are multiplied again */
+    scene_graph.update();
+    if (chimney_node >= 0)
+    {
+        const Vector4D top = scene_graph.world(chimney_node) * Vector4D{0.0f, 0.0f, 0.0f, 1.0f};
+        particles.setEmitter(Vector3D{top.x, top.y, top.z + SMOKE_SOURCE_HEIGHT});
+    }
+    else
+        particles.clearEmitter();
+
+    render_queue.clear();
+    recordRange(ground_range);
+
+    /* One task per region, appended in region order so that the frame does not depend on the
+       thread that recorded each region */
+    if (!record_pool)
+        record_pool.reset(new WorkPool(record_threads));
+    record_pool->run(regions.size(), [&view_projs](size_t r, unsigned int)
+                     { recordRegion(regions[r], view_projs); });
+    for (const auto &region : regions)
+        render_queue.append(region.list);
+
+    recordRange(train_range);
+}
+
+void recordScene()
+{
+    recordViews({myEngine.projMatrix * myEngine.viewMatrix});
+}
+
+void renderScene()
+{
+    /* Record the whole scene, then draw it sorted by state */
+    recordScene();
+    if (animate)
+        particles.update(PARTICLE_STEP);
+    render_queue.submit(myEngine);
+    particles.draw(myEngine.projMatrix * myEngine.viewMatrix, myEngine.viewMatrix);
+}
+
+bool initParticles(int nb_puffs, int nb_smoke)
+{
+    if (!particles.init(nb_puffs, nb_smoke))
+        return false;
+    particles.spawn(CELL_SIZE * layout.sizeGrid());
+    return true;
+}
+
+void freeMeshes()
+{
+    delete ground;
+    delete ballast;
+    delete ballast_side;
+    delete train_wheel;
+    delete train_wheel_side;
+    delete train_chimney;
+    delete train_chimney_hat;
+    ground = NULL;
+    ballast = NULL;
+    ballast_side = NULL;
+    train_wheel = NULL;
+    train_wheel_side = NULL;
+    train_chimney = NULL;
+    train_chimney_hat = NULL;
+}
+
+void freeScene()
+{
+    freeMeshes();
+    particles.free();
+    myEngine.freeGL();
+}
+
+/* ---PICKING--- */
 
-    cloud_2_anim += cloud_2_speed;
-    if (cloud_2_anim > cloud_1_max_y_pos)
+/* Tops of the objects, from their construction above */
+static const float TRACK_TOP = RR * 2.0f + SR;
+static const float STATION_TOP = STATION_GROUND_HEIGHT_1 + STATION_GROUND_HEIGHT_2 + BENCH_HEIGHT;
+static const float TREE_TOP = TRUNK_HEIGHT + LEAF_HEIGHT;
+static const float BUILDING_TOP = BUILDING_SIZE * 2.0f * BUILDING_HEIGHT;
+static const float TRAIN_TOP = TRACK_TOP + TRAIN_WHEEL_RADIUS * 2.0f + (TRAIN_X_END - TRAIN_X_START) + TRAIN_CHIMNEY_HEIGHT + 1.0f;
+
+/* Box of an object on cell, from the ground to top, inset by margin on each side */
+int addPickObject(PickKind kind, const Vector2D &cell, float margin, float top)
+{
+    int object = pick_grid.add(Vector3D{cell.x * CELL_SIZE + margin, cell.y * CELL_SIZE + margin, 0.0f},
+                               Vector3D{(cell.x + 1) * CELL_SIZE - margin, (cell.y + 1) * CELL_SIZE - margin, top});
+    if (object >= int(pick_objects.size()))
+        pick_objects.resize(object + 1);
+    pick_objects[object] = PickObject{kind, cell};
+    if (kind != PickKind::Train)
+        pick_cells.insert({cell, object});
+    return object;
+}
+
+void addSceneryPickObject(const Vector2D &cell, SceneryKind kind)
+{
+    if (kind == SceneryKind::Tree)
+        addPickObject(PickKind::Tree, cell, (CELL_SIZE - LEAF_WIDTH) / 2.0f, TREE_TOP);
+    else
+        addPickObject(PickKind::Building, cell, (CELL_SIZE - GRAY_BUILDING_WIDTH) / 2.0f, BUILDING_TOP);
+}
+
+void buildPickGrid()
+{
+    pick_grid.reset(layout.sizeGrid(), CELL_SIZE);
+    pick_objects.clear();
+    pick_cells.clear();
+    /* The train is on a track cell and higher : its box is hit first from above */
+    pick_train = layout.empty() ? -1 : addPickObject(PickKind::Train, layout.first(), 0.0f, TRAIN_TOP);
+    for (int node = 0; node < track_graph.nodeCount(); node++)
+        addPickObject(PickKind::Track, track_graph.cell(node), 0.0f, TRACK_TOP);
+    for (const auto &station : layout.allStations())
+        addPickObject(PickKind::Station, station, 0.0f, STATION_TOP);
+    for (const auto &s : layout.allScenery())
+        addSceneryPickObject(s.first, s.second);
+    pick_grid.build();
+}
+
+/* Replace the objects of the cells, and the train, in place */
+void updatePickGrid(const std::vector<Vector2D> &cells)
+{
+    if (pick_train >= 0)
+        pick_grid.remove(pick_train);
+    pick_train = layout.empty() ? -1 : addPickObject(PickKind::Train, layout.first(), 0.0f, TRAIN_TOP);
+    for (const auto &cell : cells)
     {
-        cloud_2_anim = 0.0f;
-        randomCloud2Pos(data);
-        randomCloud2Speed();
+        auto range = pick_cells.equal_range(cell);
+        for (auto it = range.first; it != range.second; ++it)
+            pick_grid.remove(it->second);
+        pick_cells.erase(range.first, range.second);
+    }
+    for (const auto &cell : cells)
+    {
+        if (pick_cells.count(cell))
+            continue;
+        if (track_graph.node(cell) >= 0)
+            addPickObject(PickKind::Track, cell, 0.0f, TRACK_TOP);
+        if (layout.isStation(cell))
+            addPickObject(PickKind::Station, cell, 0.0f, STATION_TOP);
+        auto it = layout.allScenery().find(cell);
+        if (it != layout.allScenery().end())
+            addSceneryPickObject(cell, it->second);
     }
 }
 
-void draw_clouds(const nlohmann::json &data)
+PickResult pickAt(const Matrix4D &view_proj, double x, double y, int width, int height)
 {
-    drawCloud1(data);
-    drawCloud2(data);
+    PickResult result;
+    if (width <= 0 || height <= 0)
+        return result;
+
+    /* Points of the pixel on the near and far planes */
+    Matrix4D inverse = view_proj;
+    if (!inverse.invert())
+        return result;
+    const float ndc_x = 2.0f * x / width - 1.0f, ndc_y = 1.0f - 2.0f * y / height;
+    Vector4D near_point = inverse * Vector4D{ndc_x, ndc_y, -1.0f, 1.0f};
+    Vector4D far_point = inverse * Vector4D{ndc_x, ndc_y, 1.0f, 1.0f};
+    const Vector3D origin{near_point.x / near_point.w, near_point.y / near_point.w, near_point.z / near_point.w};
+    Vector3D direction = Vector3D{far_point.x / far_point.w, far_point.y / far_point.w, far_point.z / far_point.w} - origin;
+    const float length = direction.norme();
+    direction.normalize();
+
+    float distance;
+    int object = pick_grid.cast(origin, direction, length, distance, &result.cells_visited);
+    if (object >= 0)
+    {
+        result.kind = pick_objects[object].kind;
+        result.cell = pick_objects[object].cell;
+        result.distance = distance;
+        return result;
+    }
+
+    /* Nothing stands there : the ground, if the ray goes down onto the grid */
+    if (direction.z < 0.0f && origin.z > 0.0f)
+    {
+        const float t = -origin.z / direction.z;
+        const Vector3D ground_point = origin + direction * t;
+        const int cx = int(std::floor(ground_point.x / CELL_SIZE)), cy = int(std::floor(ground_point.y / CELL_SIZE));
+        if (t <= length && cx >= 0 && cy >= 0 && cx < layout.sizeGrid() && cy < layout.sizeGrid())
+        {
+            result.kind = PickKind::Ground;
+            result.cell = Vector2D{cx, cy};
+            result.distance = t;
+        }
+    }
+    return result;
 }
 
-void renderScene(const nlohmann::json &data)
+std::string pickDetails(const PickResult &pick)
 {
-    drawGround();
-    drawTracks(data);
-    drawStation(data);
-    drawTrain(data);
-    draw_sets();
-    draw_clouds(data);
+    static const char *PIECE_NAMES[] = {"straight", "curve", "switch", "crossing"};
+    std::stringstream out;
+    const std::string cell = "(" + std::to_string(pick.cell.x) + ", " + std::to_string(pick.cell.y) + ")";
+    switch (pick.kind)
+    {
+    case PickKind::None:
+        out << "nothing";
+        break;
+    case PickKind::Ground:
+        out << "empty cell " << cell << ", " << terrainName(layout.terrainAt(pick.cell));
+        break;
+    case PickKind::Track:
+    {
+        int node = track_graph.node(pick.cell);
+        out << PIECE_NAMES[int(track_graph.pieceKind(node))] << " track " << cell << ", " << track_graph.degree(node)
+            << " connections" << (layout.track(pick.cell) ? ", on the path" : ", branch");
+        break;
+    }
+    case PickKind::Station:
+        out << "station " << cell;
+        break;
+    case PickKind::Tree:
+        out << "tree " << cell;
+        break;
+    case PickKind::Building:
+        out << "building " << cell;
+        break;
+    case PickKind::Train:
+        out << "train on " << cell;
+        break;
+    }
+    if (pick.kind != PickKind::None)
+        out << ", " << pick.distance << " away";
+    out << " (" << pick.cells_visited << " cells walked)";
+    return out.str();
+}
+
+/* ---EDITING--- */
+
+/* Follow an edit of the layout that changed cells */
+void followTrackEdit(const std::vector<Vector2D> &changed)
+{
+    track_graph.update(layout, changed);
+    updateRegions(changed);
+}
+
+bool insertTrackInScene(const Vector2D &cell, const Vector2D &after)
+{
+    std::vector<Vector2D> changed{};
+    if (!layout.insertTrack(cell, after, changed))
+        return false;
+    followTrackEdit(changed);
+    return true;
+}
+
+bool removeTrackFromScene(const Vector2D &cell)
+{
+    std::vector<Vector2D> changed{};
+    if (!layout.removeTrack(cell, changed))
+        return false;
+    followTrackEdit(changed);
+    return true;
+}
+
+bool moveTrackInScene(const Vector2D &from, const Vector2D &to)
+{
+    std::vector<Vector2D> changed{};
+    if (!layout.moveTrack(from, to, changed))
+        return false;
+    followTrackEdit(changed);
+    return true;
+}
+
+/* ---VIEWS--- */
+
+/* Field of view of every camera, in degrees */
+static const float VIEW_FOV = 60.0f;
+/* The station camera looks at the first station from this far, the chase camera follows the
+   train from this far behind and this high */
+static const float STATION_VIEW_DISTANCE = 2.5f * CELL_SIZE;
+static const float CHASE_VIEW_DISTANCE = 2.0f * CELL_SIZE;
+static const float CHASE_VIEW_HEIGHT = CELL_SIZE;
+
+bool parseViewCameras(const std::string &list, std::vector<ViewCamera> &cameras)
+{
+    cameras.clear();
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ','))
+    {
+        if (name == "free")
+            cameras.push_back(ViewCamera::Free);
+        else if (name == "overview")
+            cameras.push_back(ViewCamera::Overview);
+        else if (name == "station")
+            cameras.push_back(ViewCamera::Station);
+        else if (name == "chase")
+            cameras.push_back(ViewCamera::Chase);
+        else
+        {
+            std::cerr << "ERROR: Unknown view " << name << " (free, overview, station or chase)" << std::endl;
+            return false;
+        }
+    }
+    return !cameras.empty();
+}
+
+/* Center of a cell, on the ground */
+Vector3D cellCenter(const Vector2D &cell)
+{
+    return Vector3D{(cell.x + 0.5f) * CELL_SIZE, (cell.y + 0.5f) * CELL_SIZE, 0.0f};
+}
+
+Matrix4D cameraView(ViewCamera camera)
+{
+    const float size = layout.sizeGrid() * CELL_SIZE;
+    switch (camera)
+    {
+    case ViewCamera::Free:
+        break;
+    case ViewCamera::Overview:
+    {
+        /* The whole grid, from the south at 45 degrees */
+        const Vector3D center{size / 2.0f, size / 2.0f, 0.0f};
+        return Matrix4D::lookAt(center + Vector3D{0.0f, -0.6f * size, 0.6f * size}, center, camera_up);
+    }
+    case ViewCamera::Station:
+        if (layout.allStations().empty())
+            return cameraView(ViewCamera::Overview);
+        {
+            const Vector3D station = cellCenter(layout.allStations().front());
+            const float d = STATION_VIEW_DISTANCE;
+            return Matrix4D::lookAt(station + Vector3D{-0.7f * d, -0.7f * d, 0.5f * d}, station, camera_up);
+        }
+    case ViewCamera::Chase:
+        if (layout.empty())
+            return cameraView(ViewCamera::Overview);
+        {
+            const Vector2D &current = layout.first();
+            const TrackCell *cell = layout.track(current);
+            const Vector3D train = cellCenter(current);
+            Vector3D direction = cell ? cellCenter(cell->next) - train : Vector3D{0.0f, 1.0f, 0.0f};
+            if (direction.norme() < 1e-3f)
+                direction = Vector3D{0.0f, 1.0f, 0.0f};
+            direction.normalize();
+            return Matrix4D::lookAt(train - direction * CHASE_VIEW_DISTANCE + Vector3D{0.0f, 0.0f, CHASE_VIEW_HEIGHT},
+                                    train + direction * CELL_SIZE, camera_up);
+        }
+    }
+    return Matrix4D::lookAt(camera_pos, camera_pos + camera_front, camera_up);
+}
+
+std::vector<SceneView> tileViews(const std::vector<ViewCamera> &cameras, int width, int height)
+{
+    std::vector<SceneView> views;
+    if (cameras.empty())
+        return views;
+    const int columns = int(std::ceil(std::sqrt(float(cameras.size()))));
+    const int rows = (int(cameras.size()) + columns - 1) / columns;
+    const int cell_width = width / columns, cell_height = height / rows;
+    for (size_t i = 0; i < cameras.size(); i++)
+    {
+        const int column = i % columns, row = i / columns;
+        /* First row at the top : GL viewports start from the bottom */
+        views.push_back(SceneView{cameras[i], column * cell_width, height - (row + 1) * cell_height, cell_width, cell_height});
+    }
+    return views;
+}
+
+/* Camera and projection of a view */
+struct ViewSetup
+{
+    Matrix4D view;
+    float aspect, z_far;
+};
+
+ViewSetup viewSetup(const SceneView &view)
+{
+    /* The overview sees the far side of the grid */
+    const float z_far = view.camera == ViewCamera::Overview ? std::max(Z_FAR, 1.5f * layout.sizeGrid() * CELL_SIZE) : Z_FAR;
+    return ViewSetup{cameraView(view.camera), view.width / float(std::max(view.height, 1)), z_far};
+}
+
+Matrix4D viewProjection(const SceneView &view)
+{
+    const ViewSetup setup = viewSetup(view);
+    return Matrix4D::perspective(VIEW_FOV, setup.aspect, Z_NEAR, setup.z_far) * setup.view;
+}
+
+void renderViews(const std::vector<SceneView> &views)
+{
+    std::vector<ViewSetup> cameras;
+    std::vector<Matrix4D> view_projs;
+    for (const auto &view : views)
+    {
+        cameras.push_back(viewSetup(view));
+        view_projs.push_back(Matrix4D::perspective(VIEW_FOV, cameras.back().aspect, Z_NEAR, cameras.back().z_far) *
+                             cameras.back().view);
+    }
+
+    /* The scene is recorded and its instance data streamed once; each view only adds its draws */
+    recordViews(view_projs);
+    if (animate)
+        particles.update(PARTICLE_STEP);
+    render_queue.upload(myEngine);
+    for (size_t v = 0; v < views.size(); v++)
+    {
+        glViewport(views[v].x, views[v].y, views[v].width, views[v].height);
+        myEngine.set3DProjection(VIEW_FOV, cameras[v].aspect, Z_NEAR, cameras[v].z_far);
+        myEngine.mvMatrixStack.loadIdentity();
+        myEngine.setViewMatrix(cameras[v].view);
+        /* Light clusters are cut along the frustum of the view */
+        myEngine.updateLightClusters();
+        myEngine.updateFrameUniforms();
+        render_queue.draw(myEngine);
+        particles.draw(view_projs[v], cameras[v].view);
+    }
+    render_queue.endFrame();
+}
+
+const GLBI_Queue_Stats &renderStats()
+{
+    return render_queue.lastFrameStats();
 }
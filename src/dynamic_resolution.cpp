@@ -0,0 +1,180 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+/* Over budget above TARGET_HIGH x target, well under it below TARGET_LOW x target */
+static const double TARGET_HIGH = 1.0;
+static const double TARGET_LOW = 0.7;
+/* Samples needed before going down and before going up */
+static const int FRAMES_BEFORE_DOWN = 3;
+static const int FRAMES_BEFORE_UP = 60;
+/* Scales are multiples of SCALE_STEP; going up is one step at a time */
+static const float SCALE_STEP = 0.05f;
+/* Weight of a new GPU time in the smoothed one */
+static const double GPU_SMOOTHING = 0.2;
+
+DynamicResolution::~DynamicResolution()
+{
+    free();
+}
+
+bool DynamicResolution::init(double target, float min)
+{
+    target_ms = target;
+    min_scale = std::min(std::max(min, SCALE_STEP), 1.0f);
+    current_scale = 1.0f;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &color);
+    glGenRenderbuffers(1, &depth);
+    glGenQueries(RESOLUTION_QUERIES, queries);
+    if (!fbo || !color || !depth || !queries[0])
+    {
+        std::cerr << "ERROR: Cannot create the buffers of the dynamic resolution" << std::endl;
+        free();
+        return false;
+    }
+    return true;
+}
+
+void DynamicResolution::free()
+{
+    if (fbo)
+        glDeleteFramebuffers(1, &fbo);
+    if (color)
+        glDeleteRenderbuffers(1, &color);
+    if (depth)
+        glDeleteRenderbuffers(1, &depth);
+    if (queries[0])
+        glDeleteQueries(RESOLUTION_QUERIES, queries);
+    fbo = color = depth = 0;
+    std::fill(queries, queries + RESOLUTION_QUERIES, 0u);
+    std::fill(pending, pending + RESOLUTION_QUERIES, false);
+    fbo_width = fbo_height = 0;
+}
+
+bool DynamicResolution::resize(int width, int height)
+{
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        std::cerr << "ERROR: Incomplete framebuffer for the dynamic resolution, rendering at full size" << std::endl;
+        free();
+        return false;
+    }
+    fbo_width = width;
+    fbo_height = height;
+    return true;
+}
+
+void DynamicResolution::adapt(double sample_ms)
+{
+    gpu_ms = gpu_ms > 0.0 ? (1.0 - GPU_SMOOTHING) * gpu_ms + GPU_SMOOTHING * sample_ms : sample_ms;
+    if (cooldown > 0)
+    {
+        cooldown--;
+        return;
+    }
+
+    float scale = current_scale;
+    if (gpu_ms > TARGET_HIGH * target_ms)
+    {
+        frames_under = 0;
+        if (++frames_over < FRAMES_BEFORE_DOWN)
+            return;
+        /* The fill cost follows the area : scale the sides by the square root of the excess */
+        scale = std::floor(current_scale * std::sqrt(TARGET_HIGH * target_ms / gpu_ms) / SCALE_STEP) * SCALE_STEP;
+        scale = std::min(scale, current_scale - SCALE_STEP);
+    }
+    else if (gpu_ms < TARGET_LOW * target_ms)
+    {
+        frames_over = 0;
+        if (++frames_under < FRAMES_BEFORE_UP)
+            return;
+        scale = current_scale + SCALE_STEP;
+    }
+    else
+    {
+        frames_over = frames_under = 0;
+        return;
+    }
+
+    scale = std::min(std::max(scale, min_scale), 1.0f);
+    frames_over = frames_under = 0;
+    if (scale == current_scale)
+        return;
+    current_scale = scale;
+    /* The queries in flight measured the old size */
+    cooldown = RESOLUTION_QUERIES;
+}
+
+void DynamicResolution::readQueries()
+{
+    while (pending[oldest_query])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[oldest_query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[oldest_query], GL_QUERY_RESULT, &nanoseconds);
+        pending[oldest_query] = false;
+        oldest_query = (oldest_query + 1) % RESOLUTION_QUERIES;
+        adapt(nanoseconds * 1e-6);
+    }
+}
+
+void DynamicResolution::begin(int width, int height, int &rendered_width, int &rendered_height)
+{
+    rendered_width = width;
+    rendered_height = height;
+    window_width = width;
+    window_height = height;
+    if (!fbo || width <= 0 || height <= 0)
+        return;
+    if ((width != fbo_width || height != fbo_height) && !resize(width, height))
+        return;
+
+    readQueries();
+    render_width = std::max(1, int(width * current_scale + 0.5f));
+    render_height = std::max(1, int(height * current_scale + 0.5f));
+    rendered_width = render_width;
+    rendered_height = render_height;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, render_width, render_height);
+    /* Without a free query (the GPU is more than RESOLUTION_QUERIES frames behind), this frame is not timed */
+    timing = !pending[next_query];
+    if (timing)
+        glBeginQuery(GL_TIME_ELAPSED, queries[next_query]);
+}
+
+void DynamicResolution::end()
+{
+    if (!fbo || fbo_width == 0)
+        return;
+    if (timing)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next_query] = true;
+        next_query = (next_query + 1) % RESOLUTION_QUERIES;
+        timing = false;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, window_width, window_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_width, window_height);
+}
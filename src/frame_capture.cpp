@@ -0,0 +1,251 @@
+#include "frame_capture.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "tools/stb_image_write.h"
+
+/* Frames the writer may be behind before the render thread waits for it */
+static const size_t MAX_QUEUED_FRAMES = 8;
+/* Fence waits are split in steps of 1 ms */
+static const GLuint64 FENCE_WAIT_STEP_NS = 1000000;
+
+FrameCapture::~FrameCapture()
+{
+    close();
+}
+
+bool FrameCapture::open(CaptureFormat f, const std::string &p, int w, int h, int fps)
+{
+    close();
+    format = f;
+    path = p;
+    width = w;
+    height = h;
+    if (format == CaptureFormat::Y4m)
+    {
+        width -= width % 2;
+        height -= height % 2;
+    }
+    if (width <= 0 || height <= 0)
+    {
+        std::cerr << "ERROR: Cannot capture a " << w << "x" << h << " frame" << std::endl;
+        return false;
+    }
+
+    if (format == CaptureFormat::Y4m)
+    {
+        video.open(path, std::ios::binary);
+        if (!video)
+        {
+            std::cerr << "ERROR: Cannot write " << path << std::endl;
+            return false;
+        }
+        /* Full range BT.601, square pixels, progressive */
+        video << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+        yuv.resize(size_t(width) * height * 3 / 2);
+    }
+
+    const size_t size = size_t(width) * height * 4;
+    glGenBuffers(CAPTURE_PBOS, pbos);
+    for (int i = 0; i < CAPTURE_PBOS; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        fences[i] = NULL;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    frames_captured = frames_written = 0;
+    capture_seconds = 0.0;
+    gpu_waits = writer_waits = 0;
+    stopping = false;
+    write_failed = false;
+    writer = std::thread(&FrameCapture::writerLoop, this);
+    opened = true;
+    return true;
+}
+
+void FrameCapture::capture()
+{
+    if (!opened)
+        return;
+    auto start = std::chrono::steady_clock::now();
+
+    /* The previous frame in this slot was read back one frame ago */
+    int slot = frames_captured % CAPTURE_PBOS;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frames_captured++;
+
+    /* Frame of two frames ago : the copy is most likely done */
+    int oldest = (slot + 1) % CAPTURE_PBOS;
+    if (fences[oldest])
+        readBack(oldest);
+
+    capture_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrameCapture::readBack(int slot)
+{
+    if (glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        gpu_waits++;
+        while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_STEP_NS) == GL_TIMEOUT_EXPIRED)
+            ;
+    }
+    glDeleteSync(fences[slot]);
+    fences[slot] = NULL;
+
+    const size_t size = size_t(width) * height * 4;
+    std::vector<unsigned char> pixels{};
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if (queue.size() >= MAX_QUEUED_FRAMES)
+        {
+            writer_waits++;
+            queue_changed.wait(lock, [this]()
+                               { return queue.size() < MAX_QUEUED_FRAMES; });
+        }
+        if (!free_buffers.empty())
+        {
+            pixels = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+    }
+    pixels.resize(size);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+    const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        memcpy(pixels.data(), mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!mapped)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(std::move(pixels));
+    }
+    queue_changed.notify_all();
+}
+
+void FrameCapture::close()
+{
+    if (!opened)
+        return;
+
+    /* Oldest frames first */
+    for (int i = 1; i <= CAPTURE_PBOS; i++)
+    {
+        int slot = (frames_captured + i) % CAPTURE_PBOS;
+        if (fences[slot])
+            readBack(slot);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    writer.join();
+
+    glDeleteBuffers(CAPTURE_PBOS, pbos);
+    for (int i = 0; i < CAPTURE_PBOS; i++)
+        pbos[i] = 0;
+    if (video.is_open())
+        video.close();
+    queue.clear();
+    free_buffers.clear();
+    opened = false;
+
+    std::cout << "Capture: " << frames_written << "/" << frames_captured << " frames written to " << path << ", "
+              << 1000.0 * capture_seconds / std::max(frames_captured, 1L) << " ms per frame on the render thread ("
+              << gpu_waits << " GPU waits, " << writer_waits << " writer waits)" << std::endl;
+    if (write_failed)
+        std::cerr << "ERROR: Some frames could not be written to " << path << std::endl;
+}
+
+/* ---WRITER THREAD--- */
+
+void FrameCapture::writerLoop()
+{
+    /* Only this thread writes PNG files : the stb flag is global */
+    stbi_flip_vertically_on_write(1);
+    long index = 0;
+    while (true)
+    {
+        std::vector<unsigned char> pixels{};
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_changed.wait(lock, [this]()
+                               { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            pixels = std::move(queue.front());
+            queue.pop_front();
+        }
+        queue_changed.notify_all();
+
+        bool written = format == CaptureFormat::Png ? writePng(pixels, index) : writeY4m(pixels);
+        index++;
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (written)
+            frames_written++;
+        else
+            write_failed = true;
+        free_buffers.push_back(std::move(pixels));
+    }
+}
+
+bool FrameCapture::writePng(const std::vector<unsigned char> &pixels, long index)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%06ld.png", index);
+    return stbi_write_png((path + name).c_str(), width, height, 4, pixels.data(), width * 4);
+}
+
+bool FrameCapture::writeY4m(const std::vector<unsigned char> &pixels)
+{
+    unsigned char *y_plane = yuv.data();
+    unsigned char *u_plane = y_plane + size_t(width) * height;
+    unsigned char *v_plane = u_plane + size_t(width) * height / 4;
+
+    /* GL rows go upwards : flip while converting. Chroma is averaged on 2x2 pixels */
+    for (int y = 0; y < height; y += 2)
+    {
+        const unsigned char *rows[2] = {&pixels[size_t(height - 1 - y) * width * 4], &pixels[size_t(height - 2 - y) * width * 4]};
+        for (int x = 0; x < width; x += 2)
+        {
+            int r_sum = 0, g_sum = 0, b_sum = 0;
+            for (int dy = 0; dy < 2; dy++)
+            {
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    const unsigned char *p = rows[dy] + (x + dx) * 4;
+                    int r = p[0], g = p[1], b = p[2];
+                    y_plane[size_t(y + dy) * width + x + dx] = (77 * r + 150 * g + 29 * b) >> 8;
+                    r_sum += r;
+                    g_sum += g;
+                    b_sum += b;
+                }
+            }
+            size_t c = size_t(y / 2) * (width / 2) + x / 2;
+            u_plane[c] = ((-43 * r_sum - 85 * g_sum + 128 * b_sum) >> 10) + 128;
+            v_plane[c] = ((128 * r_sum - 107 * g_sum - 21 * b_sum) >> 10) + 128;
+        }
+    }
+
+    video << "FRAME\n";
+    video.write(reinterpret_cast<const char *>(yuv.data()), yuv.size());
+    return bool(video);
+}
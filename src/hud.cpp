@@ -0,0 +1,213 @@
+#include "hud.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "glad/glad.h"
+#include "tools/shaders.hpp"
+
+using namespace STP3D;
+
+/* Glyphs are 5x7 pixels in cells of 6x8, with a border of 1 pixel around the text */
+static const int GLYPH_WIDTH = 5;
+static const int GLYPH_HEIGHT = 7;
+static const int CELL_WIDTH = 6;
+static const int CELL_HEIGHT = 8;
+static const int BORDER = 1;
+/* Screen pixels per font pixel, and distance to the window corner */
+static const int HUD_SCALE = 2;
+static const int HUD_MARGIN = 8;
+
+/* One row per byte, top row first, leftmost pixel in bit 4 */
+static const char GLYPH_CHARS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:/%-(),=";
+static const unsigned char GLYPHS[][GLYPH_HEIGHT] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, /* 0 */
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, /* 1 */
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, /* 2 */
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, /* 3 */
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, /* 4 */
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, /* 5 */
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, /* 6 */
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, /* 7 */
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, /* 8 */
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, /* 9 */
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, /* A */
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, /* B */
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, /* C */
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, /* D */
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, /* E */
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, /* F */
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, /* G */
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, /* H */
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, /* I */
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, /* J */
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, /* K */
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, /* L */
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, /* M */
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, /* N */
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, /* O */
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, /* P */
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, /* Q */
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, /* R */
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, /* S */
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, /* T */
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, /* U */
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, /* V */
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, /* W */
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, /* X */
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, /* Y */
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, /* Z */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, /* . */
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, /* : */
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, /* / */
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, /* % */
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, /* - */
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, /* ( */
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, /* ) */
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, /* , */
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}, /* = */
+};
+
+/* Rows of c, NULL for a space or a character without glyph */
+static const unsigned char *glyph(char c)
+{
+    c = std::toupper((unsigned char)c);
+    const char *found = c ? std::strchr(GLYPH_CHARS, c) : NULL;
+    return found ? GLYPHS[found - GLYPH_CHARS] : NULL;
+}
+
+bool Hud::init()
+{
+    program = ShaderManager::loadShader("../assets/shaders/hud.vert", "../assets/shaders/hud.frag", true);
+    if (!program)
+    {
+        std::cerr << "ERROR: Cannot load the HUD shaders" << std::endl;
+        return false;
+    }
+    /* The quad corners come from gl_VertexID, but a VAO must still be bound */
+    glGenVertexArrays(1, &vao);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void Hud::free()
+{
+    if (program)
+        glDeleteProgram(program);
+    if (vao)
+        glDeleteVertexArrays(1, &vao);
+    if (texture)
+        glDeleteTextures(1, &texture);
+    program = vao = texture = 0;
+    texture_width = texture_height = 0;
+}
+
+void Hud::setText(const std::vector<std::string> &lines)
+{
+    size_t longest = 0;
+    for (const auto &line : lines)
+        longest = std::max(longest, line.size());
+    if (!texture || longest == 0)
+    {
+        texture_width = texture_height = 0;
+        return;
+    }
+    texture_width = int(longest) * CELL_WIDTH + 2 * BORDER - 1;
+    texture_height = int(lines.size()) * CELL_HEIGHT + 2 * BORDER - 1;
+    pixels.assign(size_t(texture_width) * texture_height, 0);
+
+    /* Texture row 0 is the top of the quad */
+    for (size_t l = 0; l < lines.size(); l++)
+    {
+        for (size_t c = 0; c < lines[l].size(); c++)
+        {
+            const unsigned char *rows = glyph(lines[l][c]);
+            if (!rows)
+                continue;
+            for (int y = 0; y < GLYPH_HEIGHT; y++)
+            {
+                unsigned char *out = &pixels[size_t(BORDER + l * CELL_HEIGHT + y) * texture_width + BORDER + c * CELL_WIDTH];
+                for (int x = 0; x < GLYPH_WIDTH; x++)
+                {
+                    if (rows[y] & (0x10 >> x))
+                        out[x] = 255;
+                }
+            }
+        }
+    }
+
+    /* Rows of one byte per pixel are not aligned on 4 bytes */
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, texture_width, texture_height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+void Hud::draw(int width, int height)
+{
+    if (!program || texture_width == 0 || width <= 0 || height <= 0)
+        return;
+
+    /* Pixel rectangle of the text, in normalized device coordinates */
+    float left = -1.0f + 2.0f * HUD_MARGIN / width;
+    float top = 1.0f - 2.0f * HUD_MARGIN / height;
+    float right = left + 2.0f * HUD_SCALE * texture_width / width;
+    float bottom = top - 2.0f * HUD_SCALE * texture_height / height;
+
+    GLint previous_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(program);
+    glUniform4f(glGetUniformLocation(program, "rect"), left, bottom, right, top);
+    glUniform1i(glGetUniformLocation(program, "text"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glUseProgram(previous_program);
+    glDisable(GL_BLEND);
+    if (depth_test)
+        glEnable(GL_DEPTH_TEST);
+}
+
+std::vector<std::string> statsLines(const glbasimac::GLBI_Stats &stats, const glbasimac::GLBI_Queue_Stats &queue,
+                                    double frame_ms)
+{
+    char line[128];
+    std::vector<std::string> lines{};
+    std::snprintf(line, sizeof(line), "FRAME %.2f MS (%.0f FPS)", frame_ms, frame_ms > 0.0 ? 1000.0 / frame_ms : 0.0);
+    lines.push_back(line);
+    std::snprintf(line, sizeof(line), "DRAWS %u (%u INSTANCED), %llu TRIANGLES", stats.draw_calls,
+                  stats.instanced_draw_calls, (unsigned long long)stats.triangles);
+    lines.push_back(line);
+    std::snprintf(line, sizeof(line), "PROGRAMS %u, VAOS %u, TEXTURES %u", stats.program_switches, stats.vao_binds,
+                  stats.texture_binds);
+    lines.push_back(line);
+    std::snprintf(line, sizeof(line), "UNIFORMS: MODELVIEW %u, COLOR %u", stats.mv_uploads, stats.color_uploads);
+    lines.push_back(line);
+    std::snprintf(line, sizeof(line), "UPLOADS %u (%.1f KB), FENCE WAITS %u", stats.buffer_uploads,
+                  stats.buffer_bytes / 1024.0, queue.nb_fence_waits);
+    lines.push_back(line);
+    std::snprintf(line, sizeof(line), "QUEUE: %u ITEMS, %u STATE CHANGES (%u AVOIDED)", queue.nb_items,
+                  queue.nb_state_changes, queue.nb_state_changes_avoided);
+    lines.push_back(line);
+    return lines;
+}
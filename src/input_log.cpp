@@ -0,0 +1,77 @@
+#include "input_log.hpp"
+
+#include <cstring>
+#include <iostream>
+
+static const char LOG_MAGIC[4] = {'T', 'T', 'I', 'L'};
+static const uint32_t LOG_VERSION = 1;
+static const uint8_t FLAG_ANIMATE = 1;
+
+template <typename T>
+static void writeValue(std::ofstream &out, const T &value)
+{
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::ifstream &in, T &value)
+{
+    return bool(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+bool InputRecorder::open(const std::string &path, uint32_t seed)
+{
+    out.open(path, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "ERROR: Cannot write " << path << std::endl;
+        return false;
+    }
+    out.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+    writeValue(out, LOG_VERSION);
+    writeValue(out, seed);
+    return true;
+}
+
+void InputRecorder::write(const FrameInput &input)
+{
+    writeValue(out, input.camera_pos.x);
+    writeValue(out, input.camera_pos.y);
+    writeValue(out, input.camera_pos.z);
+    writeValue(out, input.yaw);
+    writeValue(out, input.pitch);
+    writeValue(out, uint8_t(input.animate ? FLAG_ANIMATE : 0));
+}
+
+bool InputReplayer::open(const std::string &path)
+{
+    in.open(path, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "ERROR: Cannot open " << path << std::endl;
+        return false;
+    }
+    char magic[4];
+    uint32_t version;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0 || !readValue(in, version) || !readValue(in, run_seed))
+    {
+        std::cerr << "ERROR: " << path << " is not an input log" << std::endl;
+        return false;
+    }
+    if (version != LOG_VERSION)
+    {
+        std::cerr << "ERROR: " << path << " has version " << version << ", expected " << LOG_VERSION << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool InputReplayer::read(FrameInput &input)
+{
+    uint8_t flags;
+    if (!readValue(in, input.camera_pos.x) || !readValue(in, input.camera_pos.y) || !readValue(in, input.camera_pos.z) ||
+        !readValue(in, input.yaw) || !readValue(in, input.pitch) || !readValue(in, flags))
+        return false;
+    input.animate = flags & FLAG_ANIMATE;
+    return true;
+}
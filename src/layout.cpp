@@ -0,0 +1,629 @@
+#include "layout.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+/* Occupied cells drawn in a row before deciding the grid is full */
+static const int FREE_CELL_TRIES = 100;
+
+/* ---JSON VALIDATION--- */
+
+static bool validSizeGridFormat(const nlohmann::json &data)
+{
+    return data.contains("size_grid") && data["size_grid"].is_number_integer();
+}
+
+static bool validOriginFormat(const nlohmann::json &data)
+{
+    return data.contains("origin") && data["origin"].is_array() && data["origin"].size() == 2 && data["origin"][0].is_number_integer() && data["origin"][1].is_number_integer();
+}
+
+static bool validPathFormat(const nlohmann::json &data)
+{
+    if (!data.contains("path") || !data["path"].is_array())
+        return false;
+    for (const auto &e : data["path"])
+    {
+        if (!e.is_array() || e.size() != 2 || !e[0].is_number_integer() || !e[1].is_number_integer())
+            return false;
+    }
+    return true;
+}
+
+static bool validCellFormat(const nlohmann::json &e)
+{
+    return e.is_array() && e.size() == 2 && e[0].is_number_integer() && e[1].is_number_integer();
+}
+
+/* Optional : [[[int, int], ...], ...], each branch at least two cells long */
+static bool validBranchesFormat(const nlohmann::json &data)
+{
+    if (!data.contains("branches"))
+        return true;
+    if (!data["branches"].is_array())
+        return false;
+    for (const auto &branch : data["branches"])
+    {
+        if (!branch.is_array() || branch.size() < 2)
+            return false;
+        for (const auto &e : branch)
+        {
+            if (!validCellFormat(e))
+                return false;
+        }
+    }
+    return true;
+}
+
+/* Optional : [[int, int], ...], stations added to the origin */
+static bool validStationsFormat(const nlohmann::json &data)
+{
+    if (!data.contains("stations"))
+        return true;
+    if (!data["stations"].is_array())
+        return false;
+    for (const auto &e : data["stations"])
+    {
+        if (!validCellFormat(e))
+            return false;
+    }
+    return true;
+}
+
+/* Optional : {"gravel": [[int, int], ...], "water": [...], ...}, other cells are grass */
+static bool validTerrainFormat(const nlohmann::json &data)
+{
+    if (!data.contains("terrain"))
+        return true;
+    if (!data["terrain"].is_object())
+        return false;
+    for (const auto &entry : data["terrain"].items())
+    {
+        if (!entry.value().is_array())
+            return false;
+        for (const auto &e : entry.value())
+        {
+            if (!validCellFormat(e))
+                return false;
+        }
+    }
+    return true;
+}
+
+const char *terrainName(TerrainKind kind)
+{
+    switch (kind)
+    {
+    case TerrainKind::Grass:
+        return "grass";
+    case TerrainKind::Gravel:
+        return "gravel";
+    case TerrainKind::Platform:
+        return "platform";
+    case TerrainKind::Water:
+        return "water";
+    case TerrainKind::Count:
+        break;
+    }
+    return "unknown";
+}
+
+const char *layoutErrorName(LayoutErrorKind kind)
+{
+    switch (kind)
+    {
+    case LayoutErrorKind::None:
+        return "ok";
+    case LayoutErrorKind::InvalidFormat:
+        return "invalid_format";
+    case LayoutErrorKind::GridTooSmall:
+        return "grid_too_small";
+    case LayoutErrorKind::DuplicateCell:
+        return "duplicate_cell";
+    case LayoutErrorKind::NotAdjacent:
+        return "not_adjacent";
+    }
+    return "unknown";
+}
+
+bool isCorner(const Vector2D &prev, const Vector2D &current, const Vector2D &next)
+{
+    auto A = current - prev;
+    auto B = next - current;
+    return (A.x * B.y - A.y * B.x) != 0;
+}
+
+uint8_t sideBit(const Vector2D &from, const Vector2D &to)
+{
+    return to.x > from.x ? 1 : to.x < from.x ? 2 : to.y > from.y ? 4 : 8;
+}
+
+/* ---LOADING--- */
+
+bool Layout::load(const nlohmann::json &data)
+{
+    LayoutError error = parse(data);
+    if (error)
+        std::cerr << "ERROR: " << error.message << std::endl;
+    return !error;
+}
+
+LayoutError Layout::parse(const nlohmann::json &data)
+{
+    if (!validSizeGridFormat(data) || !validOriginFormat(data) || !validPathFormat(data) ||
+        !validBranchesFormat(data) || !validStationsFormat(data) || !validTerrainFormat(data))
+    {
+        return {LayoutErrorKind::InvalidFormat, Vector2D{},
+                "Invalid json file\nsize_grid: int\norigin: [int, int]\npath: [[int, int], ...]\n"
+                "branches (optional): [[[int, int], ...], ...]\nstations (optional): [[int, int], ...]\n"
+                "terrain (optional): {\"gravel\" | \"platform\" | \"water\" | \"grass\": [[int, int], ...], ...}"};
+    }
+    if (data["size_grid"].get<int>() < 10)
+        return {LayoutErrorKind::GridTooSmall, Vector2D{}, "Grid size must be at least 10"};
+
+    size_grid = data["size_grid"].get<int>();
+    station = Vector2D{data["origin"].get<std::vector<int>>()};
+    tracks.clear();
+    broken_links.clear();
+    scenery.clear();
+
+    const auto &path = data["path"];
+    tracks.reserve(path.size());
+    Vector2D prev;
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        Vector2D current{path[i][0].get<int>(), path[i][1].get<int>()};
+
+        if (tracks.count(current))
+        {
+            return {LayoutErrorKind::DuplicateCell, current,
+                    "The path contains a duplicate (" + std::to_string(current.x) + ", " + std::to_string(current.y) + ")"};
+        }
+        if (i > 0 && current.manhattanDistance(prev) != 1)
+            return {LayoutErrorKind::NotAdjacent, current, "The current rail must be adjacent to the previous rail"};
+
+        if (i == 0)
+        {
+            first_cell = current;
+            tracks[current] = TrackCell{current, current, PieceKind::Straight};
+        }
+        else
+        {
+            /* Append at the end of the ring, just before the first cell */
+            tracks[current] = TrackCell{prev, first_cell, PieceKind::Straight};
+            tracks[prev].next = current;
+            tracks[first_cell].prev = current;
+        }
+        prev = current;
+    }
+
+    for (const auto &t : tracks)
+        updateKind(t.first);
+    LayoutError error = parseTerrain(data);
+    if (error)
+        return error;
+    return parseNetwork(data);
+}
+
+LayoutError Layout::parseTerrain(const nlohmann::json &data)
+{
+    terrain.clear();
+    if (!data.contains("terrain"))
+        return {};
+
+    for (const auto &entry : data["terrain"].items())
+    {
+        int kind = 0;
+        while (kind < int(TerrainKind::Count) && entry.key() != terrainName(TerrainKind(kind)))
+            kind++;
+        if (kind == int(TerrainKind::Count))
+            return {LayoutErrorKind::InvalidFormat, Vector2D{}, "Unknown terrain \"" + entry.key() + "\""};
+        for (const auto &e : entry.value())
+        {
+            Vector2D cell{e[0].get<int>(), e[1].get<int>()};
+            if (!setTerrain(cell, TerrainKind(kind)))
+            {
+                return {LayoutErrorKind::InvalidFormat, cell,
+                        "Terrain outside the grid (" + std::to_string(cell.x) + ", " + std::to_string(cell.y) + ")"};
+            }
+        }
+    }
+    return {};
+}
+
+LayoutError Layout::parseNetwork(const nlohmann::json &data)
+{
+    stations.assign(1, station);
+    branches.clear();
+    branch_cells.clear();
+    branch_links.clear();
+
+    if (data.contains("stations"))
+    {
+        for (const auto &e : data["stations"])
+            stations.push_back(Vector2D{e[0].get<int>(), e[1].get<int>()});
+    }
+    station_cells = std::unordered_set<Vector2D, Vector2DHash>(stations.begin(), stations.end());
+    if (!data.contains("branches"))
+        return {};
+
+    for (const auto &b : data["branches"])
+    {
+        std::vector<Vector2D> branch{};
+        branch.reserve(b.size());
+        for (size_t i = 0; i < b.size(); ++i)
+        {
+            Vector2D current{b[i][0].get<int>(), b[i][1].get<int>()};
+            if (i > 0 && current.manhattanDistance(branch.back()) != 1)
+                return {LayoutErrorKind::NotAdjacent, current, "The current rail of a branch must be adjacent to the previous rail"};
+
+            /* Only the ends of a branch may join an existing track */
+            bool end = i == 0 || i + 1 == b.size();
+            if (isTrack(current) && !end)
+            {
+                return {LayoutErrorKind::DuplicateCell, current,
+                        "A branch crosses a track at (" + std::to_string(current.x) + ", " + std::to_string(current.y) + ")"};
+            }
+            if (!isTrack(current))
+                branch_cells.insert(current);
+            if (i > 0)
+            {
+                branch_links[branch.back()] |= sideBit(branch.back(), current);
+                branch_links[current] |= sideBit(current, branch.back());
+            }
+            branch.push_back(current);
+        }
+        branches.push_back(std::move(branch));
+    }
+    return {};
+}
+
+void Layout::placeScenery(int treeCount, int buildingCount)
+{
+    scenery.reserve(scenery.size() + treeCount + buildingCount);
+    Vector2D cell;
+    for (int i = 0; i < treeCount && randomFreeCell(cell); i++)
+        scenery[cell] = SceneryKind::Tree;
+    for (int i = 0; i < buildingCount && randomFreeCell(cell); i++)
+        scenery[cell] = SceneryKind::Building;
+}
+
+bool Layout::randomFreeCell(Vector2D &cell)
+{
+    if (size_grid <= 0)
+        return false;
+    std::uniform_int_distribution<int> coord(0, size_grid - 1);
+    for (int i = 0; i < FREE_CELL_TRIES; i++)
+    {
+        cell = Vector2D{coord(randomEngine()), coord(randomEngine())};
+        if (isFree(cell))
+            return true;
+    }
+    return false;
+}
+
+LayoutDiff Layout::applyChanges(const Layout &target)
+{
+    LayoutDiff diff;
+    if (target.size_grid != size_grid)
+    {
+        size_grid = target.size_grid;
+        station = target.station;
+        stations = target.stations;
+        station_cells = target.station_cells;
+        first_cell = target.first_cell;
+        tracks = target.tracks;
+        broken_links = target.broken_links;
+        branches = target.branches;
+        branch_cells = target.branch_cells;
+        branch_links = target.branch_links;
+        scenery = target.scenery;
+        terrain = target.terrain;
+        diff.added = tracks.size();
+        diff.rebuilt = true;
+        return diff;
+    }
+
+    /* Cells whose link or kind has to be re-checked */
+    std::vector<Vector2D> touched{};
+    Vector2D last;
+    if (lastCell(last))
+        touched.push_back(last);
+
+    for (auto it = tracks.begin(); it != tracks.end();)
+    {
+        if (!target.tracks.count(it->first))
+        {
+            diff.cells.push_back(it->first);
+            broken_links.erase(it->first);
+            it = tracks.erase(it);
+            diff.removed++;
+        }
+        else
+            ++it;
+    }
+    for (const auto &t : target.tracks)
+    {
+        auto it = tracks.find(t.first);
+        if (it == tracks.end())
+        {
+            tracks[t.first] = t.second;
+            diff.added++;
+        }
+        else if (!(it->second.prev == t.second.prev) || !(it->second.next == t.second.next))
+        {
+            it->second.prev = t.second.prev;
+            it->second.next = t.second.next;
+            diff.relinked++;
+        }
+        else
+            continue;
+        touched.push_back(t.first);
+    }
+
+    bool size_crossed = (tracks.size() > 2) != (tracks.size() - diff.added + diff.removed > 2);
+    first_cell = target.first_cell;
+    if (lastCell(last))
+        touched.push_back(last);
+    if (size_crossed)
+    {
+        /* Curves need at least three cells : at most 3 cells to update */
+        for (const auto &t : tracks)
+            touched.push_back(t.first);
+    }
+    for (const auto &cell : touched)
+    {
+        if (!tracks.count(cell))
+            continue;
+        updateLink(cell);
+        updateKind(cell);
+        relocateScenery(cell, diff.cells);
+        diff.cells.push_back(cell);
+    }
+
+    if (!(station == target.station))
+    {
+        diff.cells.push_back(station);
+        station = target.station;
+        relocateScenery(station, diff.cells);
+        diff.origin_changed = true;
+    }
+    if (!(stations == target.stations) || !(branches == target.branches))
+    {
+        /* Stations and branch links found on one side only */
+        for (const auto &cell : stations)
+        {
+            if (!target.station_cells.count(cell))
+                diff.cells.push_back(cell);
+        }
+        for (const auto &cell : target.stations)
+        {
+            if (!station_cells.count(cell))
+                diff.cells.push_back(cell);
+        }
+        for (const auto &link : branch_links)
+        {
+            auto it = target.branch_links.find(link.first);
+            if (it == target.branch_links.end() || it->second != link.second)
+                diff.cells.push_back(link.first);
+        }
+        for (const auto &link : target.branch_links)
+        {
+            if (!branch_links.count(link.first))
+                diff.cells.push_back(link.first);
+        }
+        stations = target.stations;
+        station_cells = target.station_cells;
+        branches = target.branches;
+        branch_cells = target.branch_cells;
+        branch_links = target.branch_links;
+        for (const auto &cell : branch_cells)
+            relocateScenery(cell, diff.cells);
+        for (const auto &cell : stations)
+            relocateScenery(cell, diff.cells);
+        diff.network_changed = true;
+    }
+    /* Every other cell is grass in both layouts : the cost follows the terrain maps of the files,
+       not the size of the grid */
+    for (const auto &t : terrain)
+    {
+        if (target.terrainAt(t.first) != t.second)
+            diff.terrain_changed.push_back(t.first);
+    }
+    for (const auto &t : target.terrain)
+    {
+        if (terrainAt(t.first) == TerrainKind::Grass)
+            diff.terrain_changed.push_back(t.first);
+    }
+    terrain = target.terrain;
+    return diff;
+}
+
+bool Layout::lastCell(Vector2D &cell) const
+{
+    if (tracks.empty())
+        return false;
+    cell = tracks.at(first_cell).prev;
+    return true;
+}
+
+/* ---EDITING--- */
+
+bool Layout::insertTrack(const Vector2D &cell, const Vector2D &after, std::vector<Vector2D> &changed)
+{
+    if (!inGrid(cell) || isTrack(cell) || isStation(cell))
+        return false;
+
+    if (tracks.empty())
+    {
+        first_cell = cell;
+        tracks[cell] = TrackCell{cell, cell, PieceKind::Straight};
+    }
+    else
+    {
+        auto it = tracks.find(after);
+        if (it == tracks.end())
+            return false;
+        Vector2D next = it->second.next;
+        it->second.next = cell;
+        tracks[next].prev = cell;
+        tracks[cell] = TrackCell{after, next, PieceKind::Straight};
+        updateLink(after);
+        updateKind(after);
+        updateKind(next);
+        changed.push_back(after);
+        changed.push_back(next);
+    }
+    updateLink(cell);
+    updateKind(cell);
+    relocateScenery(cell, changed);
+    changed.push_back(cell);
+    return true;
+}
+
+bool Layout::removeTrack(const Vector2D &cell, std::vector<Vector2D> &changed)
+{
+    auto it = tracks.find(cell);
+    if (it == tracks.end())
+        return false;
+    changed.push_back(cell);
+
+    Vector2D prev = it->second.prev;
+    Vector2D next = it->second.next;
+    tracks.erase(it);
+    broken_links.erase(cell);
+    if (tracks.empty())
+        return true;
+
+    tracks[prev].next = next;
+    tracks[next].prev = prev;
+    if (cell == first_cell)
+        first_cell = next;
+    updateLink(prev);
+    updateKind(prev);
+    updateKind(next);
+    changed.push_back(prev);
+    changed.push_back(next);
+    return true;
+}
+
+bool Layout::moveTrack(const Vector2D &from, const Vector2D &to, std::vector<Vector2D> &changed)
+{
+    auto it = tracks.find(from);
+    if (it == tracks.end() || !inGrid(to) || isTrack(to) || isStation(to))
+        return false;
+
+    TrackCell moved = it->second;
+    tracks.erase(it);
+    broken_links.erase(from);
+    if (moved.prev == from)
+    {
+        /* Only cell of the path */
+        moved.prev = to;
+        moved.next = to;
+    }
+    tracks[to] = moved;
+    tracks[moved.prev].next = to;
+    tracks[moved.next].prev = to;
+    if (from == first_cell)
+        first_cell = to;
+
+    updateLink(moved.prev);
+    updateLink(to);
+    updateKind(moved.prev);
+    updateKind(to);
+    updateKind(moved.next);
+    relocateScenery(to, changed);
+    changed.push_back(from);
+    changed.push_back(to);
+    changed.push_back(moved.prev);
+    changed.push_back(moved.next);
+    return true;
+}
+
+bool Layout::setTerrain(const Vector2D &cell, TerrainKind kind)
+{
+    if (!inGrid(cell) || kind == TerrainKind::Count)
+        return false;
+    if (kind == TerrainKind::Grass)
+        terrain.erase(cell);
+    else
+        terrain[cell] = kind;
+    return true;
+}
+
+/* ---QUERIES--- */
+
+const TrackCell *Layout::track(const Vector2D &cell) const
+{
+    auto it = tracks.find(cell);
+    return it == tracks.end() ? NULL : &it->second;
+}
+
+TerrainKind Layout::terrainAt(const Vector2D &cell) const
+{
+    auto it = terrain.find(cell);
+    return it == terrain.end() ? TerrainKind::Grass : it->second;
+}
+
+bool Layout::inGrid(const Vector2D &cell) const
+{
+    return cell.x >= 0 && cell.y >= 0 && cell.x < size_grid && cell.y < size_grid;
+}
+
+bool Layout::isFree(const Vector2D &cell) const
+{
+    return !(cell == station) && !station_cells.count(cell) && !tracks.count(cell) && !branch_cells.count(cell) &&
+           !scenery.count(cell);
+}
+
+uint8_t Layout::links(const Vector2D &cell) const
+{
+    uint8_t sides = 0;
+    /* A broken link or a ring closed by a jump joins nothing */
+    const TrackCell *t = track(cell);
+    if (t && cell.isNeighbor(t->next))
+        sides |= sideBit(cell, t->next);
+    if (t && cell.isNeighbor(t->prev))
+        sides |= sideBit(cell, t->prev);
+    auto it = branch_links.find(cell);
+    if (it != branch_links.end())
+        sides |= it->second;
+    return sides;
+}
+
+void Layout::updateLink(const Vector2D &cell)
+{
+    const TrackCell &t = tracks.at(cell);
+    /* The link from the last cell to the first one closes the ring and may be a jump */
+    if (t.next == first_cell || cell.isNeighbor(t.next))
+        broken_links.erase(cell);
+    else
+        broken_links.insert(cell);
+}
+
+void Layout::updateKind(const Vector2D &cell)
+{
+    TrackCell &t = tracks.at(cell);
+    bool curve = tracks.size() > 2 && cell.isNeighbor(t.prev) && cell.isNeighbor(t.next) && isCorner(t.prev, cell, t.next);
+    t.kind = curve ? PieceKind::Curve : PieceKind::Straight;
+}
+
+void Layout::relocateScenery(const Vector2D &cell, std::vector<Vector2D> &changed)
+{
+    auto it = scenery.find(cell);
+    if (it == scenery.end())
+        return;
+    SceneryKind kind = it->second;
+    scenery.erase(it);
+
+    changed.push_back(cell);
+    Vector2D candidate;
+    if (randomFreeCell(candidate))
+    {
+        scenery[candidate] = kind;
+        changed.push_back(candidate);
+    }
+}
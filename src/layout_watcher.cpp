@@ -0,0 +1,140 @@
+#include "layout_watcher.hpp"
+#include "metrics.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/* Time waited for the stop flag between two checks of the file events */
+static const int WATCH_TIMEOUT_MS = 200;
+/* Editors often write a file in several steps : wait for the last one */
+static const std::chrono::milliseconds SETTLE_DELAY{50};
+
+LayoutWatcher::LayoutWatcher(const std::string &path) : file_path{path}
+{
+    auto slash = path.find_last_of('/');
+    directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    file_name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        std::cerr << "WARNING: Cannot watch " << path << ", hot reload disabled" << std::endl;
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+        inotify_fd = -1;
+        return;
+    }
+    running = true;
+    worker = std::thread(&LayoutWatcher::run, this);
+#else
+    std::cerr << "WARNING: Hot reload is only available on Linux" << std::endl;
+#endif
+}
+
+LayoutWatcher::~LayoutWatcher()
+{
+    running = false;
+    if (worker.joinable())
+        worker.join();
+#ifdef __linux__
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+#endif
+}
+
+bool LayoutWatcher::poll(Layout &layout, nlohmann::json &data)
+{
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    if (!has_pending)
+        return false;
+    layout = std::move(pending_layout);
+    data = std::move(pending_data);
+    has_pending = false;
+    return true;
+}
+
+void LayoutWatcher::run()
+{
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+    while (running)
+    {
+        struct pollfd pfd{inotify_fd, POLLIN, 0};
+        if (::poll(&pfd, 1, WATCH_TIMEOUT_MS) <= 0)
+            continue;
+
+        bool changed = false;
+        ssize_t len;
+        while ((len = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *p = buffer; p < buffer + len;)
+            {
+                auto *event = reinterpret_cast<struct inotify_event *>(p);
+                if (event->len > 0 && file_name == event->name)
+                    changed = true;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (!changed)
+            continue;
+
+        std::this_thread::sleep_for(SETTLE_DELAY);
+        /* Drop the events of the same save */
+        while (read(inotify_fd, buffer, sizeof(buffer)) > 0)
+            ;
+        parse();
+    }
+#endif
+}
+
+void LayoutWatcher::parse()
+{
+    static Histogram &parseTime = metrics.histogram("the_train_layout_parse_seconds",
+                                                    "Time to read, parse and check an edited layout", LOAD_TIME_BUCKETS);
+    static Counter &rejected = metrics.counter("the_train_layout_rejected_total",
+                                               "Edited layouts that could not be read or failed the checks");
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream file(file_path);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open " << file_path << std::endl;
+        rejected.add();
+        return;
+    }
+
+    nlohmann::json data;
+    try
+    {
+        file >> data;
+    }
+    catch (const nlohmann::json::parse_error &e)
+    {
+        std::cerr << "ERROR: " << file_path << " is not valid json, keeping the current layout" << std::endl
+                  << e.what() << std::endl;
+        rejected.add();
+        return;
+    }
+
+    Layout layout;
+    if (!layout.load(data))
+    {
+        std::cerr << "Keeping the current layout" << std::endl;
+        rejected.add();
+        return;
+    }
+    parseTime.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    pending_layout = std::move(layout);
+    pending_data = std::move(data);
+    has_pending = true;
+}
@@ -6,11 +6,24 @@
 #include "glbasimac/glbi_texture.hpp"
 #include "nlohmann/json.hpp"
 #include "draw_scene.hpp"
-#include "vector2d.hpp"
-
+#include "layout_watcher.hpp"
+#include "input_log.hpp"
+#include "dynamic_resolution.hpp"
+#include "frame_capture.hpp"
+#include "hud.hpp"
+#include "metrics.hpp"
+#include "random.hpp"
+#include "simulation.hpp"
+#include "validate.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
-#include <unordered_set>
+#include <string>
+#include <vector>
 
 using namespace glbasimac;
 using namespace STP3D;
@@ -32,6 +45,37 @@ double lastX = 0.0f, lastY = 0.0f; /* Last mouse position */
 
 static const float CAMERA_SPEED = 2.0f;
 
+/* Light benchmark : number of frames averaged for each report */
+static const int BENCHMARK_FRAMES = 100;
+
+/* Render statistics : time between two refreshes of the HUD, and between two --stats lines */
+static const double HUD_REFRESH_SECONDS = 0.5;
+static const double STATS_PERIOD_SECONDS = 1.0;
+/* Default time between two exports of the metrics */
+static const double METRICS_PERIOD_SECONDS = 5.0;
+/* Dynamic resolution : default smallest fraction of the window size rendered */
+static const float MIN_RENDER_SCALE = 0.5f;
+/* Particles simulated on the GPU : default cloud puffs, and smoke of the chimney */
+static const int CLOUD_PUFFS = 20000;
+static const int SMOKE_PARTICLES = 4096;
+static bool showHud = false;
+
+/* Picking : the cursor moves the camera, unless C frees it to click on objects */
+static bool cursorFree = false;
+static bool pickRequested = false;
+
+/* Edits of the track at the pick point, applied after the frame like a pick */
+enum class TrackEdit
+{
+    None,
+    Insert, /* On the ground, after a track of the path next to it */
+    Remove,
+    Move /* Take the track, then put it down at the next Move */
+};
+static TrackEdit editRequested = TrackEdit::None;
+static bool trackTaken = false;
+static Vector2D takenTrack{0, 0};
+
 void onError(int error, const char *description)
 {
     std::cout << "GLFW Error (" << error << ") : " << description << std::endl;
@@ -78,6 +122,37 @@ void onKey(GLFWwindow *window, int key, int /*scancode*/, int action, int /*mods
             animate = !animate;
             break;
 
+        /* Free/Capture the cursor */
+        case GLFW_KEY_C:
+            if (action == GLFW_PRESS)
+            {
+                cursorFree = !cursorFree;
+                glfwSetInputMode(window, GLFW_CURSOR, cursorFree ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+                /* No jump of the camera when the cursor is captured again */
+                glfwGetCursorPos(window, &lastX, &lastY);
+            }
+            break;
+
+        /* Edit the track */
+        case GLFW_KEY_I:
+            if (action == GLFW_PRESS)
+                editRequested = TrackEdit::Insert;
+            break;
+        case GLFW_KEY_X:
+            if (action == GLFW_PRESS)
+                editRequested = TrackEdit::Remove;
+            break;
+        case GLFW_KEY_M:
+            if (action == GLFW_PRESS)
+                editRequested = TrackEdit::Move;
+            break;
+
+        /* Show/Hide the render statistics */
+        case GLFW_KEY_H:
+            if (action == GLFW_PRESS)
+                showHud = !showHud;
+            break;
+
         /* Quitter */
         case GLFW_KEY_ESCAPE:
             glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -86,86 +161,162 @@ void onKey(GLFWwindow *window, int key, int /*scancode*/, int action, int /*mods
     }
 }
 
-void usage()
+void onMouseButton(GLFWwindow * /*window*/, int button, int action, int /*mods*/)
 {
-    std::cerr << "Usage: " << "./the_train filename.json" << std::endl;
+    /* Picked after the next frame is rendered, with its matrices */
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        pickRequested = true;
 }
 
-bool validSizeGridFormat(const nlohmann::json &data)
+/* Command line options */
+struct Options
 {
-    return data.contains("size_grid") && data["size_grid"].is_number_integer();
-}
+    std::string layout_file;
+    int lights = 0;
+    bool has_seed = false;
+    uint32_t seed = 0;
+    std::string record_file;
+    std::string replay_file;
+    std::string capture_png;
+    std::string capture_y4m;
+    bool hud = false;
+    bool stats = false;
+    std::string metrics_socket;
+    std::string metrics_file;
+    double metrics_period = METRICS_PERIOD_SECONDS;
+    std::vector<ViewCamera> views;
+    double target_ms = 0.0;
+    float min_scale = MIN_RENDER_SCALE;
+    int particles = CLOUD_PUFFS;
+};
 
-bool validOriginFormat(const nlohmann::json &data)
+void usage()
 {
-    return data.contains("origin") && data["origin"].is_array() && data["origin"].size() == 2 && data["origin"][0].is_number_integer() && data["origin"][1].is_number_integer();
+    std::cerr << "Usage: " << "./the_train filename.json [options]" << std::endl
+              << "  --lights N     benchmark N clustered point lights (frame time printed every "
+              << BENCHMARK_FRAMES << " frames)" << std::endl
+              << "  --seed N       seed of the random scenery and clouds" << std::endl
+              << "  --record FILE  save the camera of every frame (and the seed) in FILE" << std::endl
+              << "  --replay FILE  replay a recorded run as fast as possible, then quit" << std::endl
+              << "  --capture-png PREFIX  save every frame as PREFIX000000.png, PREFIX000001.png, ..." << std::endl
+              << "  --capture-y4m FILE    record the session as a raw Y4M video" << std::endl
+              << "  --views LIST   split the window between cameras, e.g. free,overview,station,chase" << std::endl
+              << "  --target-ms MS lower the rendering resolution to keep the GPU time of a frame under MS" << std::endl
+              << "  --min-scale S  smallest fraction of the window size rendered with --target-ms (default "
+              << MIN_RENDER_SCALE << ")" << std::endl
+              << "  --particles N  cloud puffs simulated on the GPU (default " << CLOUD_PUFFS << ")" << std::endl
+              << "  --hud          show the render statistics of each frame (toggled with H)" << std::endl
+              << "  --stats        print the render statistics every " << STATS_PERIOD_SECONDS << " s" << std::endl
+              << "  --metrics-socket PATH  send the runtime metrics as JSON lines to the clients of a Unix socket" << std::endl
+              << "  --metrics-file PATH    keep the runtime metrics in PATH, in the Prometheus text format" << std::endl
+              << "  --metrics-period S     time between two exports of the metrics (default "
+              << METRICS_PERIOD_SECONDS << " s)" << std::endl
+              << "  In the window, a click prints what is at the center (or under the cursor, freed with C)" << std::endl
+              << "  and I, X and M edit the track there : I adds a track next to the path, X removes one," << std::endl
+              << "  M takes one and M again puts it down" << std::endl
+              << "       ./the_train --validate-only [--threads N] file.json|directory..." << std::endl
+              << "  check the layout files in parallel, without opening a window" << std::endl
+              << "       ./the_train --simulate filename.json [options]" << std::endl
+              << "  simulate trains on the layout, without opening a window (--simulate alone for the options)" << std::endl;
 }
 
-bool validPathFormat(const nlohmann::json &data)
+int validateOnly(int argc, char **argv)
 {
-    if (!data.contains("path") || !data["path"].is_array())
-        return false;
-    for (const auto &e : data["path"])
+    std::vector<std::string> paths{};
+    unsigned int nb_threads = 0;
+    for (int i = 2; i < argc; i++)
     {
-        if (!e.is_array() || e.size() != 2 || !e[0].is_number_integer() || !e[1].is_number_integer())
-            return false;
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            nb_threads = std::atoi(argv[++i]);
+        else
+            paths.push_back(arg);
     }
-    return true;
-}
-
-bool checkDataFormat(const nlohmann::json &data)
-{
-    if (!validSizeGridFormat(data) || !validOriginFormat(data) || !validPathFormat(data))
+    if (paths.empty())
     {
-        std::cerr << "ERROR: Invalid json file" << std::endl
-                  << "size_grid: int" << std::endl
-                  << "origin: [int, int]" << std::endl
-                  << "path: [[int, int], ...]" << std::endl;
-        return false;
+        usage();
+        return 1;
     }
-    return true;
+    return validateLayouts(paths, nb_threads);
 }
 
-bool checkGridSize(const nlohmann::json &data)
+bool parseOptions(int argc, char **argv, Options &options)
 {
-    if (data["size_grid"].get<int>() < 10)
-    {
-        std::cerr << "ERROR: Grid size must be at least 10" << std::endl;
+    if (argc < 2)
         return false;
-    }
-    return true;
-}
-
-bool checkPath(const nlohmann::json &data)
-{
-    std::unordered_set<Vector2D, Vector2DHash> set;
-    Vector2D prev;
-
-    for (size_t i = 0; i < data["path"].size(); ++i)
+    options.layout_file = argv[1];
+    for (int i = 2; i < argc; i++)
     {
-        const auto &e = data["path"][i];
-        Vector2D current{e[0].get<int>(), e[1].get<int>()};
-
-        if (set.count(current))
+        std::string arg = argv[i];
+        if (arg == "--hud")
         {
-            std::cerr << "ERROR: The path contains a duplicate (" << current.x << ", " << current.y << ")" << std::endl;
-            return false;
+            options.hud = true;
+            continue;
         }
-        set.insert(current);
-
-        if (i > 0 && current.manhattanDistance(prev) != 1)
+        if (arg == "--stats")
         {
-            std::cerr << "ERROR: The current rail must be adjacent to the previous rail" << std::endl;
+            options.stats = true;
+            continue;
+        }
+        if (i + 1 >= argc)
             return false;
+        if (arg == "--lights")
+        {
+            options.lights = std::atoi(argv[++i]);
+            if (options.lights <= 0)
+                return false;
+        }
+        else if (arg == "--seed")
+        {
+            options.has_seed = true;
+            options.seed = std::strtoul(argv[++i], NULL, 10);
+        }
+        else if (arg == "--record")
+            options.record_file = argv[++i];
+        else if (arg == "--replay")
+            options.replay_file = argv[++i];
+        else if (arg == "--capture-png")
+            options.capture_png = argv[++i];
+        else if (arg == "--capture-y4m")
+            options.capture_y4m = argv[++i];
+        else if (arg == "--views")
+        {
+            if (!parseViewCameras(argv[++i], options.views))
+                return false;
+        }
+        else if (arg == "--particles")
+        {
+            options.particles = std::atoi(argv[++i]);
+            if (options.particles < 0)
+                return false;
+        }
+        else if (arg == "--target-ms")
+        {
+            options.target_ms = std::atof(argv[++i]);
+            if (options.target_ms <= 0.0)
+                return false;
+        }
+        else if (arg == "--min-scale")
+        {
+            options.min_scale = std::atof(argv[++i]);
+            if (options.min_scale <= 0.0f || options.min_scale > 1.0f)
+                return false;
+        }
+        else if (arg == "--metrics-socket")
+            options.metrics_socket = argv[++i];
+        else if (arg == "--metrics-file")
+            options.metrics_file = argv[++i];
+        else if (arg == "--metrics-period")
+        {
+            options.metrics_period = std::atof(argv[++i]);
+            if (options.metrics_period <= 0.0)
+                return false;
         }
-        prev = current;
+        else
+            return false;
     }
-    return true;
-}
-
-bool checkData(const nlohmann::json &data)
-{
-    return checkDataFormat(data) && checkGridSize(data) && checkPath(data);
+    return (options.record_file.empty() || options.replay_file.empty()) &&
+           (options.capture_png.empty() || options.capture_y4m.empty());
 }
 
 void updateYawPitch(GLFWwindow *window)
@@ -192,24 +343,70 @@ void updateYawPitch(GLFWwindow *window)
 
 int main(int argc, char **argv)
 {
-    if (argc != 2)
+    if (argc >= 2 && std::string(argv[1]) == "--validate-only")
+        return validateOnly(argc, argv);
+    if (argc >= 2 && std::string(argv[1]) == "--simulate")
+        return simulateLayout(argc, argv);
+
+    Options options;
+    if (!parseOptions(argc, argv, options))
     {
         usage();
         return 1;
     }
+    const int nbBenchmarkLights = options.lights;
+
+    /* A replay uses the seed of the recorded run */
+    InputRecorder recorder;
+    InputReplayer replayer;
+    const bool recording = !options.record_file.empty();
+    const bool replaying = !options.replay_file.empty();
+    if (replaying)
+    {
+        if (!replayer.open(options.replay_file))
+            return 1;
+        seedRandom(replayer.seed());
+    }
+    else if (options.has_seed)
+        seedRandom(options.seed);
+    std::cout << "Seed: " << randomSeed() << std::endl;
+    if (recording && !recorder.open(options.record_file, randomSeed()))
+        return 1;
+
+    /* Metrics are always counted; the exporter thread only runs if they are published */
+    MetricsExporter exporter(options.metrics_socket, options.metrics_file, options.metrics_period);
+    Gauge &loadMetric = metrics.gauge("the_train_scene_load_seconds", "Time to load the layout, the meshes and the textures");
+    Counter &reloadsMetric = metrics.counter("the_train_layout_reloads_total", "Layout edits applied without restarting");
+    Histogram &reloadTimeMetric = metrics.histogram("the_train_layout_reload_seconds", "Time to apply an edited layout to the scene",
+                                                    LOAD_TIME_BUCKETS);
+    Counter &framesMetric = metrics.counter("the_train_frames_total", "Frames rendered");
+    Histogram &frameTimeMetric = metrics.histogram("the_train_frame_seconds", "Time between the start of two frames",
+                                                   FRAME_TIME_BUCKETS);
+    Gauge &fpsMetric = metrics.gauge("the_train_frames_per_second", "Frame rate, averaged over the last frames");
+    Counter &drawCallsMetric = metrics.counter("the_train_draw_calls_total", "Draw calls issued by the render queue");
+    Counter &itemsMetric = metrics.counter("the_train_draw_items_total", "Items submitted to the render queue");
+    Histogram &pickTimeMetric = metrics.histogram("the_train_pick_seconds", "Time to find the object under the cursor",
+                                                  LOAD_TIME_BUCKETS);
+    Histogram &editTimeMetric = metrics.histogram("the_train_track_edit_seconds", "Time to apply an edit of the track to the scene",
+                                                  LOAD_TIME_BUCKETS);
+    Counter &fenceWaitsMetric = metrics.counter("the_train_fence_waits_total",
+                                                "Times the CPU waited for the GPU to release instance memory");
+    Gauge &renderScaleMetric = metrics.gauge("the_train_render_scale", "Fraction of the window size rendered (dynamic resolution)");
+    Gauge &gpuTimeMetric = metrics.gauge("the_train_gpu_frame_seconds", "GPU time of the scene, averaged over the last frames");
+    const auto loadStart = std::chrono::steady_clock::now();
 
     /* Open the file in read mode */
-    std::ifstream file(argv[1]);
+    std::ifstream file(options.layout_file);
     if (!file)
     {
-        std::cerr << "ERROR: Cannot open " << argv[1] << std::endl;
+        std::cerr << "ERROR: Cannot open " << options.layout_file << std::endl;
         return 1;
     }
 
     /* Load the json file */
     nlohmann::json data;
     file >> data;
-    if (!checkData(data))
+    if (!layout.load(data))
         return 1;
 
     /* GLFW initialisation */
@@ -245,44 +442,289 @@ int main(int argc, char **argv)
 
     glfwSetWindowSizeCallback(window, onWindowResized);
     glfwSetKeyCallback(window, onKey);
+    glfwSetMouseButtonCallback(window, onMouseButton);
 
     std::cout << "Engine init" << std::endl;
     myEngine.mode2D = false; // Set engine to 3D mode
-    myEngine.initGL();
+    myEngine.initGL((GLADloadproc)glfwGetProcAddress);
     onWindowResized(window, WINDOW_WIDTH, WINDOW_HEIGHT);
     CHECK_GL;
 
     initScene(data);
-    if (!initGrassTexture())
+    if (!initMaterials())
+    {
+        freeScene();
+        glfwTerminate();
+        return 1;
+    }
+    if (!initParticles(options.particles, SMOKE_PARTICLES))
+    {
+        freeScene();
+        glfwTerminate();
+        return 1;
+    }
+    if (nbBenchmarkLights > 0)
+        initBenchmarkLights(data, nbBenchmarkLights);
+    loadMetric.set(std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count());
+    /* Frames are read back asynchronously and written by a background thread */
+    FrameCapture capture;
+    if (!options.capture_png.empty() || !options.capture_y4m.empty())
+    {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        bool png = !options.capture_png.empty();
+        if (!capture.open(png ? CaptureFormat::Png : CaptureFormat::Y4m, png ? options.capture_png : options.capture_y4m,
+                          width, height, int(1.0 / FRAMERATE_IN_SECONDS + 0.5)))
+        {
+            freeScene();
+            glfwTerminate();
+            return 1;
+        }
+    }
+
+    /* The scene is rendered offscreen at a scale that holds the GPU time budget */
+    DynamicResolution resolution;
+    if (options.target_ms > 0.0 && !resolution.init(options.target_ms, options.min_scale))
+    {
+        freeScene();
+        glfwTerminate();
+        return 1;
+    }
+
+    Hud hud;
+    showHud = options.hud;
+    if (!hud.init())
     {
+        freeScene();
         glfwTerminate();
         return 1;
     }
+    /* Counters of the last frame, shown and printed as they are at each refresh */
+    double hudRefreshTime = 0.0;
+    double statsPrintTime = glfwGetTime();
+    double lastFrameStart = glfwGetTime();
+    double frameMs = 0.0;
+
+    double benchmarkTime = 0.0;
+    int benchmarkFrames = 0;
+    double replayStartTime = glfwGetTime();
+    int replayFrames = 0;
+    unsigned int replayFenceWaits = 0;
+
+    /* Edits of the layout file are applied without restarting */
+    LayoutWatcher watcher(options.layout_file);
+    Layout reloaded;
 
     /* Loop until the user closes the window */
     while (!glfwWindowShouldClose(window))
     {
         /* Get time (in second) at loop beginning */
         double startTime = glfwGetTime();
+        frameMs = 0.9 * frameMs + 0.1 * 1000.0 * (startTime - lastFrameStart);
+        frameTimeMetric.observe(startTime - lastFrameStart);
+        fpsMetric.set(1000.0 / std::max(frameMs, 1e-3));
+        lastFrameStart = startTime;
+        glbiStats.reset();
+
+        /* Swap in the reloaded layout between two frames */
+        if (watcher.poll(reloaded, data))
+        {
+            reloadScene(reloaded, data);
+            reloadsMetric.add();
+            reloadTimeMetric.observe(glfwGetTime() - startTime);
+        }
 
-        /* Render here */
+        /* Render here, offscreen if the resolution is dynamic */
+        int renderWidth, renderHeight;
+        {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            resolution.begin(width, height, renderWidth, renderHeight);
+        }
         glClearColor(0.0, 0.0, 0.0, 0.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
 
         /* Fix camera position */
         myEngine.mvMatrixStack.loadIdentity();
-        updateYawPitch(window);
+        if (!cursorFree)
+            updateYawPitch(window);
+        if (replaying)
+        {
+            /* The log replaces the user input */
+            FrameInput input;
+            if (!replayer.read(input))
+            {
+                double replayTime = glfwGetTime() - replayStartTime;
+                std::cout << "Replay finished: " << replayFrames << " frames, "
+                          << 1000.0 * replayTime / std::max(replayFrames, 1) << " ms/frame, "
+                          << replayFenceWaits << " fence waits" << std::endl;
+                break;
+            }
+            camera_pos = input.camera_pos;
+            yaw = input.yaw;
+            pitch = input.pitch;
+            animate = input.animate;
+            replayFrames++;
+        }
+        else if (recording)
+            recorder.write(FrameInput{camera_pos, yaw, pitch, animate});
         camera_front = Vector3D(
             cos(deg2rad(yaw)) * cos(deg2rad(pitch)),
             sin(deg2rad(yaw)) * cos(deg2rad(pitch)),
             sin(deg2rad(pitch)));
         camera_front.normalize();
-        Matrix4D view_matrix = Matrix4D::lookAt(camera_pos, camera_pos + camera_front, camera_up);
-        myEngine.setViewMatrix(view_matrix);
-        myEngine.updateMvMatrix();
+        if (options.views.empty())
+        {
+            Matrix4D view_matrix = Matrix4D::lookAt(camera_pos, camera_pos + camera_front, camera_up);
+            myEngine.setViewMatrix(view_matrix);
+            myEngine.updateLightClusters();
+            myEngine.updateFrameUniforms();
+            myEngine.updateMvMatrix();
+
+            renderScene();
+        }
+        else
+        {
+            /* Several cameras on the same scene, in viewports of the window */
+            renderViews(tileViews(options.views, renderWidth, renderHeight));
+            glViewport(0, 0, renderWidth, renderHeight);
+        }
+        /* Upscaled to the window before the HUD, which stays sharp */
+        resolution.end();
+        if (resolution.enabled())
+        {
+            renderScaleMetric.set(resolution.scale());
+            gpuTimeMetric.set(resolution.gpuMs() / 1000.0);
+        }
+        replayFenceWaits += renderStats().nb_fence_waits;
+        framesMetric.add();
+        drawCallsMetric.add(renderStats().nb_draw_calls);
+        itemsMetric.add(renderStats().nb_items);
+        fenceWaitsMetric.add(renderStats().nb_fence_waits);
+
+        if (pickRequested || editRequested != TrackEdit::None)
+        {
+            int width, height, windowWidth, windowHeight;
+            glfwGetFramebufferSize(window, &width, &height);
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+            /* Under the free cursor, else at the center of the window where the camera looks */
+            double x = width / 2.0, y = height / 2.0;
+            if (cursorFree)
+            {
+                glfwGetCursorPos(window, &x, &y);
+                x *= width / (double)std::max(windowWidth, 1);
+                y *= height / (double)std::max(windowHeight, 1);
+            }
+            double pickStart = glfwGetTime();
+            PickResult pick;
+            if (options.views.empty())
+                pick = pickAt(myEngine.projMatrix * myEngine.viewMatrix, x, y, width, height);
+            for (const SceneView &view : tileViews(options.views, width, height))
+            {
+                /* Viewports start from the bottom, the cursor from the top */
+                const double top = height - view.y - view.height;
+                if (x >= view.x && x < view.x + view.width && y >= top && y < top + view.height)
+                    pick = pickAt(viewProjection(view), x - view.x, y - top, view.width, view.height);
+            }
+            pickTimeMetric.observe(glfwGetTime() - pickStart);
+            const std::string details = pickDetails(pick);
+            if (pickRequested)
+                std::cout << "Picked " << details << std::endl;
+            pickRequested = false;
+
+            if (editRequested != TrackEdit::None)
+            {
+                const double editStart = glfwGetTime();
+                const bool onTrack = pick.kind == PickKind::Track || pick.kind == PickKind::Train;
+                /* Scenery is moved away by a track put on it */
+                const bool onGround = pick.kind == PickKind::Ground || pick.kind == PickKind::Tree || pick.kind == PickKind::Building;
+                bool done = false;
+                switch (editRequested)
+                {
+                case TrackEdit::Insert:
+                    /* The path is left open between the new track and the one that followed,
+                       until other edits join them */
+                    for (const auto &side : {Vector2D{1, 0}, Vector2D{-1, 0}, Vector2D{0, 1}, Vector2D{0, -1}})
+                    {
+                        if (!done && onGround && (layout.track(pick.cell + side) || layout.empty()))
+                            done = insertTrackInScene(pick.cell, pick.cell + side);
+                    }
+                    std::cout << (done ? "Added a track on " : "No track added on ") << details << std::endl;
+                    break;
+                case TrackEdit::Remove:
+                    done = onTrack && removeTrackFromScene(pick.cell);
+                    std::cout << (done ? "Removed the " : "No track of the path removed on ") << details << std::endl;
+                    break;
+                case TrackEdit::Move:
+                    if (!trackTaken)
+                    {
+                        trackTaken = onTrack && layout.track(pick.cell);
+                        takenTrack = pick.cell;
+                        std::cout << (trackTaken ? "Took the " : "No track of the path to take on ") << details << std::endl;
+                        break;
+                    }
+                    trackTaken = false;
+                    done = onGround && moveTrackInScene(takenTrack, pick.cell);
+                    std::cout << (done ? "Put the track down on " : "Track not moved to ") << details << std::endl;
+                    break;
+                case TrackEdit::None:
+                    break;
+                }
+                editRequested = TrackEdit::None;
+                if (done)
+                    editTimeMetric.observe(glfwGetTime() - editStart);
+            }
+        }
+
+        /* The HUD is drawn after the counters are read, so it is not counted */
+        const GLBI_Stats frameStats = glbiStats;
+        auto frameLines = [&]()
+        {
+            std::vector<std::string> lines = statsLines(frameStats, renderStats(), frameMs);
+            if (resolution.enabled())
+            {
+                char line[64];
+                std::snprintf(line, sizeof(line), "RESOLUTION %d%% (%dX%d), GPU %.2f MS", int(resolution.scale() * 100.0f + 0.5f),
+                              renderWidth, renderHeight, resolution.gpuMs());
+                lines.push_back(line);
+            }
+            return lines;
+        };
+        if (options.stats && startTime - statsPrintTime >= STATS_PERIOD_SECONDS)
+        {
+            std::vector<std::string> lines = frameLines();
+            for (size_t i = 0; i < lines.size(); i++)
+                std::cout << (i ? " | " : "") << lines[i];
+            std::cout << std::endl;
+            statsPrintTime = startTime;
+        }
+        if (showHud)
+        {
+            if (startTime - hudRefreshTime >= HUD_REFRESH_SECONDS)
+            {
+                hud.setText(frameLines());
+                hudRefreshTime = startTime;
+            }
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            hud.draw(width, height);
+        }
+        capture.capture();
 
-        renderScene(data);
+        if (nbBenchmarkLights > 0)
+        {
+            /* Wait for the GPU so that the whole frame is measured */
+            glFinish();
+            benchmarkTime += glfwGetTime() - startTime;
+            if (++benchmarkFrames == BENCHMARK_FRAMES)
+            {
+                std::cout << nbBenchmarkLights << " lights: " << 1000.0 * benchmarkTime / benchmarkFrames << " ms/frame, "
+                          << myEngine.lightClusters.nb_assignments << " light/cluster pairs" << std::endl;
+                benchmarkTime = 0.0;
+                benchmarkFrames = 0;
+            }
+        }
 
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
@@ -293,11 +735,14 @@ int main(int argc, char **argv)
         /* Elapsed time computation from loop begining */
         double elapsedTime = glfwGetTime() - startTime;
         /* If to few time is spend vs our wanted FPS, we wait */
-        if (elapsedTime < FRAMERATE_IN_SECONDS)
+        if (nbBenchmarkLights == 0 && !replaying && elapsedTime < FRAMERATE_IN_SECONDS)
             glfwWaitEventsTimeout(FRAMERATE_IN_SECONDS - elapsedTime);
     }
 
-    freeGrassTexture();
+    capture.close();
+    hud.free();
+    resolution.free();
+    freeScene();
 
     glfwTerminate();
 
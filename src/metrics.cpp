@@ -0,0 +1,303 @@
+#include "metrics.hpp"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+MetricsRegistry metrics;
+
+const std::vector<double> FRAME_TIME_BUCKETS{0.004, 0.008, 0.0125, 0.017, 0.025, 0.034, 0.05, 0.1, 0.25, 1.0};
+const std::vector<double> LOAD_TIME_BUCKETS{0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0, 10.0};
+
+/* Time waited for new clients and for the stop flag between two checks */
+static const int EXPORT_POLL_MS = 100;
+
+/* ---METRICS--- */
+
+Histogram::Histogram(const std::vector<double> &bounds)
+    : upper_bounds{bounds}, buckets{new std::atomic<uint64_t>[bounds.size() + 1]}
+{
+    for (size_t i = 0; i <= bounds.size(); i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(double v)
+{
+    /* A dozen buckets at most : a linear search is faster than a binary one */
+    size_t i = 0;
+    while (i < upper_bounds.size() && v > upper_bounds[i])
+        i++;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    nb_values.fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(uint64_t(std::max(v, 0.0) * 1e9), std::memory_order_relaxed);
+}
+
+MetricsRegistry::Entry &MetricsRegistry::entry(const std::string &name, const std::string &help, Kind kind)
+{
+    for (Entry &e : entries)
+        if (e.name == name)
+        {
+            if (e.kind != kind)
+                std::cerr << "WARNING: Metric " << name << " registered with two different types" << std::endl;
+            return e;
+        }
+    entries.emplace_back();
+    Entry &e = entries.back();
+    e.name = name;
+    e.help = help;
+    e.kind = kind;
+    return e;
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entry(name, help, Kind::Counter).counter;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entry(name, help, Kind::Gauge).gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry &e = entry(name, help, Kind::Histogram);
+    if (!e.histogram)
+        e.histogram.reset(new Histogram(bounds));
+    return *e.histogram;
+}
+
+std::string MetricsRegistry::prometheusText()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out.precision(10);
+    for (const Entry &e : entries)
+    {
+        out << "# HELP " << e.name << " " << e.help << "\n";
+        switch (e.kind)
+        {
+        case Kind::Counter:
+            out << "# TYPE " << e.name << " counter\n"
+                << e.name << " " << e.counter.value() << "\n";
+            break;
+        case Kind::Gauge:
+            out << "# TYPE " << e.name << " gauge\n"
+                << e.name << " " << e.gauge.value() << "\n";
+            break;
+        case Kind::Histogram:
+        {
+            /* Buckets are cumulative in the text format. _count must equal the +Inf bucket, so it is
+               taken from the same reads : nb_values may already count a concurrent observe() */
+            const Histogram &h = *e.histogram;
+            out << "# TYPE " << e.name << " histogram\n";
+            uint64_t cumulated = 0;
+            for (size_t i = 0; i < h.bounds().size(); i++)
+            {
+                cumulated += h.bucket(i);
+                out << e.name << "_bucket{le=\"" << h.bounds()[i] << "\"} " << cumulated << "\n";
+            }
+            cumulated += h.bucket(h.bounds().size());
+            out << e.name << "_bucket{le=\"+Inf\"} " << cumulated << "\n"
+                << e.name << "_sum " << h.sum() << "\n"
+                << e.name << "_count " << cumulated << "\n";
+            break;
+        }
+        }
+    }
+    return out.str();
+}
+
+std::string MetricsRegistry::jsonLine()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    nlohmann::json line;
+    line["time"] = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    for (const Entry &e : entries)
+    {
+        switch (e.kind)
+        {
+        case Kind::Counter:
+            line[e.name] = e.counter.value();
+            break;
+        case Kind::Gauge:
+            line[e.name] = e.gauge.value();
+            break;
+        case Kind::Histogram:
+        {
+            const Histogram &h = *e.histogram;
+            std::vector<uint64_t> counts;
+            uint64_t total = 0;
+            for (size_t i = 0; i <= h.bounds().size(); i++)
+            {
+                counts.push_back(h.bucket(i));
+                total += counts.back();
+            }
+            line[e.name] = {{"count", total}, {"sum", h.sum()}, {"le", h.bounds()}, {"buckets", counts}};
+            break;
+        }
+        }
+    }
+    return line.dump();
+}
+
+/* ---EXPORT--- */
+
+MetricsExporter::MetricsExporter(const std::string &socket, const std::string &file, double period_s)
+    : socket_path{socket}, file_path{file}, period{period_s}
+{
+    if (!socket_path.empty())
+    {
+#ifdef __linux__
+        struct sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path))
+            std::cerr << "WARNING: Metrics socket path too long: " << socket_path << std::endl;
+        else
+        {
+            socket_path.copy(address.sun_path, socket_path.size());
+            /* A socket left by a previous run would make bind fail */
+            unlink(socket_path.c_str());
+            listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+                listen(listen_fd, 8) < 0)
+            {
+                std::cerr << "WARNING: Cannot listen on " << socket_path << ", metrics socket disabled" << std::endl;
+                if (listen_fd >= 0)
+                    close(listen_fd);
+                listen_fd = -1;
+            }
+        }
+#else
+        std::cerr << "WARNING: The metrics socket is only available on Linux" << std::endl;
+#endif
+    }
+    if (listen_fd < 0 && file_path.empty())
+        return;
+    running = true;
+    worker = std::thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    running = false;
+    if (worker.joinable())
+        worker.join();
+    /* Last values, so that a short run is exported too */
+    if (!file_path.empty())
+        writeFile(metrics.prometheusText());
+#ifdef __linux__
+    for (int fd : clients)
+        close(fd);
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+#endif
+}
+
+/* Resident memory of the process in bytes, 0 if unknown */
+static double residentBytes()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    unsigned long size = 0, resident = 0;
+    if (statm >> size >> resident)
+        return double(resident) * sysconf(_SC_PAGESIZE);
+#endif
+    return 0.0;
+}
+
+void MetricsExporter::run()
+{
+    Gauge &resident = metrics.gauge("the_train_resident_memory_bytes", "Resident memory of the process");
+    auto next_export = std::chrono::steady_clock::now();
+    while (running)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_export)
+        {
+            resident.set(residentBytes());
+            if (!clients.empty())
+                sendLine(metrics.jsonLine() + "\n");
+            if (!file_path.empty())
+                writeFile(metrics.prometheusText());
+            next_export = now + std::chrono::microseconds(int64_t(period * 1e6));
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_export - now).count();
+        int timeout = int(std::max<int64_t>(0, std::min<int64_t>(wait, EXPORT_POLL_MS)));
+#ifdef __linux__
+        if (listen_fd >= 0)
+        {
+            struct pollfd pfd{listen_fd, POLLIN, 0};
+            if (::poll(&pfd, 1, timeout) > 0)
+                acceptClients();
+            continue;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+    }
+}
+
+void MetricsExporter::acceptClients()
+{
+#ifdef __linux__
+    int fd;
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        clients.push_back(fd);
+#endif
+}
+
+void MetricsExporter::sendLine(const std::string &line)
+{
+#ifdef __linux__
+    for (size_t i = 0; i < clients.size();)
+    {
+        ssize_t sent = send(clients[i], line.data(), line.size(), MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            sent = 0; /* Client not reading : this line is dropped for it */
+        if (sent < 0 || (sent > 0 && size_t(sent) < line.size()))
+        {
+            /* Disconnected, or a cut line that would break the next ones */
+            close(clients[i]);
+            clients[i] = clients.back();
+            clients.pop_back();
+        }
+        else
+            i++;
+    }
+#else
+    (void)line;
+#endif
+}
+
+void MetricsExporter::writeFile(const std::string &text)
+{
+    std::string tmp_path = file_path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!(file << text))
+        {
+            std::cerr << "ERROR: Cannot write " << tmp_path << std::endl;
+            return;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), file_path.c_str()) != 0)
+        std::cerr << "ERROR: Cannot replace " << file_path << std::endl;
+}
@@ -0,0 +1,213 @@
+#include "particles.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "random.hpp"
+#include "tools/shaders.hpp"
+
+/* Sky area per cloud : more puffs make denser clouds, not more of them */
+static const float CLOUD_AREA = 2500.0f;
+/* Room around the grid where clouds leave and come back, wider than a cloud */
+static const float CLOUD_MARGIN = 40.0f;
+/* Cloud bases, and half sizes of a cloud */
+static const float CLOUD_MIN_HEIGHT = 32.0f, CLOUD_MAX_HEIGHT = 40.0f;
+static const float CLOUD_MIN_RADIUS = 8.0f, CLOUD_MAX_RADIUS = 25.0f;
+static const float CLOUD_THICKNESS = 4.0f;
+/* Drift of the clouds, along x, in units per second */
+static const float CLOUD_MIN_SPEED = 3.0f, CLOUD_MAX_SPEED = 12.0f;
+static const float PUFF_MIN_RADIUS = 2.0f, PUFF_MAX_RADIUS = 4.5f;
+/* Time a smoke particle lives, in seconds */
+static const float SMOKE_MIN_LIFE = 2.5f, SMOKE_MAX_LIFE = 4.0f;
+
+/* Floats of one particle : position and age, velocity and lifetime */
+static const int PARTICLE_FLOATS = 8;
+
+bool ParticleSystem::init(int puffs, int smoke)
+{
+    nb_puffs = std::max(puffs, 0);
+    nb_smoke = std::max(smoke, 0);
+
+    /* The update program has no fragment stage : its outputs are captured in the other buffer */
+    update_program = glCreateProgram();
+    const char *varyings[] = {"out_position_age", "out_velocity_life"};
+    bool compiled = ShaderManager::compileShader("../assets/shaders/particles_update.vert", Vertex, update_program, true);
+    if (compiled)
+        glTransformFeedbackVaryings(update_program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+    if (!compiled || !ShaderManager::linkProgram(update_program, true))
+    {
+        std::cerr << "ERROR: Cannot load the particle update shader" << std::endl;
+        free();
+        return false;
+    }
+    draw_program = ShaderManager::loadShader("../assets/shaders/particles.vert", "../assets/shaders/particles.frag", true);
+    if (!draw_program)
+    {
+        std::cerr << "ERROR: Cannot load the particle shaders" << std::endl;
+        free();
+        return false;
+    }
+
+    glGenBuffers(2, buffers);
+    glGenVertexArrays(2, update_vaos);
+    glGenVertexArrays(2, draw_vaos);
+    glGenTransformFeedbacks(1, &feedback);
+    const GLsizei stride = PARTICLE_FLOATS * sizeof(float);
+    for (int b = 0; b < 2; b++)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[b]);
+        glBufferData(GL_ARRAY_BUFFER, size_t(count()) * stride, NULL, GL_DYNAMIC_COPY);
+        /* Update : one vertex per particle. Draw : one instance per particle, 4 corners each */
+        for (int divisor = 0; divisor < 2; divisor++)
+        {
+            glBindVertexArray(divisor ? draw_vaos[b] : update_vaos[b]);
+            for (GLuint attribute = 0; attribute < 2; attribute++)
+            {
+                glEnableVertexAttribArray(attribute);
+                glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, stride, (void *)(attribute * 4 * sizeof(float)));
+                glVertexAttribDivisor(attribute, divisor);
+            }
+        }
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    current = 0;
+    return true;
+}
+
+void ParticleSystem::free()
+{
+    if (update_program)
+        glDeleteProgram(update_program);
+    if (draw_program)
+        glDeleteProgram(draw_program);
+    if (buffers[0])
+        glDeleteBuffers(2, buffers);
+    if (update_vaos[0])
+        glDeleteVertexArrays(2, update_vaos);
+    if (draw_vaos[0])
+        glDeleteVertexArrays(2, draw_vaos);
+    if (feedback)
+        glDeleteTransformFeedbacks(1, &feedback);
+    update_program = draw_program = feedback = 0;
+    buffers[0] = buffers[1] = 0;
+    update_vaos[0] = update_vaos[1] = draw_vaos[0] = draw_vaos[1] = 0;
+}
+
+void ParticleSystem::spawn(float grid_extent)
+{
+    extent = grid_extent;
+    seed = uint32_t(randomInt(0, 0x7fffffff));
+    step = 0;
+    if (!enabled())
+        return;
+
+    std::vector<float> particles(size_t(count()) * PARTICLE_FLOATS);
+    float *p = particles.data();
+    /* Puffs of a cloud : in a flattened ellipsoid above a flat base, all at the speed of the cloud.
+       Their velocity holds the speed, the x of the cloud center and their x offset from it, so the
+       cloud wraps around as a whole. Negative lifetimes mark puffs, and hold their radius */
+    const int nb_clouds = std::max(1, std::min(nb_puffs, int((extent + 2.0f * CLOUD_MARGIN) * extent / CLOUD_AREA)));
+    for (int cloud = 0; cloud < nb_clouds; cloud++)
+    {
+        const Vector3D center{randomFloat(-CLOUD_MARGIN, extent + CLOUD_MARGIN), randomFloat(0.0f, extent),
+                              randomFloat(CLOUD_MIN_HEIGHT, CLOUD_MAX_HEIGHT)};
+        const float radius_x = randomFloat(CLOUD_MIN_RADIUS, CLOUD_MAX_RADIUS);
+        const float radius_y = randomFloat(CLOUD_MIN_RADIUS, CLOUD_MAX_RADIUS);
+        const float speed = randomFloat(CLOUD_MIN_SPEED, CLOUD_MAX_SPEED);
+        const int first = int(int64_t(cloud) * nb_puffs / nb_clouds), last = int(int64_t(cloud + 1) * nb_puffs / nb_clouds);
+        for (int i = first; i < last; i++, p += PARTICLE_FLOATS)
+        {
+            float x, y, z;
+            do
+            {
+                x = randomFloat(-1.0f, 1.0f);
+                y = randomFloat(-1.0f, 1.0f);
+                z = randomFloat(0.0f, 1.0f);
+            } while (x * x + y * y + z * z > 1.0f);
+            p[0] = center.x + x * radius_x;
+            p[1] = center.y + y * radius_y;
+            p[2] = center.z + z * CLOUD_THICKNESS;
+            p[3] = 0.0f;
+            p[4] = speed;
+            p[5] = center.x;
+            p[6] = x * radius_x;
+            p[7] = -randomFloat(PUFF_MIN_RADIUS, PUFF_MAX_RADIUS);
+        }
+    }
+    /* Smoke is born one particle after the other over its first lifetime */
+    for (int i = 0; i < nb_smoke; i++, p += PARTICLE_FLOATS)
+    {
+        const float life = randomFloat(SMOKE_MIN_LIFE, SMOKE_MAX_LIFE);
+        p[0] = emitter.x;
+        p[1] = emitter.y;
+        p[2] = emitter.z;
+        p[3] = -randomFloat(0.0f, life);
+        p[4] = p[5] = p[6] = 0.0f;
+        p[7] = life;
+    }
+
+    current = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[current]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, particles.size() * sizeof(float), particles.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleSystem::update(float dt)
+{
+    if (!enabled() || count() == 0 || dt <= 0.0f)
+        return;
+
+    GLint previous_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    glUseProgram(update_program);
+    glUniform1f(glGetUniformLocation(update_program, "dt"), dt);
+    glUniform1f(glGetUniformLocation(update_program, "extent"), extent);
+    glUniform1f(glGetUniformLocation(update_program, "margin"), CLOUD_MARGIN);
+    glUniform3f(glGetUniformLocation(update_program, "emitter"), emitter.x, emitter.y, emitter.z);
+    glUniform1i(glGetUniformLocation(update_program, "emitting"), emitting);
+    glUniform1ui(glGetUniformLocation(update_program, "seed"), seed + step++ * 0x9e3779b9u);
+
+    /* Read the current state, write the other buffer, nothing is rasterized */
+    const int next = 1 - current;
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(update_vaos[current]);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedback);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[next]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, count());
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    glUseProgram(previous_program);
+    current = next;
+}
+
+void ParticleSystem::draw(const Matrix4D &view_proj, const Matrix4D &view)
+{
+    if (!enabled() || count() == 0)
+        return;
+
+    GLint previous_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    /* Translucent : blended over the scene, hidden by it, but not hiding each other */
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+
+    glUseProgram(draw_program);
+    glUniformMatrix4fv(glGetUniformLocation(draw_program, "view_proj"), 1, GL_FALSE, view_proj.mat);
+    /* Rows of the rotation of the view : the camera axes in world coordinates */
+    glUniform3f(glGetUniformLocation(draw_program, "camera_right"), view.mat[0], view.mat[4], view.mat[8]);
+    glUniform3f(glGetUniformLocation(draw_program, "camera_up"), view.mat[1], view.mat[5], view.mat[9]);
+    glBindVertexArray(draw_vaos[current]);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count());
+    glBindVertexArray(0);
+
+    glUseProgram(previous_program);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
@@ -0,0 +1,236 @@
+#include "pick_grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/* Free slots of a cell after build() : an edit replaces the objects of a cell, or puts one
+   on an empty cell */
+static const int SPARE_SLOTS = 1;
+
+void PickGrid::reset(int grid_size, float size_of_cell)
+{
+    size = grid_size;
+    cell_size = size_of_cell;
+    top = 0.0f;
+    boxes.clear();
+    removed.clear();
+    free_objects.clear();
+    built = false;
+    offsets.assign(size * size + 1, 0);
+    counts.assign(size * size, 0);
+    objects.clear();
+    overflow.clear();
+}
+
+int PickGrid::add(const Vector3D &min, const Vector3D &max)
+{
+    int object;
+    if (free_objects.empty())
+    {
+        object = boxes.size();
+        boxes.push_back(Box{min, max});
+        removed.push_back(0);
+    }
+    else
+    {
+        object = free_objects.back();
+        free_objects.pop_back();
+        boxes[object] = Box{min, max};
+        removed[object] = 0;
+    }
+    top = std::max(top, max.z);
+    if (built)
+        insert(object);
+    return object;
+}
+
+void PickGrid::remove(int object)
+{
+    if (built)
+        erase(object);
+    removed[object] = 1;
+    free_objects.push_back(object);
+}
+
+void PickGrid::cellRange(const Box &box, int &x0, int &y0, int &x1, int &y1) const
+{
+    x0 = std::max(0, int(std::floor(box.min.x / cell_size)));
+    y0 = std::max(0, int(std::floor(box.min.y / cell_size)));
+    x1 = std::min(size - 1, int(std::ceil(box.max.x / cell_size)) - 1);
+    y1 = std::min(size - 1, int(std::ceil(box.max.y / cell_size)) - 1);
+}
+
+void PickGrid::insert(int object)
+{
+    int x0, y0, x1, y1;
+    cellRange(boxes[object], x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            const int cell = y * size + x;
+            if (offsets[cell] + counts[cell] < offsets[cell + 1])
+                objects[offsets[cell] + counts[cell]++] = object;
+            else
+                overflow[cell].push_back(object);
+        }
+    }
+}
+
+void PickGrid::erase(int object)
+{
+    int x0, y0, x1, y1;
+    cellRange(boxes[object], x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            /* The last object of the cell takes the slot */
+            const int cell = y * size + x;
+            int *first = objects.data() + offsets[cell], *last = first + counts[cell];
+            int *found = std::find(first, last, object);
+            if (found != last)
+            {
+                *found = *(last - 1);
+                counts[cell]--;
+                continue;
+            }
+            auto it = overflow.find(cell);
+            if (it == overflow.end())
+                continue;
+            it->second.erase(std::find(it->second.begin(), it->second.end(), object));
+            if (it->second.empty())
+                overflow.erase(it);
+        }
+    }
+}
+
+void PickGrid::build()
+{
+    /* Count, prefix sum, then fill : two passes over the boxes */
+    counts.assign(size * size, 0);
+    int x0, y0, x1, y1;
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        if (removed[i])
+            continue;
+        cellRange(boxes[i], x0, y0, x1, y1);
+        for (int y = y0; y <= y1; y++)
+            for (int x = x0; x <= x1; x++)
+                counts[y * size + x]++;
+    }
+    offsets.assign(size * size + 1, 0);
+    for (int c = 0; c < size * size; c++)
+        offsets[c + 1] = offsets[c] + counts[c] + SPARE_SLOTS;
+    objects.resize(offsets.back());
+    counts.assign(size * size, 0);
+    overflow.clear();
+    built = true;
+    for (int i = 0; i < (int)boxes.size(); i++)
+    {
+        if (!removed[i])
+            insert(i);
+    }
+}
+
+bool PickGrid::hitBox(const Box &box, const Vector3D &origin, const Vector3D &inverse, float max_distance, float &distance)
+{
+    float t_min = 0.0f, t_max = max_distance;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float t0 = (box.min[axis] - origin[axis]) * inverse[axis];
+        float t1 = (box.max[axis] - origin[axis]) * inverse[axis];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        /* NaN (ray parallel to a face, on the face) keeps the previous bound */
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_min > t_max)
+            return false;
+    }
+    distance = t_min;
+    return true;
+}
+
+int PickGrid::cast(const Vector3D &origin, const Vector3D &direction, float max_distance, float &distance,
+                   unsigned int *cells_visited) const
+{
+    if (cells_visited)
+        *cells_visited = 0;
+    if (size <= 0 || boxes.empty())
+        return -1;
+
+    const float inf = std::numeric_limits<float>::infinity();
+    const Vector3D inverse{direction.x != 0.0f ? 1.0f / direction.x : inf, direction.y != 0.0f ? 1.0f / direction.y : inf,
+                           direction.z != 0.0f ? 1.0f / direction.z : inf};
+
+    /* Part of the ray inside the slab of the grid */
+    const Box grid{Vector3D{0.0f, 0.0f, 0.0f}, Vector3D{size * cell_size, size * cell_size, top}};
+    float t_enter;
+    if (!hitBox(grid, origin, inverse, max_distance, t_enter))
+        return -1;
+    float t_exit = max_distance;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float t0 = (grid.min[axis] - origin[axis]) * inverse[axis];
+        float t1 = (grid.max[axis] - origin[axis]) * inverse[axis];
+        float far = std::max(t0, t1);
+        if (far == far) /* Not NaN */
+            t_exit = std::min(t_exit, far);
+    }
+
+    /* First cell, and distances to the next cell boundary on x and y (Amanatides & Woo) */
+    const float start_x = origin.x + direction.x * t_enter, start_y = origin.y + direction.y * t_enter;
+    int x = std::min(std::max(int(std::floor(start_x / cell_size)), 0), size - 1);
+    int y = std::min(std::max(int(std::floor(start_y / cell_size)), 0), size - 1);
+    const int step_x = direction.x > 0.0f ? 1 : -1, step_y = direction.y > 0.0f ? 1 : -1;
+    const float delta_x = std::fabs(cell_size * inverse.x), delta_y = std::fabs(cell_size * inverse.y);
+    float next_x = direction.x != 0.0f ? ((x + (step_x > 0)) * cell_size - origin.x) * inverse.x : inf;
+    float next_y = direction.y != 0.0f ? ((y + (step_y > 0)) * cell_size - origin.y) * inverse.y : inf;
+
+    int best = -1;
+    float best_distance = max_distance;
+    while (true)
+    {
+        if (cells_visited)
+            (*cells_visited)++;
+        const int cell = y * size + x;
+        auto test = [&](int object)
+        {
+            float d;
+            if (hitBox(boxes[object], origin, inverse, best_distance, d) && (best < 0 || d < best_distance))
+            {
+                best = object;
+                best_distance = d;
+            }
+        };
+        for (int k = offsets[cell]; k < offsets[cell] + counts[cell]; k++)
+            test(objects[k]);
+        if (!overflow.empty())
+        {
+            auto it = overflow.find(cell);
+            if (it != overflow.end())
+                for (int object : it->second)
+                    test(object);
+        }
+        /* A hit before the ray leaves this cell is in a cell already walked : it is the nearest */
+        const float cell_exit = std::min(next_x, next_y);
+        if ((best >= 0 && best_distance <= cell_exit) || cell_exit >= t_exit)
+            break;
+        if (next_x < next_y)
+        {
+            x += step_x;
+            next_x += delta_x;
+        }
+        else
+        {
+            y += step_y;
+            next_y += delta_y;
+        }
+        if (x < 0 || y < 0 || x >= size || y >= size)
+            break;
+    }
+    distance = best_distance;
+    return best;
+}
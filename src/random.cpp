@@ -0,0 +1,32 @@
+#include "random.hpp"
+
+static uint32_t seed = std::random_device{}();
+static std::mt19937 engine{seed};
+
+void seedRandom(uint32_t new_seed)
+{
+    seed = new_seed;
+    engine.seed(seed);
+}
+
+uint32_t randomSeed()
+{
+    return seed;
+}
+
+std::mt19937 &randomEngine()
+{
+    return engine;
+}
+
+float randomFloat(float min, float max)
+{
+    std::uniform_real_distribution<float> dist(min, max);
+    return dist(engine);
+}
+
+int randomInt(int min, int max)
+{
+    std::uniform_int_distribution<int> dist(min, max);
+    return dist(engine);
+}
@@ -0,0 +1,422 @@
+#include "simulation.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/* Length of the track of one cell, in meters */
+static const double CELL_LENGTH = 100.0;
+/* Simulated seconds per step : trains move less than one cell per step up to 360 km/h */
+static const double STEP = 1.0;
+/* Spread of the top speed of the trains around the mean */
+static const double SPEED_SPREAD = 0.1;
+/* Fewer trains per thread are not worth the synchronisation of every step */
+static const int MIN_TRAINS_PER_THREAD = 512;
+/* Runs of the capacity sweep */
+static const int CAPACITY_RUNS = 16;
+/* Share of the best throughput above which the layout is considered saturated */
+static const double SATURATION = 0.95;
+
+/* Threads wait here between two phases. Spins, then yields, as phases are very short */
+class StepBarrier
+{
+public:
+    explicit StepBarrier(int count) : count{count} {}
+
+    void wait()
+    {
+        int gen = generation.load(std::memory_order_acquire);
+        if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+        {
+            arrived.store(0, std::memory_order_relaxed);
+            generation.fetch_add(1, std::memory_order_release);
+            return;
+        }
+        for (int spin = 0; generation.load(std::memory_order_acquire) == gen; spin++)
+        {
+            if (spin > 64)
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    const int count;
+    std::atomic<int> arrived{0};
+    std::atomic<int> generation{0};
+};
+
+/* ---SETUP--- */
+
+bool Simulation::init(const Layout &layout, const SimulationSettings &s)
+{
+    settings = s;
+    if (layout.empty() || !layout.isValid())
+    {
+        std::cerr << "ERROR: The path must be a valid loop to be simulated" << std::endl;
+        return false;
+    }
+
+    /* Walk the ring once to number the cells */
+    std::vector<Vector2D> path{};
+    Vector2D cell = layout.first();
+    do
+    {
+        path.push_back(cell);
+        cell = layout.track(cell)->next;
+    } while (!(cell == layout.first()));
+    path_length = path.size();
+
+    station_cell = -1;
+    for (int i = 0; i < path_length && station_cell < 0; i++)
+    {
+        if (path[i].isNeighbor(layout.origin()))
+            station_cell = i;
+    }
+    if (station_cell < 0)
+        std::cerr << "WARNING: The origin station is not next to the path, trains will not stop" << std::endl;
+
+    settings.block_cells = std::max(1, std::min(settings.block_cells, path_length));
+    nb_blocks = (path_length + settings.block_cells - 1) / settings.block_cells;
+    /* A train only enters a free block : with every block taken, no train ever moves */
+    if (nb_blocks < 2)
+    {
+        std::cerr << "ERROR: The path is a single block, trains cannot move (use fewer cells per block)" << std::endl;
+        return false;
+    }
+    if (settings.trains < 1 || settings.trains > maxTrains())
+    {
+        std::cerr << "ERROR: The path can hold 1 to " << maxTrains() << " trains (one per block, one block free)" << std::endl;
+        return false;
+    }
+
+    const int n = settings.trains;
+    occupant.assign(nb_blocks, -1);
+    position.assign(n, 0.0);
+    speed.assign(n, 0.0);
+    dwell_left.assign(n, 0.0);
+    block.assign(n, 0);
+    next_block.assign(n, 0);
+    distance.assign(n, 0.0);
+    blocked_time.assign(n, 0.0);
+    dwell_time.assign(n, 0.0);
+    laps.assign(n, 0);
+
+    const double mean_speed = settings.speed / 3.6 / CELL_LENGTH;
+    std::uniform_real_distribution<double> spread(1.0 - SPEED_SPREAD, 1.0 + SPEED_SPREAD);
+    for (int i = 0; i < n; i++)
+    {
+        /* Evenly spaced, at the start of a block */
+        block[i] = next_block[i] = int((long)i * nb_blocks / n);
+        position[i] = block[i] * settings.block_cells;
+        speed[i] = mean_speed * spread(randomEngine());
+        occupant[block[i]] = i;
+    }
+
+    arrivals = 0;
+    last_arrival = -1.0;
+    headway_sum = headway_min = headway_max = 0.0;
+    now = 0.0;
+    return true;
+}
+
+double Simulation::blockEnd(int b) const
+{
+    return std::min((b + 1) * settings.block_cells, path_length);
+}
+
+/* ---STEPPING--- */
+
+void Simulation::moveTrains(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        if (dwell_left[i] > 0.0)
+        {
+            dwell_left[i] -= STEP;
+            dwell_time[i] += STEP;
+            continue;
+        }
+
+        double from = position[i];
+        double to = from + speed[i] * STEP;
+        double limit = blockEnd(block[i]);
+        if (to >= limit)
+        {
+            int ahead = (block[i] + 1) % nb_blocks;
+            if (occupant[ahead] >= 0)
+            {
+                /* Wait at the signal : the block ahead is taken */
+                to = std::max(from, limit - 1e-6);
+                blocked_time[i] += STEP;
+            }
+            else
+            {
+                /* Never cross a whole block in one step */
+                next_block[i] = ahead;
+                to = std::min(to, limit + (blockEnd(ahead) - ahead * settings.block_cells) - 1e-6);
+            }
+        }
+
+        /* Stop when passing the station cell */
+        if (station_cell >= 0)
+        {
+            double stop = station_cell;
+            if (stop < from)
+                stop += path_length;
+            if (from < stop && to >= stop)
+            {
+                to = stop;
+                dwell_left[i] = settings.dwell;
+                if (last_arrival >= 0.0)
+                {
+                    double headway = now - last_arrival;
+                    headway_sum += headway;
+                    headway_min = arrivals == 1 ? headway : std::min(headway_min, headway);
+                    headway_max = std::max(headway_max, headway);
+                }
+                last_arrival = now;
+                arrivals++;
+                /* Stopped before the end of the block : do not take the next one yet */
+                if (to < limit)
+                    next_block[i] = block[i];
+            }
+        }
+
+        distance[i] += to - from;
+        if (to >= path_length)
+        {
+            to -= path_length;
+            laps[i]++;
+        }
+        position[i] = to;
+    }
+}
+
+void Simulation::updateBlocks(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        if (next_block[i] == block[i])
+            continue;
+        occupant[block[i]] = -1;
+        occupant[next_block[i]] = i;
+        block[i] = next_block[i];
+    }
+}
+
+SimulationStats Simulation::run()
+{
+    const long steps = long(settings.hours * 3600.0 / STEP);
+    const int n = settings.trains;
+    unsigned int nb_threads = settings.nb_threads ? settings.nb_threads : std::max(1u, std::thread::hardware_concurrency());
+    nb_threads = std::max(1u, std::min<unsigned int>(nb_threads, n / MIN_TRAINS_PER_THREAD));
+
+    auto start = std::chrono::steady_clock::now();
+    if (nb_threads == 1)
+    {
+        for (long step = 0; step < steps; step++)
+        {
+            now = step * STEP;
+            moveTrains(0, n);
+            updateBlocks(0, n);
+        }
+    }
+    else
+    {
+        StepBarrier barrier(nb_threads);
+        auto worker = [&](unsigned int t)
+        {
+            int begin = long(n) * t / nb_threads;
+            int end = long(n) * (t + 1) / nb_threads;
+            for (long step = 0; step < steps; step++)
+            {
+                if (t == 0)
+                    now = step * STEP;
+                barrier.wait();
+                moveTrains(begin, end);
+                barrier.wait();
+                updateBlocks(begin, end);
+            }
+        };
+        std::vector<std::thread> threads{};
+        for (unsigned int t = 1; t < nb_threads; t++)
+            threads.emplace_back(worker, t);
+        worker(0);
+        for (auto &thread : threads)
+            thread.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    SimulationStats stats;
+    stats.simulated_hours = steps * STEP / 3600.0;
+    stats.wall_seconds = std::chrono::duration<double>(stop - start).count();
+    stats.arrivals = arrivals;
+    stats.headway_mean = arrivals > 1 ? headway_sum / (arrivals - 1) : 0.0;
+    stats.headway_min = headway_min;
+    stats.headway_max = headway_max;
+    double total_distance = 0.0, total_blocked = 0.0, total_dwell = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        stats.laps += laps[i];
+        total_distance += distance[i];
+        total_blocked += blocked_time[i];
+        total_dwell += dwell_time[i];
+    }
+    const double train_seconds = double(n) * steps * STEP;
+    if (train_seconds > 0.0)
+    {
+        stats.mean_speed = total_distance * CELL_LENGTH * 3.6 / train_seconds;
+        stats.blocked_ratio = total_blocked / train_seconds;
+        stats.dwell_ratio = total_dwell / train_seconds;
+    }
+    return stats;
+}
+
+/* ---COMMAND LINE--- */
+
+static void printStats(const SimulationSettings &settings, const SimulationStats &stats)
+{
+    const double per_hour = stats.simulated_hours > 0.0 ? stats.arrivals / stats.simulated_hours : 0.0;
+    std::cout << settings.trains << " trains, " << stats.simulated_hours << " h simulated in " << stats.wall_seconds << " s ("
+              << (stats.wall_seconds > 0.0 ? stats.simulated_hours * 60.0 / stats.wall_seconds : 0.0) << " h per minute)" << std::endl
+              << "  station: " << stats.arrivals << " arrivals, " << per_hour << " per hour" << std::endl
+              << "  headway: mean " << stats.headway_mean << " s, min " << stats.headway_min << " s, max " << stats.headway_max << " s" << std::endl
+              << "  trains: " << stats.laps << " laps, mean speed " << stats.mean_speed << " km/h, "
+              << 100.0 * stats.blocked_ratio << "% waiting for a block, " << 100.0 * stats.dwell_ratio << "% at the station" << std::endl;
+}
+
+/* Throughput for an increasing number of trains, until it stops growing */
+static int capacitySweep(const Layout &layout, SimulationSettings settings)
+{
+    Simulation simulation;
+    settings.trains = 1;
+    if (!simulation.init(layout, settings))
+        return 1;
+    const int max_trains = simulation.maxTrains();
+    const int stride = std::max(1, max_trains / CAPACITY_RUNS);
+
+    std::vector<std::pair<int, double>> throughput{};
+    for (int trains = 1; trains <= max_trains; trains += stride)
+    {
+        settings.trains = trains;
+        if (!simulation.init(layout, settings))
+            return 1;
+        SimulationStats stats = simulation.run();
+        double per_hour = stats.arrivals / stats.simulated_hours;
+        throughput.push_back({trains, per_hour});
+        std::cout << trains << " trains: " << per_hour << " arrivals per hour, " << 100.0 * stats.blocked_ratio
+                  << "% waiting for a block" << std::endl;
+    }
+
+    double best = 0.0;
+    for (const auto &t : throughput)
+        best = std::max(best, t.second);
+    for (const auto &t : throughput)
+    {
+        if (t.second >= SATURATION * best)
+        {
+            std::cout << "Capacity: about " << t.first << " trains (" << best << " arrivals per hour at most)" << std::endl;
+            break;
+        }
+    }
+    return 0;
+}
+
+static void simulateUsage()
+{
+    std::cerr << "Usage: ./the_train --simulate filename.json [options]" << std::endl
+              << "  --trains N       number of trains (default 4)" << std::endl
+              << "  --capacity       run with more and more trains and report the saturation point" << std::endl
+              << "  --hours H        simulated time (default 1000)" << std::endl
+              << "  --dwell S        stop at the origin station, in seconds (default 30)" << std::endl
+              << "  --speed KMH      mean top speed (default 60, cells are " << CELL_LENGTH << " m long)" << std::endl
+              << "  --block-cells N  cells per signalling block (default 1)" << std::endl
+              << "  --threads N      stepping threads (default : one per core)" << std::endl
+              << "  --seed N         seed of the train speeds" << std::endl;
+}
+
+int simulateLayout(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        simulateUsage();
+        return 1;
+    }
+    const std::string file_path = argv[2];
+    SimulationSettings settings;
+    bool capacity = false;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--capacity")
+        {
+            capacity = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            simulateUsage();
+            return 1;
+        }
+        if (arg == "--trains")
+            settings.trains = std::atoi(argv[++i]);
+        else if (arg == "--hours")
+            settings.hours = std::atof(argv[++i]);
+        else if (arg == "--dwell")
+            settings.dwell = std::atof(argv[++i]);
+        else if (arg == "--speed")
+            settings.speed = std::atof(argv[++i]);
+        else if (arg == "--block-cells")
+            settings.block_cells = std::atoi(argv[++i]);
+        else if (arg == "--threads")
+            settings.nb_threads = std::atoi(argv[++i]);
+        else if (arg == "--seed")
+            seedRandom(std::strtoul(argv[++i], NULL, 10));
+        else
+        {
+            simulateUsage();
+            return 1;
+        }
+    }
+    if (settings.hours <= 0.0 || settings.speed <= 0.0 || settings.dwell < 0.0)
+    {
+        simulateUsage();
+        return 1;
+    }
+
+    std::ifstream file(file_path);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open " << file_path << std::endl;
+        return 1;
+    }
+    nlohmann::json data;
+    try
+    {
+        file >> data;
+    }
+    catch (const nlohmann::json::parse_error &e)
+    {
+        std::cerr << "ERROR: " << file_path << " is not valid json" << std::endl
+                  << e.what() << std::endl;
+        return 1;
+    }
+    Layout layout;
+    if (!layout.load(data))
+        return 1;
+
+    if (capacity)
+        return capacitySweep(layout, settings);
+
+    Simulation simulation;
+    if (!simulation.init(layout, settings))
+        return 1;
+    printStats(settings, simulation.run());
+    return 0;
+}
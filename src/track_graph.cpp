@@ -0,0 +1,473 @@
+#include "track_graph.hpp"
+
+#include <algorithm>
+
+/* Sides of a cell, in the order of the edges of a node : lower row, same row, upper row */
+static const Vector2D SIDES[] = {Vector2D{0, -1}, Vector2D{-1, 0}, Vector2D{1, 0}, Vector2D{0, 1}};
+
+/* ---BUILDING--- */
+
+void TrackGraph::build(const Layout &layout)
+{
+    cells.clear();
+    cells.reserve(layout.allTracks().size());
+    for (const auto &t : layout.allTracks())
+        cells.push_back(t.first);
+    for (const auto &branch : layout.allBranches())
+    {
+        /* The end of a branch may have lost the track it joined */
+        for (const auto &c : branch)
+        {
+            if (!layout.track(c) && layout.isTrack(c))
+                cells.push_back(c);
+        }
+    }
+    std::sort(cells.begin(), cells.end(), [](const Vector2D &a, const Vector2D &b)
+              { return a.y != b.y ? a.y < b.y : a.x < b.x; });
+    /* A cell shared by two branches was added twice */
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+    index.clear();
+    index.reserve(cells.size());
+    for (size_t i = 0; i < cells.size(); i++)
+        index[cells[i]] = i;
+
+    degrees.assign(cells.size(), 0);
+    targets.assign(MAX_DEGREE * cells.size(), -1);
+    reverse.assign(MAX_DEGREE * cells.size(), -1);
+    switch_trunk.assign(cells.size(), 0);
+    switch_state.assign(cells.size(), 0);
+    for (int n = 0; n < nodeCount(); n++)
+        linkNode(layout, n);
+    for (int n = 0; n < nodeCount(); n++)
+    {
+        linkReverse(n);
+        findSwitchTrunk(n);
+    }
+    findStationNodes(layout);
+
+    visit_stamp.assign(targets.size(), 0);
+    cost.resize(targets.size());
+    parent.resize(targets.size());
+    stamp = 0;
+}
+
+void TrackGraph::update(const Layout &layout, const std::vector<Vector2D> &changed)
+{
+    for (const auto &c : changed)
+    {
+        int n = node(c);
+        if (n >= 0 && !layout.isTrack(c))
+            removeNode(n);
+        else if (n < 0 && layout.isTrack(c))
+            addNode(c);
+    }
+
+    /* The connections of a changed cell, and of the tracks next to it, are found again */
+    std::vector<int> relinked{};
+    for (const auto &c : changed)
+    {
+        int n = node(c);
+        if (n >= 0)
+            relinked.push_back(n);
+        for (const auto &side : SIDES)
+        {
+            n = node(c + side);
+            if (n >= 0)
+                relinked.push_back(n);
+        }
+    }
+    std::sort(relinked.begin(), relinked.end());
+    relinked.erase(std::unique(relinked.begin(), relinked.end()), relinked.end());
+    for (int n : relinked)
+        linkNode(layout, n);
+    for (int n : relinked)
+    {
+        linkReverse(n);
+        findSwitchTrunk(n);
+    }
+    findStationNodes(layout);
+
+    /* Stamps of reused slots are older than any query to come */
+    visit_stamp.resize(targets.size(), 0);
+    cost.resize(targets.size());
+    parent.resize(targets.size());
+}
+
+int TrackGraph::addNode(const Vector2D &cell)
+{
+    int n = cells.size();
+    cells.push_back(cell);
+    index[cell] = n;
+    degrees.push_back(0);
+    targets.resize(targets.size() + MAX_DEGREE, -1);
+    reverse.resize(reverse.size() + MAX_DEGREE, -1);
+    switch_trunk.push_back(0);
+    switch_state.push_back(0);
+    return n;
+}
+
+void TrackGraph::removeNode(int n)
+{
+    int last = nodeCount() - 1;
+    index.erase(cells[n]);
+    if (n != last)
+    {
+        cells[n] = cells[last];
+        index[cells[n]] = n;
+        degrees[n] = degrees[last];
+        switch_trunk[n] = switch_trunk[last];
+        switch_state[n] = switch_state[last];
+        for (int k = 0; k < MAX_DEGREE; k++)
+        {
+            targets[MAX_DEGREE * n + k] = targets[MAX_DEGREE * last + k];
+            reverse[MAX_DEGREE * n + k] = reverse[MAX_DEGREE * last + k];
+        }
+        /* Edges to the moved node. Those of the tracks next to the removed one are stale,
+           they are linked again by update() */
+        for (int k = 0; k < degrees[n]; k++)
+        {
+            int m = targets[MAX_DEGREE * n + k];
+            if (m == n || m >= last)
+                continue;
+            for (int j = 0; j < degrees[m]; j++)
+            {
+                if (targets[MAX_DEGREE * m + j] != last)
+                    continue;
+                targets[MAX_DEGREE * m + j] = n;
+                reverse[MAX_DEGREE * m + j] = MAX_DEGREE * n + k;
+            }
+        }
+    }
+    cells.pop_back();
+    degrees.pop_back();
+    targets.resize(targets.size() - MAX_DEGREE);
+    reverse.resize(reverse.size() - MAX_DEGREE);
+    switch_trunk.pop_back();
+    switch_state.pop_back();
+}
+
+void TrackGraph::linkNode(const Layout &layout, int n)
+{
+    const uint8_t sides = layout.links(cells[n]);
+    degrees[n] = 0;
+    for (const auto &side : SIDES)
+    {
+        if (!(sides & sideBit(cells[n], cells[n] + side)))
+            continue;
+        int m = node(cells[n] + side);
+        if (m >= 0)
+            targets[MAX_DEGREE * n + degrees[n]++] = m;
+    }
+}
+
+void TrackGraph::linkReverse(int n)
+{
+    for (int k = 0; k < degrees[n]; k++)
+    {
+        int m = targets[MAX_DEGREE * n + k];
+        int back = edge(m, n);
+        reverse[MAX_DEGREE * n + k] = back;
+        reverse[back] = MAX_DEGREE * n + k;
+    }
+}
+
+void TrackGraph::findSwitchTrunk(int n)
+{
+    switch_trunk[n] = 0;
+    switch_state[n] = 0;
+    if (degree(n) != 3)
+        return;
+    /* Same pieces as drawn : straight between the two opposite connections, curve from
+       the third one to the first of them, which is the trunk */
+    const int *connections = neighbours(n);
+    for (int side = 0; side < 3; side++)
+    {
+        if (isCorner(cells[connections[(side + 1) % 3]], cells[n], cells[connections[(side + 2) % 3]]))
+            continue;
+        switch_trunk[n] = (side + 1) % 3;
+        /* Set for the straight way */
+        switch_state[n] = (side + 2) % 3;
+        return;
+    }
+}
+
+void TrackGraph::findStationNodes(const Layout &layout)
+{
+    station_nodes.clear();
+    for (const auto &station : layout.allStations())
+    {
+        int served = -1;
+        for (const auto &side : {Vector2D{1, 0}, Vector2D{-1, 0}, Vector2D{0, 1}, Vector2D{0, -1}})
+        {
+            served = node(station + side);
+            if (served >= 0)
+                break;
+        }
+        station_nodes.push_back(served);
+    }
+    tree_next.resize(station_nodes.size());
+    tree_dist.resize(station_nodes.size());
+    tree_built.assign(station_nodes.size(), 0);
+}
+
+void TrackGraph::prepareStationTree(int s)
+{
+    if (tree_built[s])
+        return;
+    tree_next[s].assign(targets.size(), -1);
+    tree_dist[s].assign(targets.size(), -1);
+    buildStationTree(s);
+    tree_built[s] = 1;
+}
+
+void TrackGraph::buildStationTree(int s)
+{
+    int station = station_nodes[s];
+    if (station < 0)
+        return;
+    int *next = tree_next[s].data();
+    int *dist = tree_dist[s].data();
+
+    /* Unit lengths : a breadth-first search gives the shortest paths. It starts from every way
+       of arriving on the station node */
+    std::vector<int> queue{};
+    queue.reserve(targets.size());
+    for (int e = MAX_DEGREE * station; e < MAX_DEGREE * station + degree(station); e++)
+    {
+        int arrival = reverse[e];
+        next[arrival] = arrival;
+        dist[arrival] = 0;
+        queue.push_back(arrival);
+    }
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        /* current goes from v to w : the edges u -> v that may be followed by it come before it */
+        int current = queue[head];
+        int v = targets[reverse[current]];
+        int out = current - MAX_DEGREE * v;
+        for (int in = 0; in < degree(v); in++)
+        {
+            int previous = reverse[MAX_DEGREE * v + in];
+            if (dist[previous] >= 0 || !canPass(v, in, out))
+                continue;
+            next[previous] = current;
+            dist[previous] = dist[current] + 1;
+            queue.push_back(previous);
+        }
+    }
+}
+
+/* ---QUERIES--- */
+
+int TrackGraph::node(const Vector2D &cell) const
+{
+    auto it = index.find(cell);
+    return it == index.end() ? -1 : it->second;
+}
+
+int TrackGraph::edge(int from, int to) const
+{
+    for (int e = MAX_DEGREE * from; e < MAX_DEGREE * from + degree(from); e++)
+    {
+        if (targets[e] == to)
+            return e;
+    }
+    return -1;
+}
+
+bool TrackGraph::canPass(int node, int in, int out) const
+{
+    switch (degree(node))
+    {
+    case 1:
+        /* Buffer stop : the train comes back */
+        return true;
+    case 3:
+        return in != out && (in == switch_trunk[node] || out == switch_trunk[node]);
+    case 4:
+    {
+        const int *n = neighbours(node);
+        return in != out && !isCorner(cells[n[in]], cells[node], cells[n[out]]);
+    }
+    default:
+        return in != out;
+    }
+}
+
+PieceKind TrackGraph::pieceKind(int node) const
+{
+    switch (degree(node))
+    {
+    case 2:
+    {
+        const int *n = neighbours(node);
+        return isCorner(cells[n[0]], cells[node], cells[n[1]]) ? PieceKind::Curve : PieceKind::Straight;
+    }
+    case 3:
+        return PieceKind::Switch;
+    case 4:
+        return PieceKind::Crossing;
+    default:
+        return PieceKind::Straight;
+    }
+}
+
+/* ---SWITCHES--- */
+
+bool TrackGraph::setSwitch(int node, int leg)
+{
+    if (degree(node) != 3 || leg < 0 || leg >= 3 || leg == switch_trunk[node])
+        return false;
+    switch_state[node] = leg;
+    return true;
+}
+
+int TrackGraph::alignSwitches(const std::vector<int> &route)
+{
+    int changed = 0;
+    for (size_t i = 0; i < route.size(); i++)
+    {
+        int current = route[i];
+        if (degree(current) != 3)
+            continue;
+        /* Facing or trailing, the leg is the connection of the route that is not the trunk */
+        const int *n = neighbours(current);
+        int trunk = n[switch_trunk[current]];
+        int leg = -1;
+        if (i > 0 && route[i - 1] != trunk)
+            leg = route[i - 1];
+        else if (i + 1 < route.size() && route[i + 1] != trunk)
+            leg = route[i + 1];
+        if (leg < 0)
+            continue;
+        int state = std::find(n, n + 3, leg) - n;
+        if (state != switch_state[current] && setSwitch(current, state))
+            changed++;
+    }
+    return changed;
+}
+
+/* ---ROUTES--- */
+
+bool TrackGraph::route(int from, int to, std::vector<int> &path)
+{
+    path.clear();
+    if (from < 0 || to < 0 || from >= nodeCount() || to >= nodeCount())
+        return false;
+    if (from == to)
+    {
+        path.push_back(from);
+        return true;
+    }
+
+    if (++stamp == 0)
+    {
+        /* The stamps wrapped around : old entries could look valid */
+        std::fill(visit_stamp.begin(), visit_stamp.end(), 0);
+        stamp = 1;
+    }
+    const Vector2D &goal = cells[to];
+    open.clear();
+    /* Standing on from, the train may leave by any connection */
+    for (int e = MAX_DEGREE * from; e < MAX_DEGREE * from + degree(from); e++)
+    {
+        visit_stamp[e] = stamp;
+        cost[e] = 1;
+        parent[e] = -1;
+        open.push_back({-(1 + cells[targets[e]].manhattanDistance(goal)), e});
+        std::push_heap(open.begin(), open.end());
+    }
+
+    while (!open.empty())
+    {
+        std::pop_heap(open.begin(), open.end());
+        auto top = open.back();
+        open.pop_back();
+        int current = top.second;
+        int v = targets[current];
+        /* Stale entry : a shorter way to current was found after it was pushed */
+        if (-top.first > cost[current] + cells[v].manhattanDistance(goal))
+            continue;
+        if (v == to)
+        {
+            for (int e = current; e >= 0; e = parent[e])
+                path.push_back(targets[e]);
+            path.push_back(from);
+            std::reverse(path.begin(), path.end());
+            return true;
+        }
+        int in = reverse[current] - MAX_DEGREE * v;
+        for (int out = 0; out < degree(v); out++)
+        {
+            if (!canPass(v, in, out))
+                continue;
+            int next = MAX_DEGREE * v + out;
+            int new_cost = cost[current] + 1;
+            if (visit_stamp[next] == stamp && cost[next] <= new_cost)
+                continue;
+            visit_stamp[next] = stamp;
+            cost[next] = new_cost;
+            parent[next] = current;
+            open.push_back({-(new_cost + cells[targets[next]].manhattanDistance(goal)), next});
+            std::push_heap(open.begin(), open.end());
+        }
+    }
+    return false;
+}
+
+int TrackGraph::bestEdge(int node, int s) const
+{
+    const int *dist = tree_dist[s].data();
+    int best = -1;
+    for (int e = MAX_DEGREE * node; e < MAX_DEGREE * node + degree(node); e++)
+    {
+        if (dist[e] >= 0 && (best < 0 || dist[e] < dist[best]))
+            best = e;
+    }
+    return best;
+}
+
+int TrackGraph::nextHop(int node, int s, int previous)
+{
+    prepareStationTree(s);
+    if (node == station_nodes[s])
+        return node;
+    int e = previous < 0 ? bestEdge(node, s) : edge(previous, node);
+    if (e < 0 || tree_dist[s][e] < 0)
+        return -1;
+    /* Standing, the best edge is the first move; moving, e is the way the train came */
+    return previous < 0 ? targets[e] : targets[tree_next[s][e]];
+}
+
+int TrackGraph::distanceToStation(int node, int s, int previous)
+{
+    prepareStationTree(s);
+    if (node == station_nodes[s])
+        return 0;
+    int e = previous < 0 ? bestEdge(node, s) : edge(previous, node);
+    if (e < 0)
+        return -1;
+    int dist = tree_dist[s][e];
+    return dist < 0 ? -1 : dist + (previous < 0 ? 1 : 0);
+}
+
+bool TrackGraph::routeToStation(int from, int s, std::vector<int> &path)
+{
+    path.clear();
+    if (from < 0 || from >= nodeCount() || s < 0 || s >= stationCount() || distanceToStation(from, s) < 0)
+        return false;
+    path.reserve(distanceToStation(from, s) + 1);
+    path.push_back(from);
+    if (from == station_nodes[s])
+        return true;
+    const int *next = tree_next[s].data();
+    int e = bestEdge(from, s);
+    path.push_back(targets[e]);
+    while (next[e] != e)
+    {
+        e = next[e];
+        path.push_back(targets[e]);
+    }
+    return true;
+}
@@ -0,0 +1,116 @@
+#include "validate.hpp"
+#include "layout.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+/* Result of one file. kind is empty if the file is valid */
+struct FileResult
+{
+    std::string kind;
+    bool has_cell = false;
+    Vector2D cell;
+    std::string message;
+};
+
+static std::vector<std::string> listFiles(const std::vector<std::string> &paths)
+{
+    std::vector<std::string> files{};
+    for (const auto &path : paths)
+    {
+        std::error_code ec;
+        if (fs::is_directory(path, ec))
+        {
+            std::vector<std::string> entries{};
+            for (const auto &entry : fs::directory_iterator(path, ec))
+                if (entry.is_regular_file() && entry.path().extension() == ".json")
+                    entries.push_back(entry.path().string());
+            /* Directory order is not specified : keep the output stable */
+            std::sort(entries.begin(), entries.end());
+            files.insert(files.end(), entries.begin(), entries.end());
+        }
+        else
+            files.push_back(path);
+    }
+    return files;
+}
+
+static FileResult validateFile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return {"cannot_open", false, Vector2D{}, "Cannot open the file"};
+
+    nlohmann::json data;
+    try
+    {
+        file >> data;
+    }
+    catch (const nlohmann::json::parse_error &e)
+    {
+        return {"invalid_json", false, Vector2D{}, e.what()};
+    }
+
+    Layout layout;
+    LayoutError error = layout.parse(data);
+    if (!error)
+        return {};
+    bool has_cell = error.kind == LayoutErrorKind::DuplicateCell || error.kind == LayoutErrorKind::NotAdjacent;
+    return {layoutErrorName(error.kind), has_cell, error.cell, error.message};
+}
+
+int validateLayouts(const std::vector<std::string> &paths, unsigned int nb_threads)
+{
+    const std::vector<std::string> files = listFiles(paths);
+    std::vector<FileResult> results(files.size());
+
+    if (nb_threads == 0)
+        nb_threads = std::max(1u, std::thread::hardware_concurrency());
+    nb_threads = std::min<unsigned int>(nb_threads, std::max<size_t>(files.size(), 1));
+
+    auto start = std::chrono::steady_clock::now();
+    /* Workers take the next file until none is left */
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers{};
+    for (unsigned int t = 0; t < nb_threads; t++)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 for (size_t i = next++; i < files.size(); i = next++)
+                                     results[i] = validateFile(files[i]); });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t nb_errors = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const FileResult &r = results[i];
+        if (r.kind.empty())
+        {
+            std::cout << files[i] << ": ok" << std::endl;
+            continue;
+        }
+        nb_errors++;
+        std::cout << files[i] << ": error " << r.kind;
+        if (r.has_cell)
+            std::cout << " at (" << r.cell.x << ", " << r.cell.y << ")";
+        /* Keep one line per file */
+        std::string message = r.message;
+        std::replace(message.begin(), message.end(), '\n', ' ');
+        std::cout << ": " << message << std::endl;
+    }
+
+    std::cout << files.size() << " files, " << files.size() - nb_errors << " ok, " << nb_errors << " errors in "
+              << seconds << " s (" << (seconds > 0.0 ? files.size() / seconds : 0.0) << " files/s, "
+              << nb_threads << " threads)" << std::endl;
+    return nb_errors == 0 && !files.empty() ? 0 : 1;
+}
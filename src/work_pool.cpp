@@ -0,0 +1,115 @@
+#include "work_pool.hpp"
+
+#include <algorithm>
+
+WorkPool::WorkPool(unsigned int nb_threads)
+{
+    nb_workers = nb_threads ? nb_threads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int w = 0; w < nb_workers; w++)
+        queues.emplace_back(new WorkerQueue());
+    for (unsigned int w = 1; w < nb_workers; w++)
+        threads.emplace_back(&WorkPool::threadLoop, this, w);
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        stopping = true;
+    }
+    batch_changed.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void WorkPool::run(size_t count, const std::function<void(size_t, unsigned int)> &task)
+{
+    if (count == 0)
+        return;
+    if (nb_workers == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            task(i, 0);
+        return;
+    }
+
+    /* Neighbouring tasks stay on the same worker unless they are stolen */
+    for (unsigned int w = 0; w < nb_workers; w++)
+    {
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        for (size_t i = count * w / nb_workers; i < count * (w + 1) / nb_workers; i++)
+            queues[w]->tasks.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        batch_task = &task;
+        batch_id++;
+        active = nb_workers - 1;
+    }
+    batch_changed.notify_all();
+
+    work(0);
+
+    /* Every thread has to leave the batch before task goes out of scope */
+    std::unique_lock<std::mutex> lock(batch_mutex);
+    batch_done.wait(lock, [this]()
+                    { return active == 0; });
+    batch_task = NULL;
+}
+
+void WorkPool::threadLoop(unsigned int worker)
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(batch_mutex);
+            batch_changed.wait(lock, [this, seen]()
+                               { return stopping || batch_id != seen; });
+            if (stopping)
+                return;
+            seen = batch_id;
+        }
+        work(worker);
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            active--;
+        }
+        batch_done.notify_all();
+    }
+}
+
+void WorkPool::work(unsigned int worker)
+{
+    size_t index;
+    while (pop(worker, index))
+        (*batch_task)(index, worker);
+}
+
+bool WorkPool::pop(unsigned int worker, size_t &index)
+{
+    {
+        WorkerQueue &own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    /* Steal the last task of another worker : the one it would have run last */
+    for (unsigned int k = 1; k < nb_workers; k++)
+    {
+        WorkerQueue &other = *queues[(worker + k) % nb_workers];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty())
+        {
+            index = other.tasks.back();
+            other.tasks.pop_back();
+            nb_steals++;
+            return true;
+        }
+    }
+    return false;
+}
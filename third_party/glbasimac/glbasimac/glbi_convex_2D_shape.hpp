@@ -4,6 +4,7 @@
 #include <cassert>
 #include "tools/mesh.hpp"
 #include "tools/vector3d.hpp"
+#include "glbasimac/glbi_geometry_cache.hpp"
 
 using namespace STP3D;
 
@@ -20,6 +21,9 @@ struct GLBI_Convex_2D_Shape {
 	};
 
 	void initShape(const std::vector<float> in_coord);
+	/// Upload coordinates taken from a geometry cache, without keeping a CPU copy.
+	/// The nature of the shape becomes the primitive type of the geometry.
+	void initShape(const GLBI_Geometry& geometry);
 
 	void changeNature(unsigned int new_gl_type);
 
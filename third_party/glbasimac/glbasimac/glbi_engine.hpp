@@ -5,31 +5,68 @@
 #include <iostream>
 #include "tools/matrix4d.hpp"
 #include "tools/matrix_stack.hpp"
+#include "glbasimac/glbi_light_clusters.hpp"
+#include "glbasimac/glbi_material_table.hpp"
+#include "glbasimac/glbi_stats.hpp"
 
 using namespace STP3D;
 
 namespace glbasimac {
 
+/// First attribute index of the per-instance modelview matrix (one column per index, 4 to 7)
+#define GLBI_INSTANCE_MATRIX_ATTRIB 4
+/// Attribute index of the vertex color (flat color when no array is bound)
+#define GLBI_COLOR_ATTRIB 3
+/// Uniform buffer binding point of the FrameUniforms block
+#define GLBI_FRAME_UNIFORMS_BINDING 0
+/// Size of the light arrays of the FrameUniforms block
+#define GLBI_MAX_LIGHTS 6
+
+/// CPU copy of the FrameUniforms block, following the std140 layout of the shaders
+struct GLBI_Frame_Uniforms {
+	float projectionMat[16];
+	float viewMatrix[16];
+	float lightPos[GLBI_MAX_LIGHTS][4];
+	float lightIntensity[GLBI_MAX_LIGHTS][4]; // w unused
+	float attenuationFactor[4];               // w unused
+	int numOfLight;
+	int padding[3];
+	float clusterDepth[4];    // z_near, z_far, log(z_far/z_near), unused
+	float clusterViewport[4]; // x, y, width, height in pixels
+	int clusterDims[4];       // nx, ny, nz, number of point lights
+};
+
 struct GLBI_Engine {
-	GLBI_Engine():mode2D(true),useTexture(0),currentShader(0),attFactors({1.0,0.0,1.0}),numberOfLight(1) {
+	GLBI_Engine():mode2D(true),useTexture(0),currentShader(0),idFrameUBO(0),frameUniformsDirty(true),attFactors({1.0,0.0,1.0}),numberOfLight(1),zNear(0.1f),zFar(100.0f),procLoader(NULL) {
 		lightPos.push_back({0.0,0.0,0.0,0.0});
 		lightIntensity.push_back({0.0,0.0,0.0});
+		frameUniforms = GLBI_Frame_Uniforms();
 	}
 
 	~GLBI_Engine() {}
 
-	/// Set the OpenGL Engine
-	void initGL();
+	/// Set the OpenGL Engine. loader (e.g. glfwGetProcAddress) is used for functions newer than the GL loader, may be NULL.
+	void initGL(GLADloadproc loader = NULL);
+	/// Delete the GL objects of the engine. Call it before the context is destroyed.
+	void freeGL();
 	/// Set 2D orthographic projection. Resulting virtual screen size is [xmin,ymin][xmax,ymax]
 	void set2DProjection(float xmin,float xmax,float ymin,float ymax);
 	/// Set 3D perspective projection with a \param fov and \param z_near / \param \z_far depth range
 	void set3DProjection(float fov,float ratio,float z_near,float z_far);
 	/// Set the current flat color to r,g,b. This color will remains until changed
 	void setFlatColor(float r,float g,float b);
-	/// Set the current flat color to r,g,b. This color will remains until changed
+	/// Set the view matrix (3D) and compose it with the current transformation
 	void setViewMatrix(const Matrix4D& mat);
+	/// Send the frame constants (projection, view, lights) to the GPU. One buffer write, only if changed.
+	void updateFrameUniforms();
 	/// Send current transformation to GL Engine. ids is the id of the shader to set.
 	void updateMvMatrix();
+	/// Send a given transformation to GL Engine, bypassing the matrix stack.
+	void updateMvMatrix(const Matrix4D& mat);
+	/// Set the per-instance transformation to identity for non instanced draws.
+	void resetInstanceMatrix();
+	/// Set the material index of the following non instanced draws (0, plain white, by default)
+	void setMaterial(unsigned int id_material);
 	
 	/// In 3D configuration, activate or desactivate texturing.
 	void activateTexturing(bool use_texture);
@@ -51,6 +88,12 @@ struct GLBI_Engine {
 	void setShininess(float new_shininess);
 	/// Set specular coefficient (for future rendered object)
 	void setSpecularColor(const Vector3D& c_spec);
+	/// Add a point light (world coordinates) lit through the cluster grid. No limit on their number.
+	void addPointLight(const Vector3D& position,const Vector3D& intensity,float radius);
+	/// Remove all the point lights
+	void clearPointLights();
+	/// Assign the point lights to the clusters of the current view. Call after setViewMatrix.
+	void updateLightClusters();
 
 	/// GL parameters
 	unsigned int idShader[3];
@@ -59,12 +102,31 @@ struct GLBI_Engine {
 	bool mode2D;
 	int useTexture; // 0 do not use texture. Else number of texture to use (TODO, 1 for the moment)
 	int currentShader;
+	unsigned int idFrameUBO;
+	GLBI_Frame_Uniforms frameUniforms;
+	bool frameUniformsDirty;
 
 	/// Light parameters
 	Vector3D attFactors;
 	std::vector<Vector4D> lightPos;
 	std::vector<Vector3D> lightIntensity;
 	int numberOfLight;
+
+	/// Clustered point lights
+	std::vector<GLBI_Point_Light> pointLights;
+	GLBI_Light_Clusters lightClusters;
+	Matrix4D projMatrix;
+	float zNear,zFar;
+
+	/// Colors, texture layers and shininess of the scene, indexed by the material attribute
+	GLBI_Material_Table materials;
+
+	/// Loader given to initGL, NULL if none
+	GLADloadproc procLoader;
+
+private:
+	/// Copy the light parameters in the frame uniforms
+	void storeLights();
 };
 
 }
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "tools/mesh.hpp"
+#include "tools/indexed_mesh.hpp"
+
+namespace glbasimac {
+
+/// Attribute buffers a cached mesh can have (coordinates, normals, uvs, colors)
+#define GLBI_GEOMETRY_MAX_ATTRIBUTES 4
+/// Bumped when the file layout changes : older files are then regenerated
+#define GLBI_GEOMETRY_CACHE_VERSION 1
+
+/**
+  * Identity of a generated mesh : a 64 bits FNV-1a hash of the generator name and of
+  * every parameter it depends on. Change the name (e.g. "rail/2") when the generator
+  * itself changes, so that meshes made by the old code are not reused.
+  */
+struct GLBI_Geometry_Key {
+	explicit GLBI_Geometry_Key(const char* generator) {
+		addBytes(generator,strlen(generator)+1);
+	};
+
+	GLBI_Geometry_Key& add(float v) {return addBytes(&v,sizeof(v));};
+	GLBI_Geometry_Key& add(int v) {return addBytes(&v,sizeof(v));};
+	GLBI_Geometry_Key& add(unsigned int v) {return addBytes(&v,sizeof(v));};
+
+	uint64_t value = 14695981039346656037ULL;
+
+private:
+	GLBI_Geometry_Key& addBytes(const void* data,size_t bytes) {
+		const unsigned char* p = (const unsigned char*)data;
+		for(size_t i=0;i<bytes;i++) value = (value ^ p[i])*1099511628211ULL;
+		return *this;
+	};
+};
+
+/**
+  * GPU-ready view of one mesh : non interleaved float attributes and an optional index
+  * buffer. The data belongs to the cache (file mapping or generated copy).
+  */
+struct GLBI_Geometry {
+	unsigned int gl_type = GL_TRIANGLES;
+	unsigned int nb_vertices = 0;
+	unsigned int nb_indices = 0; // 0 for a mesh drawn without indices
+	unsigned int nb_attributes = 0;
+	unsigned int attr_id[GLBI_GEOMETRY_MAX_ATTRIBUTES] = {0};
+	unsigned int attr_size[GLBI_GEOMETRY_MAX_ATTRIBUTES] = {0};
+	const float* attributes[GLBI_GEOMETRY_MAX_ATTRIBUTES] = {NULL};
+	const unsigned int* indices = NULL;
+
+	/// Upload the buffers in a new mesh with its VAO, in the formats of layout. The mesh keeps no CPU copy.
+	STP3D::StandardMesh* createStandardMesh(const STP3D::VertexLayout& layout = STP3D::VertexLayout()) const;
+	STP3D::IndexedMesh* createIndexedMesh(const STP3D::VertexLayout& layout = STP3D::VertexLayout()) const;
+};
+
+/// Mesh data made by a generator, owned until the cache is closed
+struct GLBI_Geometry_Data {
+	/// Coordinates only, dimension floats per vertex
+	GLBI_Geometry_Data(unsigned int type,std::vector<float> coords,unsigned int dimension = 3);
+	/// Copy of the CPU buffers of a mesh built by the basic_mesh functions
+	explicit GLBI_Geometry_Data(const STP3D::StandardMesh& mesh);
+	explicit GLBI_Geometry_Data(const STP3D::IndexedMesh& mesh);
+
+	GLBI_Geometry view() const;
+
+	unsigned int gl_type;
+	unsigned int nb_vertices;
+	std::vector<unsigned int> attr_id;
+	std::vector<unsigned int> attr_size;
+	std::vector<std::vector<float>> attributes;
+	std::vector<unsigned int> indices;
+};
+
+/**
+  * Binary file of meshes that only depend on constants, so that they are generated once
+  * instead of at every launch.
+  * open() memory-maps the file and indexes its meshes by key; fetch() returns the mapped
+  * mesh, or runs the generator on a miss. If anything was generated, close() writes a new
+  * file (through a temporary file and a rename) holding exactly the meshes fetched since
+  * open(), so meshes of old parameters are dropped. A file of another version, of another
+  * byte order or that fails the bound checks is ignored and replaced.
+  * Views returned by fetch() are only valid until close().
+  */
+struct GLBI_Geometry_Cache {
+	GLBI_Geometry_Cache() {};
+	~GLBI_Geometry_Cache() {
+		close();
+	};
+
+	/// Map path if it exists. Returns false if there was no usable file (all meshes will be generated)
+	bool open(const std::string& path);
+	/// Mesh stored under key, made by generate if the file does not have it
+	const GLBI_Geometry& fetch(const GLBI_Geometry_Key& key,const std::function<GLBI_Geometry_Data()>& generate);
+	/// Write the file if meshes were generated, then unmap it
+	void close();
+
+	unsigned int nb_loaded = 0;    // Meshes taken from the file since open()
+	unsigned int nb_generated = 0; // Meshes generated since open()
+
+private:
+	/// Check the file and index its meshes. False if it cannot be trusted
+	bool indexFile();
+	bool writeFile() const;
+	void unmap();
+
+	std::string file_path;
+	bool opened = false;
+	const unsigned char* mapped = NULL;
+	size_t mapped_size = 0;
+	std::vector<unsigned char> file_copy; // Used instead of a mapping where mmap is not available
+
+	std::unordered_map<uint64_t,GLBI_Geometry> file_entries;
+	std::unordered_map<uint64_t,GLBI_Geometry> used;
+	std::vector<uint64_t> used_order;
+	std::deque<GLBI_Geometry_Data> generated;
+};
+
+}
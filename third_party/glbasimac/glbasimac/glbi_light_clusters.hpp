@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include "tools/gl_tools.hpp"
+#include "tools/matrix4d.hpp"
+#include "tools/vector3d.hpp"
+
+using namespace STP3D;
+
+namespace glbasimac {
+
+/// Texture units used by the clustered lighting buffers (unit 0 is tex0)
+#define GLBI_LIGHT_DATA_UNIT 1
+#define GLBI_CLUSTER_TABLE_UNIT 2
+#define GLBI_LIGHT_INDICES_UNIT 3
+
+/// Point light with a finite range, lit through the cluster grid
+struct GLBI_Point_Light {
+	Vector3D position;  // World coordinates
+	Vector3D intensity;
+	float radius;       // No contribution beyond this distance
+};
+
+/**
+  * Clustered forward lighting.
+  * The view frustum is cut in a nx*ny*nz grid (screen tiles, exponential depth slices).
+  * Every frame, each point light is assigned on the CPU to the clusters its sphere overlaps.
+  * Lights, per-cluster ranges and light indices are sent in three texture buffers so that
+  * the Phong shader only iterates over the lights of the cluster of the fragment.
+  */
+struct GLBI_Light_Clusters {
+	GLBI_Light_Clusters(unsigned int nx = 16,unsigned int ny = 9,unsigned int nz = 24)
+		:nb_assignments(0) {
+		dims[0] = nx; dims[1] = ny; dims[2] = nz;
+		for(int i=0;i<3;i++) {id_buffer[i] = 0; id_texture[i] = 0;}
+	};
+
+	~GLBI_Light_Clusters() {
+		release();
+	};
+
+	/// Create the texture buffers. Needs a GL context.
+	void initGL();
+	/// Delete the texture buffers, if created. Call it while the context is current.
+	void release();
+	/// Assign the lights to the clusters of the given camera and upload the result
+	void build(const std::vector<GLBI_Point_Light>& lights,const Matrix4D& view,const Matrix4D& proj,
+	           float z_near,float z_far);
+	/// Bind the three texture buffers on their texture units
+	void bindTextures() const;
+
+	unsigned int nbClusters() const {return dims[0]*dims[1]*dims[2];};
+
+	// Cluster parameters and CPU copies of the GPU buffers
+	unsigned int dims[3];
+	std::vector<float> light_data;          // 2 RGBA texels per light : view position and radius, intensity
+	std::vector<unsigned int> cluster_table; // Per cluster : first index in light_indices, count
+	std::vector<unsigned int> light_indices;
+	std::vector<unsigned int> cluster_range; // Per light : x0,x1,y0,y1,z0,z1 (empty if x0 > x1)
+	unsigned int nb_assignments;            // Light/cluster pairs of the last build
+
+	// GL parameters
+	unsigned int id_buffer[3];
+	unsigned int id_texture[3];
+
+private:
+	unsigned int depthSlice(float depth,float z_near,float log_ratio) const;
+};
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include "tools/gl_tools.hpp"
+#include "tools/vector3d.hpp"
+
+using namespace STP3D;
+
+namespace glbasimac {
+
+/// Texture units of the material table (after the clustered lighting units)
+#define GLBI_MATERIAL_DATA_UNIT 4
+#define GLBI_MATERIAL_LAYERS_UNIT 5
+#define GLBI_MATERIAL_SPLAT_UNIT 6
+/// Attribute index of the material index (unsigned int, per instance or generic)
+#define GLBI_MATERIAL_ATTRIB 8
+/// Width and height of the layers of the texture array : images are resampled to it
+#define GLBI_MATERIAL_LAYER_SIZE 512
+/// Layer of a splat material : the material is read per cell from the splat map
+#define GLBI_MATERIAL_SPLAT -2
+
+/// Look of a surface : color, optional layer of the texture array, shininess (0 for the engine one)
+struct GLBI_Material_Entry {
+	Vector3D color;
+	int layer;        // -1 if not textured, GLBI_MATERIAL_SPLAT for the splat map
+	float shininess;
+};
+
+/**
+  * Materials of a scene, shared by all programs.
+  * The entries are sent in a texture buffer (2 RGBA texels per material : color and shininess,
+  * layer) and the textures are the layers of one GL_TEXTURE_2D_ARRAY, so a draw only carries
+  * a material index : a color or a texture change is no longer a state change.
+  * Material 0 is plain white, used when no index is given (generic attribute value).
+  * The splat map is a GL_R8UI texture of material indices, one texel per cell of a grid :
+  * a surface drawn with a splat material, whose texture coordinates span the grid from 0
+  * to 1, takes in each cell the color and layer of the material of the cell, with one tile
+  * of the layer per cell. Any number of surfaces is drawn in one draw call.
+  * The table is uploaded again by bindTextures() when it changed.
+  */
+struct GLBI_Material_Table {
+	GLBI_Material_Table():id_buffer(0),id_data(0),id_layers(0),id_splat(0),splat_width(0),splat_height(0),
+		dirty(true),layers_dirty(true),splat_dirty(true) {
+		entries.push_back({Vector3D(1.0,1.0,1.0),-1,0.0f});
+	};
+
+	~GLBI_Material_Table() {
+		release();
+	};
+
+	/// Create the texture buffer and the texture array. Needs a GL context.
+	void initGL();
+	/// Delete the GL objects that were created. Call it while the context is current.
+	void release();
+	/// Index of the material, added if the table does not have it yet
+	unsigned int material(const Vector3D& color,int layer = -1,float shininess = 0.0f);
+	/// Add an image (3 or 4 channels) as a new layer of the texture array. Returns the layer
+	int addLayer(unsigned int width,unsigned int height,unsigned int n_chan,const unsigned char* pixels);
+	/// Replace the splat map by width x height material indices (row y = cell y). Uploaded by bindTextures()
+	void setSplatMap(unsigned int width,unsigned int height,const std::vector<unsigned char>& cells);
+	/// Change the material of one cell : a one texel upload
+	void setSplatCell(unsigned int x,unsigned int y,unsigned char material);
+	/// Upload the table if it changed, then bind it on its texture units
+	void bindTextures();
+
+	unsigned int nbMaterials() const {return entries.size();};
+	unsigned int nbLayers() const {return layer_pixels.size()/(GLBI_MATERIAL_LAYER_SIZE*GLBI_MATERIAL_LAYER_SIZE*4);};
+
+	// CPU copies of the GPU data
+	std::vector<GLBI_Material_Entry> entries;
+	std::vector<unsigned char> layer_pixels; // RGBA layers of GLBI_MATERIAL_LAYER_SIZE squared pixels
+	std::vector<unsigned char> splat_cells;  // Material index of each cell of the splat map
+
+	// GL parameters
+	unsigned int id_buffer;
+	unsigned int id_data;
+	unsigned int id_layers;
+	unsigned int id_splat;
+
+private:
+	void upload();
+	unsigned int splat_width,splat_height;
+	bool dirty;
+	bool layers_dirty;
+	bool splat_dirty;
+};
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "glbasimac/glbi_engine.hpp"
+#include "glbasimac/glbi_convex_2D_shape.hpp"
+#include "glbasimac/glbi_ring_buffer.hpp"
+#include "tools/mesh.hpp"
+#include "tools/indexed_mesh.hpp"
+
+using namespace STP3D;
+
+namespace glbasimac {
+
+/// Words streamed per instance : world matrix (16 floats) then material index (unsigned int)
+#define GLBI_INSTANCE_STRIDE 17
+/// Initial size of one frame of the instance ring buffer, grown when needed
+#define GLBI_INSTANCE_RING_BYTES (64*1024)
+
+/// Everything the queue needs to know about the look of one draw
+struct GLBI_Material {
+	GLBI_Material(unsigned int material = 0,int shader = 0)
+		:id_material(material),idShader(shader) {};
+
+	unsigned int id_material; // Index in GLBI_Engine::materials
+	int idShader;             // Index in GLBI_Engine::idShader
+};
+
+/// GL objects needed to issue the draw call of one mesh
+struct GLBI_Draw_Source {
+	unsigned int id_vao;
+	unsigned int id_index; // 0 if the mesh is not indexed
+	unsigned int gl_type;
+	unsigned int nb_elts;  // Number of vertices, or of indices if indexed
+};
+
+struct GLBI_Draw_Item {
+	uint64_t key;
+	GLBI_Draw_Source source;
+	GLBI_Material material;
+	Matrix4D world; // Object to world transformation
+};
+
+/// Statistics of the last submitted frame
+struct GLBI_Queue_Stats {
+	unsigned int nb_items;
+	unsigned int nb_draw_calls;
+	unsigned int nb_instanced_draw_calls;
+	unsigned int nb_state_changes;         // Program and VAO changes actually issued
+	unsigned int nb_state_changes_avoided; // Versus submitting the items in recording order
+	unsigned int nb_fence_waits;           // Times the CPU waited for the GPU to release instance memory
+};
+
+/**
+  * Draws recorded without any GL call, so that several lists can be filled by different
+  * threads (one list per thread) and appended to the render queue afterwards.
+  */
+struct GLBI_Draw_List {
+	/// Remove all recorded items. Memory is kept for the next frame.
+	void clear();
+	/// Record one draw with the given material and object to world matrix
+	void addMesh(const StandardMesh& mesh,const GLBI_Material& material,const Matrix4D& world);
+	void addMesh(const IndexedMesh& mesh,const GLBI_Material& material,const Matrix4D& world);
+	void addShape(const GLBI_Convex_2D_Shape& shape,const GLBI_Material& material,const Matrix4D& world);
+
+	std::vector<GLBI_Draw_Item> items;
+
+private:
+	void addItem(const GLBI_Draw_Source& source,const GLBI_Material& material,const Matrix4D& world);
+};
+
+/**
+  * Render queue: draws are recorded during scene traversal and submitted later in one pass.
+  * Items are sorted by a packed key (program > VAO > material) so that state changes only
+  * happen when needed. Consecutive items sharing program and mesh are merged in one instanced
+  * draw whatever their material. The world matrix (attributes 4 to 7) and material index
+  * (GLBI_MATERIAL_ATTRIB) of every item are streamed through a ring buffer, so no per-object
+  * uniform, color or texture is set : the programs get the view matrix of the engine as
+  * their modelview, once per program change.
+  * Items with equal keys are drawn in recording order : append lists in a fixed order to get
+  * the same frame whatever the thread that filled them.
+  * Several views of the same items (cameras in viewports) upload the instance data once and
+  * then only issue their own draws : upload(), draw() for each view, endFrame().
+  */
+struct GLBI_Render_Queue : GLBI_Draw_List {
+	GLBI_Render_Queue() {
+		stats = {0,0,0,0,0,0};
+	};
+
+	/// Record the items of list after the ones already recorded
+	void append(const GLBI_Draw_List& list);
+	/// Sort the recorded items and draw them with the engine. Items are kept until clear().
+	/// Same as upload(), draw() and endFrame()
+	void submit(GLBI_Engine& engine);
+	/// Sort the recorded items and stream their world matrices and materials
+	void upload(GLBI_Engine& engine);
+	/// Draw the uploaded items with the current view and projection of the engine
+	void draw(GLBI_Engine& engine);
+	/// Release the instance data to the GPU : call once the last view is drawn
+	void endFrame();
+
+	const GLBI_Queue_Stats& lastFrameStats() const {return stats;};
+
+	// Queue data
+	std::vector<std::pair<uint64_t,unsigned int>> order;
+	std::vector<float> instance_data;
+	GLBI_Ring_Buffer instance_ring;
+	size_t ring_offset = 0;  // Instance data of the uploaded items
+	unsigned int nb_views = 0; // draw() calls since upload()
+	GLBI_Queue_Stats stats;
+
+private:
+	/// State changes needed to draw the items one by one in recording order
+	unsigned int countStateChanges() const;
+};
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include "tools/gl_tools.hpp"
+#include "glbasimac/glbi_stats.hpp"
+
+namespace glbasimac {
+
+/// Number of frames the GPU may lag behind the CPU (one buffer section each)
+#define GLBI_RING_SECTIONS 3
+
+/**
+  * Ring buffer for per-frame dynamic data.
+  * The buffer is cut in GLBI_RING_SECTIONS sections, one per frame in flight. A fence is
+  * set after the draws of each frame; a section is only written again once its fence
+  * has signaled, so writes never wait on the driver.
+  * If glBufferStorage can be loaded (GL 4.4 or ARB_buffer_storage), the buffer is mapped
+  * once (persistent and coherent) and written with memcpy. Otherwise each write is a
+  * glBufferSubData in a section the GPU is done with.
+  */
+struct GLBI_Ring_Buffer {
+	GLBI_Ring_Buffer():id_buffer(0),section_size(0),current(0),offset(0),mapped(NULL),persistent(false),fence_waits(0) {
+		for(int i=0;i<GLBI_RING_SECTIONS;i++) fences[i] = NULL;
+	};
+
+	~GLBI_Ring_Buffer() {
+		release();
+	};
+
+	/// Create the buffer. loader is used to find glBufferStorage (e.g. glfwGetProcAddress), may be NULL.
+	void initGL(size_t section_bytes,GLADloadproc loader);
+	/// Start a frame needing bytes bytes : move to the next section and wait for the GPU if it still reads it
+	void beginFrame(size_t bytes);
+	/// Copy data in the current section. Returns its offset in the buffer (16 bytes aligned).
+	size_t write(const void* data,size_t bytes);
+	/// Fence the current section. Call after the last draw reading it.
+	void endFrame();
+
+	unsigned int id_buffer;
+	size_t section_size;
+	unsigned int current;     // Section of the current frame
+	size_t offset;            // Bytes already written in the current section
+	unsigned char* mapped;    // Persistent mapping, NULL in glBufferSubData mode
+	bool persistent;
+	unsigned int fence_waits; // Times the last beginFrame had to wait for the GPU
+	GLsync fences[GLBI_RING_SECTIONS];
+
+private:
+	void create(size_t section_bytes);
+	void release();
+
+	typedef void (APIENTRYP Buffer_Storage_Proc)(GLenum target,GLsizeiptr size,const void* data,GLbitfield flags);
+	Buffer_Storage_Proc buffer_storage = NULL;
+};
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include "glbasimac/glbi_render_queue.hpp"
+#include "tools/matrix4d.hpp"
+
+using namespace STP3D;
+
+namespace glbasimac {
+
+/**
+  * Transform hierarchy with cached world matrices.
+  * Nodes live in flat arrays and a parent is always added before its children, so update()
+  * is one sweep in index order : a node is multiplied again only if its local transform
+  * was set since the last update or if its parent was. A static scene costs one flag test
+  * per node. Draws are attached to nodes and recorded with the world matrix of their node.
+  */
+struct GLBI_Scene_Graph {
+	/// Remove all nodes and draws
+	void clear();
+	/// Add a node under parent (-1 for a root). Returns its index
+	int addNode(int parent,const Matrix4D& local = Matrix4D());
+	/// Change the local transform of node : it and its subtree are updated by the next update()
+	void setLocal(int node,const Matrix4D& local);
+	/// Draw mesh with material at the place of node
+	void attachMesh(int node,const StandardMesh& mesh,const GLBI_Material& material);
+	void attachMesh(int node,const IndexedMesh& mesh,const GLBI_Material& material);
+	void attachShape(int node,const GLBI_Convex_2D_Shape& shape,const GLBI_Material& material);
+
+	/// Recompute the world matrices of the changed subtrees. Returns the number of nodes updated
+	unsigned int update();
+	/// True if a node of [first,last) was updated by the last update()
+	bool changed(int first,int last) const;
+	/// Record the draws [first,last) in list with the world matrix of their node
+	void record(GLBI_Draw_List& list,int first,int last) const;
+
+	int nbNodes() const {return parent.size();};
+	int nbDraws() const {return draws.items.size();};
+	const Matrix4D& world(int node) const {return world_mat[node];};
+
+	// Nodes
+	std::vector<int> parent;
+	std::vector<Matrix4D> local;
+	std::vector<Matrix4D> world_mat;
+	std::vector<unsigned char> dirty;   // Local transform set since the last update
+	std::vector<unsigned char> updated; // World matrix recomputed by the last update
+	// Draws, in the order they were attached
+	GLBI_Draw_List draws;
+	std::vector<int> draw_node;
+};
+
+/**
+  * Build a hierarchy with the matrix stack idiom : pushMatrix() opens a child node, the
+  * transformations compose the local transform of the current node and the draws are
+  * attached to it. Nodes are only created when a draw or a child needs them, and a
+  * transformation added after a draw starts a sibling node, so every draw keeps the
+  * transform it was attached with.
+  */
+struct GLBI_Scene_Builder {
+	/// Add the nodes in graph, under root (-1 for roots)
+	GLBI_Scene_Builder(GLBI_Scene_Graph& graph,int root = -1);
+
+	void pushMatrix();
+	void popMatrix();
+	void addTransformation(const Matrix4D& transfo);
+	void addTranslation(const Vector3D& trans);
+	void addRotation(float angle,const Vector3D& axe);
+	void addHomothety(float scale);
+
+	void addMesh(const StandardMesh& mesh,const GLBI_Material& material);
+	void addMesh(const IndexedMesh& mesh,const GLBI_Material& material);
+	void addShape(const GLBI_Convex_2D_Shape& shape,const GLBI_Material& material);
+	/// Node of the current transform, created if needed
+	int currentNode();
+
+private:
+	struct Frame {
+		Matrix4D local;
+		int node; // -1 until needed
+	};
+	int node(size_t level);
+
+	GLBI_Scene_Graph& graph;
+	int root;
+	std::vector<Frame> frames;
+};
+
+}
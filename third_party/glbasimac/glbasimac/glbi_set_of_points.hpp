@@ -15,6 +15,8 @@ struct GLBI_Set_Of_Points {
 	GLBI_Set_Of_Points(unsigned int dim = 2)
 		:nb_pts(0),pts(0,GL_POINTS),dimension(dim) {
 		assert((dimension == 2) || (dimension ==3));
+		// Colors are shown with 8 bits per channel anyway
+		pts.setLayout(VertexLayout().set(3,VTX_UNORM8));
 	};
 
 	~GLBI_Set_Of_Points() {
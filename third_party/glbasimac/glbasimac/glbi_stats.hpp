@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include "tools/gl_tools.hpp"
+
+namespace glbasimac {
+
+/**
+  * Work sent to GL by glbasimac since the last reset (usually one frame).
+  * Filled by the draw entry points (meshes, shapes, render queue) and the engine setters;
+  * the application resets it when a frame starts and reads it when the frame is done.
+  */
+struct GLBI_Stats {
+	unsigned int draw_calls = 0;
+	unsigned int instanced_draw_calls = 0;
+	uint64_t triangles = 0;
+	uint64_t vertices = 0;
+	unsigned int mv_uploads = 0;       // Modelview (and normal) matrix uniforms
+	unsigned int color_uploads = 0;    // Flat colors
+	unsigned int program_switches = 0;
+	unsigned int vao_binds = 0;
+	unsigned int texture_binds = 0;
+	unsigned int buffer_uploads = 0;   // Frame uniforms, light buffers, instance data
+	uint64_t buffer_bytes = 0;
+
+	void reset() {*this = GLBI_Stats();};
+
+	/// Count one draw of nb_vertices vertices (or indices) of primitive mode, nb_instances times
+	void countDraw(GLenum mode,unsigned int nb_vertices,unsigned int nb_instances = 1) {
+		draw_calls++;
+		if (nb_instances > 1) instanced_draw_calls++;
+		vertices += (uint64_t)nb_vertices*nb_instances;
+		uint64_t nb_triangles = 0;
+		if (mode == GL_TRIANGLES) nb_triangles = nb_vertices/3;
+		else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && nb_vertices > 2) nb_triangles = nb_vertices-2;
+		triangles += nb_triangles*nb_instances;
+	};
+
+	void countUpload(uint64_t bytes) {
+		buffer_uploads++;
+		buffer_bytes += bytes;
+	};
+};
+
+/// Statistics of the frame being drawn
+extern GLBI_Stats glbiStats;
+
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <cassert>
 #include "tools/gl_tools.hpp"
+#include "glbasimac/glbi_stats.hpp"
 
 using namespace STP3D;
 
@@ -13,7 +14,7 @@ struct GLBI_Texture {
 	};
 
 	~GLBI_Texture() {
-		glDeleteTextures(1,&id_in_GL);
+		if (id_in_GL) glDeleteTextures(1,&id_in_GL);
 	};
 
 	void createTexture();
@@ -32,6 +32,23 @@ namespace glbasimac {
 		}
 	}
 
+	void GLBI_Convex_2D_Shape::initShape(const GLBI_Geometry& geometry) {
+		assert(geometry.nb_attributes >= 1 && geometry.attr_id[0] == 0 && geometry.attr_size[0] == dimension);
+		// Initialised again : replace the previous buffers
+		if (shape.getIdVAO() != 0) shape.reInit();
+		coord_pts.clear();
+		nb_pts = geometry.nb_vertices;
+
+		shape.setNbElt(nb_pts);
+		shape.changeType(geometry.gl_type);
+		shape.addOneBuffer(0,dimension,const_cast<float*>(geometry.attributes[0]),"Coordinates",false);
+		if(!shape.createVAO()) {
+			std::cerr<<"Unable to create VAO for Set of Points"<<std::endl;
+			exit(1);
+		}
+		shape.releaseCPUMemory();
+	}
+
 	void GLBI_Convex_2D_Shape::changeNature(unsigned int new_gl_type) {
 		shape.changeType(new_gl_type);
 	}
@@ -6,8 +6,9 @@ using namespace STP3D;
 namespace glbasimac
 {
 
-	void GLBI_Engine::initGL()
+	void GLBI_Engine::initGL(GLADloadproc loader)
 	{
+		procLoader = loader;
 		std::cout << "Initialisation of GL Engine" << std::endl;
 
 		if (mode2D)
@@ -23,15 +24,45 @@ namespace glbasimac
 			idShader[1] = ShaderManager::loadShader("../assets/shaders/phong_shading.vert", "../assets/shaders/phong_shading.frag", true);
 		}
 		mvMatrixStack.loadIdentity();
+		resetInstanceMatrix();
+		setMaterial(0);
+		// The material table is read by every program, 2D included
+		materials.initGL();
+		materials.bindTextures();
+		for (int i = 0; i < (mode2D ? 1 : 2); i++)
+		{
+			glUseProgram(idShader[i]);
+			glUniform1i(glGetUniformLocation(idShader[i], "materialData"), GLBI_MATERIAL_DATA_UNIT);
+			glUniform1i(glGetUniformLocation(idShader[i], "materialLayers"), GLBI_MATERIAL_LAYERS_UNIT);
+			glUniform1i(glGetUniformLocation(idShader[i], "materialSplat"), GLBI_MATERIAL_SPLAT_UNIT);
+		}
 		glUseProgram(idShader[0]);
 		if (!mode2D)
 		{
+			// Projection, view and lights are shared by all programs through one uniform buffer
+			glGenBuffers(1, &idFrameUBO);
+			glBindBuffer(GL_UNIFORM_BUFFER, idFrameUBO);
+			glBufferData(GL_UNIFORM_BUFFER, sizeof(GLBI_Frame_Uniforms), NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			glBindBufferBase(GL_UNIFORM_BUFFER, GLBI_FRAME_UNIFORMS_BINDING, idFrameUBO);
+			for (int i = 0; i < 2; i++)
+			{
+				unsigned int idBlock = glGetUniformBlockIndex(idShader[i], "FrameUniforms");
+				if (idBlock != GL_INVALID_INDEX)
+					glUniformBlockBinding(idShader[i], idBlock, GLBI_FRAME_UNIFORMS_BINDING);
+			}
+			storeLights();
+			lightClusters.initGL();
+			updateLightClusters();
+			updateFrameUniforms();
+
 			glUniform1i(glGetUniformLocation(idShader[0], "use_texture"), useTexture);
 			glUseProgram(idShader[1]);
-			glUniform3fv(glGetUniformLocation(idShader[1], "attenuationFactor"), 1, attFactors);
 			glUniform1f(glGetUniformLocation(idShader[1], "shininess"), 0.0);
-			glUniform1i(glGetUniformLocation(idShader[1], "numOfLight"), numberOfLight);
 			glUniform1i(glGetUniformLocation(idShader[1], "use_texture"), useTexture);
+			glUniform1i(glGetUniformLocation(idShader[1], "lightData"), GLBI_LIGHT_DATA_UNIT);
+			glUniform1i(glGetUniformLocation(idShader[1], "clusterTable"), GLBI_CLUSTER_TABLE_UNIT);
+			glUniform1i(glGetUniformLocation(idShader[1], "lightIndices"), GLBI_LIGHT_INDICES_UNIT);
 			glUseProgram(idShader[0]);
 		}
 		else
@@ -40,23 +71,54 @@ namespace glbasimac
 		}
 	}
 
+	void GLBI_Engine::freeGL()
+	{
+		lightClusters.release();
+		materials.release();
+		if (idFrameUBO)
+			glDeleteBuffers(1, &idFrameUBO);
+		idFrameUBO = 0;
+	}
+
 	void GLBI_Engine::setFlatColor(float r, float g, float b)
 	{
 		glVertexAttrib3f(glGetAttribLocation(idShader[currentShader], "vx_col"), r, g, b);
+		glbiStats.color_uploads++;
 	}
 
 	void GLBI_Engine::updateMvMatrix()
 	{
-		glUniformMatrix4fv(glGetUniformLocation(idShader[currentShader], "modelviewMat"), 1, GL_FALSE, mvMatrixStack.getTopGLMatrix());
+		updateMvMatrix(Matrix4D(mvMatrixStack.getTopGLMatrix()));
+	}
+
+	void GLBI_Engine::updateMvMatrix(const Matrix4D &mat)
+	{
+		glUniformMatrix4fv(glGetUniformLocation(idShader[currentShader], "modelviewMat"), 1, GL_FALSE, mat.mat);
+		glbiStats.mv_uploads++;
 		if (!mode2D)
 		{
-			Matrix4D nmlMatrix = mvMatrixStack.getTopGLMatrix();
+			Matrix4D nmlMatrix = mat;
 			nmlMatrix.invert();
 			nmlMatrix.transpose();
 			glUniformMatrix4fv(glGetUniformLocation(idShader[currentShader], "normalMat"), 1, GL_FALSE, nmlMatrix);
 		}
 	}
 
+	void GLBI_Engine::resetInstanceMatrix()
+	{
+		// Generic attribute values are used when the instance array is disabled
+		glVertexAttrib4f(GLBI_INSTANCE_MATRIX_ATTRIB, 1.0, 0.0, 0.0, 0.0);
+		glVertexAttrib4f(GLBI_INSTANCE_MATRIX_ATTRIB + 1, 0.0, 1.0, 0.0, 0.0);
+		glVertexAttrib4f(GLBI_INSTANCE_MATRIX_ATTRIB + 2, 0.0, 0.0, 1.0, 0.0);
+		glVertexAttrib4f(GLBI_INSTANCE_MATRIX_ATTRIB + 3, 0.0, 0.0, 0.0, 1.0);
+	}
+
+	void GLBI_Engine::setMaterial(unsigned int id_material)
+	{
+		// Integer generic value, used when the material array is disabled
+		glVertexAttribI4ui(GLBI_MATERIAL_ATTRIB, id_material, 0, 0, 0);
+	}
+
 	void GLBI_Engine::set2DProjection(float xmin, float xmax, float ymin, float ymax)
 	{
 		Matrix4D proj = Matrix4D::ortho2D(xmin, xmax, ymin, ymax);
@@ -66,29 +128,76 @@ namespace glbasimac
 	void GLBI_Engine::set3DProjection(float fov, float ratio, float z_near, float z_far)
 	{
 		Matrix4D proj = Matrix4D::perspective(fov, ratio, z_near, z_far);
-		glUseProgram(idShader[0]);
-		glUniformMatrix4fv(glGetUniformLocation(idShader[0], "projectionMat"), 1, GL_FALSE, proj);
-		if (!mode2D)
+		if (mode2D)
 		{
-			glUseProgram(idShader[1]);
-			glUniformMatrix4fv(glGetUniformLocation(idShader[1], "projectionMat"), 1, GL_FALSE, proj);
-			glUseProgram(idShader[currentShader]);
+			glUniformMatrix4fv(glGetUniformLocation(idShader[currentShader], "projectionMat"), 1, GL_FALSE, proj);
+			return;
 		}
+		projMatrix = proj;
+		zNear = z_near;
+		zFar = z_far;
+		proj.get(frameUniforms.projectionMat);
+		frameUniformsDirty = true;
 	}
 
 	void GLBI_Engine::setViewMatrix(const Matrix4D &mat)
 	{
 		viewMatrix = mat;
-		// Mettre le uniform dans le shader correspondant.
+		// Sent with the other frame constants by updateFrameUniforms
 		if (!mode2D)
 		{
-			glUseProgram(idShader[1]);
-			glUniformMatrix4fv(glGetUniformLocation(idShader[1], "viewMatrix"), 1, GL_FALSE, viewMatrix);
-			glUseProgram(idShader[currentShader]);
+			viewMatrix.get(frameUniforms.viewMatrix);
+			frameUniformsDirty = true;
 		}
 		mvMatrixStack.addTransformation(mat);
 	}
 
+	void GLBI_Engine::updateFrameUniforms()
+	{
+		if (mode2D || !frameUniformsDirty)
+			return;
+		glBindBuffer(GL_UNIFORM_BUFFER, idFrameUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GLBI_Frame_Uniforms), &frameUniforms);
+		glbiStats.countUpload(sizeof(GLBI_Frame_Uniforms));
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		frameUniformsDirty = false;
+	}
+
+	void GLBI_Engine::updateLightClusters()
+	{
+		if (mode2D)
+			return;
+		lightClusters.build(pointLights, viewMatrix, projMatrix, zNear, zFar);
+		lightClusters.bindTextures();
+
+		int viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		frameUniforms.clusterDepth[0] = zNear;
+		frameUniforms.clusterDepth[1] = zFar;
+		frameUniforms.clusterDepth[2] = std::log(zFar / zNear);
+		for (int i = 0; i < 4; i++)
+			frameUniforms.clusterViewport[i] = viewport[i];
+		for (int i = 0; i < 3; i++)
+			frameUniforms.clusterDims[i] = lightClusters.dims[i];
+		frameUniforms.clusterDims[3] = pointLights.size();
+		frameUniformsDirty = true;
+	}
+
+	void GLBI_Engine::storeLights()
+	{
+		for (int i = 0; i < numberOfLight && i < GLBI_MAX_LIGHTS; i++)
+		{
+			for (int j = 0; j < 4; j++)
+				frameUniforms.lightPos[i][j] = lightPos[i][j];
+			for (int j = 0; j < 3; j++)
+				frameUniforms.lightIntensity[i][j] = lightIntensity[i][j];
+		}
+		for (int j = 0; j < 3; j++)
+			frameUniforms.attenuationFactor[j] = attFactors[j];
+		frameUniforms.numOfLight = numberOfLight < GLBI_MAX_LIGHTS ? numberOfLight : GLBI_MAX_LIGHTS;
+		frameUniformsDirty = true;
+	}
+
 	void GLBI_Engine::activateTexturing(bool use_texture)
 	{
 		useTexture = use_texture;
@@ -108,6 +217,7 @@ namespace glbasimac
 	{
 		currentShader = 0;
 		glUseProgram(idShader[0]);
+		glbiStats.program_switches++;
 	}
 
 	void GLBI_Engine::switchToPhongShading()
@@ -120,37 +230,38 @@ namespace glbasimac
 		{
 			currentShader = 1;
 			glUseProgram(idShader[1]);
+			glbiStats.program_switches++;
 		}
 	}
 
 	void GLBI_Engine::setLightPosition(const Vector4D &light_pos, int num_light)
 	{
-		if (mode2D || currentShader == 0)
+		if (mode2D)
 		{
-			std::cerr << "Unable to set light position in 2D mode or in Flat shading" << std::endl;
+			std::cerr << "Unable to set light position in 2D mode" << std::endl;
 		}
 		else
 		{
 			if (num_light < numberOfLight)
 			{
 				lightPos[num_light] = light_pos;
-				glUniform4fv(glGetUniformLocation(idShader[currentShader], "lightPos"), numberOfLight, &lightPos[0][0]);
+				storeLights();
 			}
 		}
 	}
 
 	void GLBI_Engine::setLightIntensity(const Vector3D &light_intensity, int num_light)
 	{
-		if (mode2D || currentShader == 0)
+		if (mode2D)
 		{
-			std::cerr << "Unable to set light position in 2D mode or in Flat shading" << std::endl;
+			std::cerr << "Unable to set light intensity in 2D mode" << std::endl;
 		}
 		else
 		{
 			if (num_light < numberOfLight)
 			{
 				lightIntensity[num_light] = light_intensity;
-				glUniform3fv(glGetUniformLocation(idShader[currentShader], "lightIntensity"), numberOfLight, &lightIntensity[0][0]);
+				storeLights();
 			}
 		}
 	}
@@ -169,14 +280,14 @@ namespace glbasimac
 
 	void GLBI_Engine::setAttenuationFactor(const Vector3D &factors)
 	{
-		if (mode2D || currentShader == 0)
+		if (mode2D)
 		{
-			std::cerr << "Unable to set light position in 2D mode or in Flat shading" << std::endl;
+			std::cerr << "Unable to set attenuation factor in 2D mode" << std::endl;
 		}
 		else
 		{
 			attFactors = factors;
-			glUniform3fv(glGetUniformLocation(idShader[1], "attenuationFactor"), 1, attFactors);
+			storeLights();
 		}
 	}
 
@@ -186,17 +297,36 @@ namespace glbasimac
 		{
 			std::cerr << "Unable to add light in 2D mode" << std::endl;
 		}
+		else if (numberOfLight >= GLBI_MAX_LIGHTS)
+		{
+			std::cerr << "Unable to add more than " << GLBI_MAX_LIGHTS << " lights" << std::endl;
+		}
 		else
 		{
 			numberOfLight++;
 			lightPos.push_back(light_pos);
 			lightIntensity.push_back(light_intensity);
-			glUseProgram(idShader[1]);
-			glUniform1i(glGetUniformLocation(idShader[1], "numOfLight"), numberOfLight);
-			glUseProgram(idShader[currentShader]);
+			storeLights();
+		}
+	}
+
+	void GLBI_Engine::addPointLight(const Vector3D &position, const Vector3D &intensity, float radius)
+	{
+		if (mode2D)
+		{
+			std::cerr << "Unable to add point light in 2D mode" << std::endl;
+		}
+		else
+		{
+			pointLights.push_back({position, intensity, radius});
 		}
 	}
 
+	void GLBI_Engine::clearPointLights()
+	{
+		pointLights.clear();
+	}
+
 	void GLBI_Engine::setShininess(float new_shininess)
 	{
 		if (mode2D || currentShader == 0)
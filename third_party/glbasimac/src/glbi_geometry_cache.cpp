@@ -0,0 +1,330 @@
+#include "glbasimac/glbi_geometry_cache.hpp"
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GLBI_HAS_MMAP
+#endif
+
+using namespace STP3D;
+
+namespace glbasimac {
+
+	/// File layout : header, table of entries, then the buffers (16 bytes aligned)
+	static const char CACHE_MAGIC[8] = "GLBIGEO";
+	/// Written as is : a file made on a machine of the other byte order reads differently
+	static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+	struct Cache_Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t nb_entries;
+		uint32_t reserved;
+	};
+
+	struct Cache_Entry {
+		uint64_t key;
+		uint32_t gl_type;
+		uint32_t nb_vertices;
+		uint32_t nb_indices;
+		uint32_t nb_attributes;
+		uint32_t attr_id[GLBI_GEOMETRY_MAX_ATTRIBUTES];
+		uint32_t attr_size[GLBI_GEOMETRY_MAX_ATTRIBUTES];
+		uint64_t attr_offset[GLBI_GEOMETRY_MAX_ATTRIBUTES];
+		uint64_t index_offset;
+	};
+
+	static uint64_t align16(uint64_t offset) {
+		return (offset+15) & ~(uint64_t)15;
+	}
+
+	static const char* semanticOf(unsigned int id) {
+		switch(id) {
+			case 0: return "coordinates";
+			case 1: return "normals";
+			case 2: return "uvs";
+			case 3: return "colors";
+			default: return "attribute";
+		}
+	}
+
+	static unsigned int indicesPerPrimitive(unsigned int gl_type) {
+		if (gl_type == GL_POINTS) return 1;
+		if (gl_type == GL_LINES) return 2;
+		return 3;
+	}
+
+	/*****************************************************************
+	 *                      GEOMETRY AND DATA
+	 *****************************************************************/
+
+	StandardMesh* GLBI_Geometry::createStandardMesh(const VertexLayout& layout) const {
+		assert(nb_indices == 0);
+		StandardMesh* mesh = new StandardMesh(nb_vertices,gl_type);
+		mesh->setLayout(layout);
+		for(unsigned int i=0;i<nb_attributes;i++) {
+			mesh->addOneBuffer(attr_id[i],attr_size[i],const_cast<float*>(attributes[i]),semanticOf(attr_id[i]),false);
+		}
+		mesh->createVAO();
+		// Buffers are not copied : only forget the pointers
+		mesh->releaseCPUMemory();
+		return mesh;
+	}
+
+	IndexedMesh* GLBI_Geometry::createIndexedMesh(const VertexLayout& layout) const {
+		assert(nb_indices > 0);
+		IndexedMesh* mesh = new IndexedMesh(nb_indices/indicesPerPrimitive(gl_type),nb_vertices,gl_type);
+		mesh->setLayout(layout);
+		for(unsigned int i=0;i<nb_attributes;i++) {
+			mesh->addOneBuffer(attr_id[i],attr_size[i],const_cast<float*>(attributes[i]),semanticOf(attr_id[i]),false);
+		}
+		mesh->addIndexBuffer(const_cast<unsigned int*>(indices),false);
+		mesh->createVAO();
+		// The mesh would delete[] these pointers : they belong to the cache
+		for(unsigned int i=0;i<mesh->buffers.size();i++) mesh->buffers[i] = NULL;
+		mesh->index_buffer = NULL;
+		return mesh;
+	}
+
+	GLBI_Geometry_Data::GLBI_Geometry_Data(unsigned int type,std::vector<float> coords,unsigned int dimension)
+		:gl_type(type),nb_vertices(coords.size()/dimension) {
+		attr_id.push_back(0);
+		attr_size.push_back(dimension);
+		attributes.push_back(std::move(coords));
+	}
+
+	GLBI_Geometry_Data::GLBI_Geometry_Data(const StandardMesh& mesh)
+		:gl_type(mesh.getType()),nb_vertices(mesh.getNbElt()) {
+		for(unsigned int i=0;i<mesh.getNbBuffers();i++) {
+			const float* data = mesh.getBuffer(i);
+			attr_id.push_back(mesh.getAttributeId(i));
+			attr_size.push_back(mesh.getEltSize(i));
+			attributes.emplace_back(data,data+nb_vertices*mesh.getEltSize(i));
+		}
+	}
+
+	GLBI_Geometry_Data::GLBI_Geometry_Data(const IndexedMesh& mesh)
+		:gl_type(mesh.gl_type_mesh),nb_vertices(mesh.nb_elts) {
+		for(unsigned int i=0;i<mesh.buffers.size();i++) {
+			const float* data = mesh.buffers[i];
+			attr_id.push_back(mesh.attr_id[i]);
+			attr_size.push_back(mesh.size_one_elt[i]);
+			attributes.emplace_back(data,data+nb_vertices*mesh.size_one_elt[i]);
+		}
+		indices.assign(mesh.index_buffer,mesh.index_buffer+mesh.getNbIndex());
+	}
+
+	GLBI_Geometry GLBI_Geometry_Data::view() const {
+		assert(attributes.size() <= GLBI_GEOMETRY_MAX_ATTRIBUTES);
+		GLBI_Geometry geometry;
+		geometry.gl_type = gl_type;
+		geometry.nb_vertices = nb_vertices;
+		geometry.nb_indices = indices.size();
+		geometry.nb_attributes = attributes.size();
+		for(unsigned int i=0;i<attributes.size();i++) {
+			geometry.attr_id[i] = attr_id[i];
+			geometry.attr_size[i] = attr_size[i];
+			geometry.attributes[i] = attributes[i].data();
+		}
+		geometry.indices = indices.empty() ? NULL : indices.data();
+		return geometry;
+	}
+
+	/*****************************************************************
+	 *                      CACHE FILE
+	 *****************************************************************/
+
+	bool GLBI_Geometry_Cache::open(const std::string& path) {
+		close();
+		file_path = path;
+		opened = true;
+		nb_loaded = nb_generated = 0;
+
+#ifdef GLBI_HAS_MMAP
+		int fd = ::open(path.c_str(),O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		if (fstat(fd,&info) == 0 && info.st_size > 0) {
+			void* address = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+			if (address != MAP_FAILED) {
+				mapped = (const unsigned char*)address;
+				mapped_size = info.st_size;
+			}
+		}
+		// The mapping stays valid once the descriptor is closed
+		::close(fd);
+#else
+		std::ifstream file(path,std::ios::binary);
+		if (!file) return false;
+		file_copy.assign(std::istreambuf_iterator<char>(file),std::istreambuf_iterator<char>());
+		mapped = file_copy.data();
+		mapped_size = file_copy.size();
+#endif
+		if (!mapped) return false;
+
+		if (!indexFile()) {
+			std::cerr<<"Geometry cache "<<path<<" is outdated or damaged : it will be rebuilt"<<std::endl;
+			file_entries.clear();
+			unmap();
+			return false;
+		}
+		return true;
+	}
+
+	bool GLBI_Geometry_Cache::indexFile() {
+		if (mapped_size < sizeof(Cache_Header)) return false;
+		Cache_Header header;
+		memcpy(&header,mapped,sizeof(header));
+		if (memcmp(header.magic,CACHE_MAGIC,sizeof(CACHE_MAGIC)) != 0 || header.version != GLBI_GEOMETRY_CACHE_VERSION ||
+		    header.byte_order != CACHE_BYTE_ORDER) {
+			return false;
+		}
+		if (header.nb_entries > (mapped_size-sizeof(Cache_Header))/sizeof(Cache_Entry)) return false;
+
+		const unsigned char* table = mapped+sizeof(Cache_Header);
+		for(uint32_t e=0;e<header.nb_entries;e++) {
+			Cache_Entry entry;
+			memcpy(&entry,table+e*sizeof(Cache_Entry),sizeof(entry));
+			if (entry.nb_attributes == 0 || entry.nb_attributes > GLBI_GEOMETRY_MAX_ATTRIBUTES) return false;
+
+			GLBI_Geometry geometry;
+			geometry.gl_type = entry.gl_type;
+			geometry.nb_vertices = entry.nb_vertices;
+			geometry.nb_indices = entry.nb_indices;
+			geometry.nb_attributes = entry.nb_attributes;
+			for(uint32_t i=0;i<entry.nb_attributes;i++) {
+				uint64_t bytes = (uint64_t)entry.nb_vertices*entry.attr_size[i]*sizeof(float);
+				if (entry.attr_size[i] == 0 || entry.attr_size[i] > 4 || entry.attr_offset[i]%16 != 0 ||
+				    entry.attr_offset[i] > mapped_size || bytes > mapped_size-entry.attr_offset[i]) {
+					return false;
+				}
+				geometry.attr_id[i] = entry.attr_id[i];
+				geometry.attr_size[i] = entry.attr_size[i];
+				geometry.attributes[i] = (const float*)(mapped+entry.attr_offset[i]);
+			}
+			if (entry.nb_indices > 0) {
+				uint64_t bytes = (uint64_t)entry.nb_indices*sizeof(unsigned int);
+				if (entry.index_offset%16 != 0 || entry.index_offset > mapped_size || bytes > mapped_size-entry.index_offset) {
+					return false;
+				}
+				geometry.indices = (const unsigned int*)(mapped+entry.index_offset);
+				// An index out of the vertex buffers would make the GPU read anywhere
+				for(uint32_t i=0;i<entry.nb_indices;i++) {
+					if (geometry.indices[i] >= entry.nb_vertices) return false;
+				}
+			}
+			file_entries[entry.key] = geometry;
+		}
+		return true;
+	}
+
+	const GLBI_Geometry& GLBI_Geometry_Cache::fetch(const GLBI_Geometry_Key& key,const std::function<GLBI_Geometry_Data()>& generate) {
+		auto found = used.find(key.value);
+		if (found != used.end()) return found->second;
+
+		used_order.push_back(key.value);
+		auto in_file = file_entries.find(key.value);
+		if (in_file != file_entries.end()) {
+			nb_loaded++;
+			return used.emplace(key.value,in_file->second).first->second;
+		}
+		generated.push_back(generate());
+		nb_generated++;
+		return used.emplace(key.value,generated.back().view()).first->second;
+	}
+
+	bool GLBI_Geometry_Cache::writeFile() const {
+		Cache_Header header;
+		memcpy(header.magic,CACHE_MAGIC,sizeof(CACHE_MAGIC));
+		header.version = GLBI_GEOMETRY_CACHE_VERSION;
+		header.byte_order = CACHE_BYTE_ORDER;
+		header.nb_entries = used_order.size();
+		header.reserved = 0;
+
+		// Place the buffers after the table
+		std::vector<Cache_Entry> table(used_order.size());
+		uint64_t offset = align16(sizeof(Cache_Header)+table.size()*sizeof(Cache_Entry));
+		for(size_t e=0;e<used_order.size();e++) {
+			const GLBI_Geometry& geometry = used.at(used_order[e]);
+			Cache_Entry& entry = table[e];
+			memset(&entry,0,sizeof(entry));
+			entry.key = used_order[e];
+			entry.gl_type = geometry.gl_type;
+			entry.nb_vertices = geometry.nb_vertices;
+			entry.nb_indices = geometry.nb_indices;
+			entry.nb_attributes = geometry.nb_attributes;
+			for(unsigned int i=0;i<geometry.nb_attributes;i++) {
+				entry.attr_id[i] = geometry.attr_id[i];
+				entry.attr_size[i] = geometry.attr_size[i];
+				entry.attr_offset[i] = offset;
+				offset = align16(offset+(uint64_t)geometry.nb_vertices*geometry.attr_size[i]*sizeof(float));
+			}
+			if (geometry.nb_indices > 0) {
+				entry.index_offset = offset;
+				offset = align16(offset+(uint64_t)geometry.nb_indices*sizeof(unsigned int));
+			}
+		}
+
+		// A file mapped by another run stays valid : the new one replaces it with a rename
+		std::string tmp_path = file_path+".tmp";
+		std::ofstream file(tmp_path,std::ios::binary);
+		if (!file) return false;
+		static const char padding[16] = {0};
+		auto pad = [&]() {
+			file.write(padding,align16(file.tellp())-(uint64_t)file.tellp());
+		};
+		file.write((const char*)&header,sizeof(header));
+		file.write((const char*)table.data(),table.size()*sizeof(Cache_Entry));
+		pad();
+		for(uint64_t key : used_order) {
+			const GLBI_Geometry& geometry = used.at(key);
+			for(unsigned int i=0;i<geometry.nb_attributes;i++) {
+				file.write((const char*)geometry.attributes[i],(size_t)geometry.nb_vertices*geometry.attr_size[i]*sizeof(float));
+				pad();
+			}
+			if (geometry.nb_indices > 0) {
+				file.write((const char*)geometry.indices,(size_t)geometry.nb_indices*sizeof(unsigned int));
+				pad();
+			}
+		}
+		file.close();
+		if (!file || std::rename(tmp_path.c_str(),file_path.c_str()) != 0) {
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void GLBI_Geometry_Cache::close() {
+		if (!opened) return;
+		// Meshes read from the file are written again from the mapping : write before unmapping
+		if (nb_generated > 0 && !writeFile()) {
+			std::cerr<<"Unable to write the geometry cache "<<file_path<<std::endl;
+		}
+		std::cerr<<"Geometry cache "<<file_path<<" : "<<nb_loaded<<" meshes loaded, "<<nb_generated<<" generated"<<std::endl;
+		unmap();
+		file_entries.clear();
+		used.clear();
+		used_order.clear();
+		generated.clear();
+		opened = false;
+	}
+
+	void GLBI_Geometry_Cache::unmap() {
+#ifdef GLBI_HAS_MMAP
+		if (mapped) munmap((void*)mapped,mapped_size);
+#endif
+		file_copy.clear();
+		mapped = NULL;
+		mapped_size = 0;
+	}
+
+}
@@ -0,0 +1,138 @@
+#include "glbasimac/glbi_light_clusters.hpp"
+#include "tools/vector4d.hpp"
+#include "glbasimac/glbi_stats.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace glbasimac {
+
+	void GLBI_Light_Clusters::initGL() {
+		const GLenum formats[3] = {GL_RGBA32F,GL_RG32UI,GL_R32UI};
+		glGenBuffers(3,id_buffer);
+		glGenTextures(3,id_texture);
+		for(int i=0;i<3;i++) {
+			if (id_buffer[i] == 0 || id_texture[i] == 0) {
+				std::cerr<<"Unable to create the light cluster buffers. Exiting"<<std::endl;
+				exit(1);
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER,id_buffer[i]);
+			glBufferData(GL_TEXTURE_BUFFER,0,NULL,GL_STREAM_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER,id_texture[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER,formats[i],id_buffer[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER,0);
+		glBindBuffer(GL_TEXTURE_BUFFER,0);
+	}
+
+	void GLBI_Light_Clusters::release() {
+		if (id_texture[0]) glDeleteTextures(3,id_texture);
+		if (id_buffer[0]) glDeleteBuffers(3,id_buffer);
+		for(int i=0;i<3;i++) {id_buffer[i] = 0; id_texture[i] = 0;}
+	}
+
+	unsigned int GLBI_Light_Clusters::depthSlice(float depth,float z_near,float log_ratio) const {
+		if (depth <= z_near) return 0;
+		int slice = (int)(std::log(depth/z_near)/log_ratio*dims[2]);
+		return (unsigned int)std::min(std::max(slice,0),(int)dims[2]-1);
+	}
+
+	/// Tile range [t0,t1] covered by the NDC interval [ndc_min,ndc_max]. False if outside the screen.
+	static bool tileRange(float ndc_min,float ndc_max,unsigned int nb_tiles,unsigned int& t0,unsigned int& t1) {
+		if (ndc_max < -1.0f || ndc_min > 1.0f) return false;
+		int first = (int)std::floor((ndc_min+1.0f)*0.5f*nb_tiles);
+		int last = (int)std::floor((ndc_max+1.0f)*0.5f*nb_tiles);
+		t0 = (unsigned int)std::min(std::max(first,0),(int)nb_tiles-1);
+		t1 = (unsigned int)std::min(std::max(last,0),(int)nb_tiles-1);
+		return true;
+	}
+
+	void GLBI_Light_Clusters::build(const std::vector<GLBI_Point_Light>& lights,const Matrix4D& view,const Matrix4D& proj,
+	                                float z_near,float z_far) {
+		const float log_ratio = std::log(z_far/z_near);
+		light_data.resize(lights.size()*8);
+		cluster_range.resize(lights.size()*6);
+		cluster_table.assign(nbClusters()*2,0);
+
+		// First pass : view space position and cluster range of each light, count per cluster
+		for(size_t i=0;i<lights.size();i++) {
+			const GLBI_Point_Light& light = lights[i];
+			Vector4D p = view*Vector4D(light.position,1.0f);
+			float r = light.radius;
+			float* data = &light_data[8*i];
+			data[0] = p.x; data[1] = p.y; data[2] = p.z; data[3] = r;
+			data[4] = light.intensity.x; data[5] = light.intensity.y; data[6] = light.intensity.z; data[7] = 0.0f;
+
+			unsigned int* range = &cluster_range[6*i];
+			range[0] = 1; range[1] = 0; // Empty until proven visible
+			float depth_min = -p.z-r;
+			float depth_max = -p.z+r;
+			if (depth_max < z_near || depth_min > z_far) continue;
+
+			unsigned int x0 = 0,x1 = dims[0]-1,y0 = 0,y1 = dims[1]-1;
+			if (depth_min > z_near) {
+				// Whole bounding box in front of the camera : its projected corners bound the sphere
+				float min_x = 1e30f,max_x = -1e30f,min_y = 1e30f,max_y = -1e30f;
+				for(int c=0;c<8;c++) {
+					Vector4D clip = proj*Vector4D(p.x+((c&1)?r:-r),p.y+((c&2)?r:-r),p.z+((c&4)?r:-r),1.0f);
+					float ndc_x = clip.x/clip.w;
+					float ndc_y = clip.y/clip.w;
+					min_x = std::min(min_x,ndc_x); max_x = std::max(max_x,ndc_x);
+					min_y = std::min(min_y,ndc_y); max_y = std::max(max_y,ndc_y);
+				}
+				if (!tileRange(min_x,max_x,dims[0],x0,x1) || !tileRange(min_y,max_y,dims[1],y0,y1)) continue;
+			}
+			range[0] = x0; range[1] = x1; range[2] = y0; range[3] = y1;
+			range[4] = depthSlice(std::max(depth_min,z_near),z_near,log_ratio);
+			range[5] = depthSlice(std::min(depth_max,z_far),z_near,log_ratio);
+			for(unsigned int z=range[4];z<=range[5];z++)
+				for(unsigned int y=y0;y<=y1;y++)
+					for(unsigned int x=x0;x<=x1;x++)
+						cluster_table[2*(x+dims[0]*(y+dims[1]*z))+1]++;
+		}
+
+		// Offsets of each cluster in the index list
+		nb_assignments = 0;
+		for(unsigned int c=0;c<nbClusters();c++) {
+			cluster_table[2*c] = nb_assignments;
+			nb_assignments += cluster_table[2*c+1];
+			cluster_table[2*c+1] = 0;
+		}
+
+		// Second pass : fill the index list
+		light_indices.resize(nb_assignments);
+		for(size_t i=0;i<lights.size();i++) {
+			const unsigned int* range = &cluster_range[6*i];
+			if (range[0] > range[1]) continue;
+			for(unsigned int z=range[4];z<=range[5];z++)
+				for(unsigned int y=range[2];y<=range[3];y++)
+					for(unsigned int x=range[0];x<=range[1];x++) {
+						unsigned int c = x+dims[0]*(y+dims[1]*z);
+						light_indices[cluster_table[2*c]+cluster_table[2*c+1]++] = i;
+					}
+		}
+
+		// Upload (buffers are orphaned every frame)
+		glBindBuffer(GL_TEXTURE_BUFFER,id_buffer[0]);
+		glBufferData(GL_TEXTURE_BUFFER,light_data.size()*sizeof(float),light_data.data(),GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER,id_buffer[1]);
+		glBufferData(GL_TEXTURE_BUFFER,cluster_table.size()*sizeof(unsigned int),cluster_table.data(),GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER,id_buffer[2]);
+		glBufferData(GL_TEXTURE_BUFFER,light_indices.size()*sizeof(unsigned int),light_indices.data(),GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER,0);
+		glbiStats.countUpload(light_data.size()*sizeof(float));
+		glbiStats.countUpload(cluster_table.size()*sizeof(unsigned int));
+		glbiStats.countUpload(light_indices.size()*sizeof(unsigned int));
+	}
+
+	void GLBI_Light_Clusters::bindTextures() const {
+		glActiveTexture(GL_TEXTURE0+GLBI_LIGHT_DATA_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER,id_texture[0]);
+		glActiveTexture(GL_TEXTURE0+GLBI_CLUSTER_TABLE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER,id_texture[1]);
+		glActiveTexture(GL_TEXTURE0+GLBI_LIGHT_INDICES_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER,id_texture[2]);
+		glActiveTexture(GL_TEXTURE0);
+		glbiStats.texture_binds += 3;
+	}
+
+}
@@ -0,0 +1,185 @@
+#include "glbasimac/glbi_material_table.hpp"
+#include "glbasimac/glbi_stats.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace glbasimac {
+
+	void GLBI_Material_Table::initGL() {
+		glGenBuffers(1,&id_buffer);
+		glGenTextures(1,&id_data);
+		glGenTextures(1,&id_layers);
+		glGenTextures(1,&id_splat);
+		if (id_buffer == 0 || id_data == 0 || id_layers == 0 || id_splat == 0) {
+			std::cerr<<"Unable to create the material table. Exiting"<<std::endl;
+			exit(1);
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER,id_buffer);
+		glBufferData(GL_TEXTURE_BUFFER,0,NULL,GL_STATIC_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER,id_data);
+		glTexBuffer(GL_TEXTURE_BUFFER,GL_RGBA32F,id_buffer);
+		glBindTexture(GL_TEXTURE_BUFFER,0);
+		glBindBuffer(GL_TEXTURE_BUFFER,0);
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY,id_layers);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,GL_REPEAT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+
+		// Integer texture : no filtering, each cell is one material
+		glBindTexture(GL_TEXTURE_2D,id_splat);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D,0);
+		dirty = layers_dirty = splat_dirty = true;
+	}
+
+	void GLBI_Material_Table::release() {
+		if (id_data) glDeleteTextures(1,&id_data);
+		if (id_layers) glDeleteTextures(1,&id_layers);
+		if (id_splat) glDeleteTextures(1,&id_splat);
+		if (id_buffer) glDeleteBuffers(1,&id_buffer);
+		id_buffer = id_data = id_layers = id_splat = 0;
+	}
+
+	unsigned int GLBI_Material_Table::material(const Vector3D& color,int layer,float shininess) {
+		for(size_t i=0;i<entries.size();i++) {
+			const GLBI_Material_Entry& e = entries[i];
+			if (e.color.x == color.x && e.color.y == color.y && e.color.z == color.z &&
+			    e.layer == layer && e.shininess == shininess) return i;
+		}
+		entries.push_back({color,layer,shininess});
+		dirty = true;
+		return entries.size()-1;
+	}
+
+	/// Bilinear resampling of an image to a RGBA layer (missing alpha is opaque)
+	static void resampleLayer(unsigned int w,unsigned int h,unsigned int n_chan,const unsigned char* src,unsigned char* dst) {
+		const unsigned int S = GLBI_MATERIAL_LAYER_SIZE;
+		for(unsigned int y=0;y<S;y++) {
+			float fy = std::max((y+0.5f)*h/S-0.5f,0.0f);
+			unsigned int y0 = std::min((unsigned int)fy,h-1);
+			unsigned int y1 = std::min(y0+1,h-1);
+			float ty = fy-y0;
+			for(unsigned int x=0;x<S;x++) {
+				float fx = std::max((x+0.5f)*w/S-0.5f,0.0f);
+				unsigned int x0 = std::min((unsigned int)fx,w-1);
+				unsigned int x1 = std::min(x0+1,w-1);
+				float tx = fx-x0;
+				unsigned char* out = dst+4*(y*S+x);
+				for(unsigned int c=0;c<4;c++) {
+					if (c >= n_chan) {out[c] = 255; continue;}
+					float top = src[n_chan*(y0*w+x0)+c]*(1.0f-tx)+src[n_chan*(y0*w+x1)+c]*tx;
+					float bottom = src[n_chan*(y1*w+x0)+c]*(1.0f-tx)+src[n_chan*(y1*w+x1)+c]*tx;
+					out[c] = (unsigned char)(top*(1.0f-ty)+bottom*ty+0.5f);
+				}
+			}
+		}
+	}
+
+	int GLBI_Material_Table::addLayer(unsigned int width,unsigned int height,unsigned int n_chan,const unsigned char* pixels) {
+		if (n_chan != 3 && n_chan != 4) {
+			std::cerr<<"Unable to add a "<<n_chan<<" channels image to the material layers"<<std::endl;
+			return -1;
+		}
+		const size_t layer_bytes = GLBI_MATERIAL_LAYER_SIZE*GLBI_MATERIAL_LAYER_SIZE*4;
+		int layer = nbLayers();
+		layer_pixels.resize(layer_pixels.size()+layer_bytes);
+		resampleLayer(width,height,n_chan,pixels,&layer_pixels[layer*layer_bytes]);
+		layers_dirty = true;
+		return layer;
+	}
+
+	void GLBI_Material_Table::setSplatMap(unsigned int width,unsigned int height,const std::vector<unsigned char>& cells) {
+		if (cells.size() != (size_t)width*height) {
+			std::cerr<<"Unable to set a splat map of "<<width<<"x"<<height<<" from "<<cells.size()<<" cells"<<std::endl;
+			return;
+		}
+		splat_width = width;
+		splat_height = height;
+		splat_cells = cells;
+		splat_dirty = true;
+	}
+
+	void GLBI_Material_Table::setSplatCell(unsigned int x,unsigned int y,unsigned char material) {
+		if (x >= splat_width || y >= splat_height) return;
+		splat_cells[(size_t)y*splat_width+x] = material;
+		// Before the first upload, the whole map is sent anyway
+		if (splat_dirty || id_splat == 0) return;
+		glActiveTexture(GL_TEXTURE0+GLBI_MATERIAL_SPLAT_UNIT);
+		glBindTexture(GL_TEXTURE_2D,id_splat);
+		glTexSubImage2D(GL_TEXTURE_2D,0,x,y,1,1,GL_RED_INTEGER,GL_UNSIGNED_BYTE,&material);
+		glActiveTexture(GL_TEXTURE0);
+		glbiStats.countUpload(1);
+	}
+
+	void GLBI_Material_Table::upload() {
+		if (dirty) {
+			std::vector<float> data(8*entries.size(),0.0f);
+			for(size_t i=0;i<entries.size();i++) {
+				const GLBI_Material_Entry& e = entries[i];
+				float* texels = &data[8*i];
+				texels[0] = e.color.x;
+				texels[1] = e.color.y;
+				texels[2] = e.color.z;
+				texels[3] = e.shininess;
+				texels[4] = e.layer;
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER,id_buffer);
+			glBufferData(GL_TEXTURE_BUFFER,data.size()*sizeof(float),data.data(),GL_STATIC_DRAW);
+			glBindBuffer(GL_TEXTURE_BUFFER,0);
+			glbiStats.countUpload(data.size()*sizeof(float));
+			dirty = false;
+		}
+		if (layers_dirty) {
+			// The array is reallocated with all its layers : layers are only added while loading
+			glBindTexture(GL_TEXTURE_2D_ARRAY,id_layers);
+			if (layer_pixels.empty()) {
+				const unsigned char white[4] = {255,255,255,255};
+				glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_RGBA8,1,1,1,0,GL_RGBA,GL_UNSIGNED_BYTE,white);
+			}
+			else {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_RGBA8,GLBI_MATERIAL_LAYER_SIZE,GLBI_MATERIAL_LAYER_SIZE,nbLayers(),0,
+				             GL_RGBA,GL_UNSIGNED_BYTE,layer_pixels.data());
+				glbiStats.countUpload(layer_pixels.size());
+			}
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+			glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+			layers_dirty = false;
+		}
+		if (splat_dirty) {
+			// Rows of one byte per cell are not aligned on 4 bytes. Without a map, every cell is material 0
+			const unsigned char none = 0;
+			GLint alignment;
+			glGetIntegerv(GL_UNPACK_ALIGNMENT,&alignment);
+			glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+			glBindTexture(GL_TEXTURE_2D,id_splat);
+			if (splat_cells.empty())
+				glTexImage2D(GL_TEXTURE_2D,0,GL_R8UI,1,1,0,GL_RED_INTEGER,GL_UNSIGNED_BYTE,&none);
+			else {
+				glTexImage2D(GL_TEXTURE_2D,0,GL_R8UI,splat_width,splat_height,0,GL_RED_INTEGER,GL_UNSIGNED_BYTE,splat_cells.data());
+				glbiStats.countUpload(splat_cells.size());
+			}
+			glBindTexture(GL_TEXTURE_2D,0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT,alignment);
+			splat_dirty = false;
+		}
+	}
+
+	void GLBI_Material_Table::bindTextures() {
+		upload();
+		glActiveTexture(GL_TEXTURE0+GLBI_MATERIAL_DATA_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER,id_data);
+		glActiveTexture(GL_TEXTURE0+GLBI_MATERIAL_LAYERS_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY,id_layers);
+		glActiveTexture(GL_TEXTURE0+GLBI_MATERIAL_SPLAT_UNIT);
+		glBindTexture(GL_TEXTURE_2D,id_splat);
+		glActiveTexture(GL_TEXTURE0);
+		glbiStats.texture_binds += 3;
+	}
+
+}
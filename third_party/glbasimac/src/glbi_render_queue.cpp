@@ -0,0 +1,176 @@
+#include "glbasimac/glbi_render_queue.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace glbasimac {
+
+	/// Key layout (most significant first) : program (2 bits), VAO (30), material (32)
+	static uint64_t packKey(const GLBI_Draw_Source& source,const GLBI_Material& material) {
+		uint64_t shader = material.idShader & 0x3;
+		uint64_t vao = source.id_vao & 0x3FFFFFFF;
+		return (shader<<62) | (vao<<32) | material.id_material;
+	}
+
+	/// Two items can be drawn by the same instanced call (the material is an instance attribute)
+	static bool sameBatch(const GLBI_Draw_Item& a,const GLBI_Draw_Item& b) {
+		return a.source.id_vao == b.source.id_vao && a.source.id_index == b.source.id_index &&
+		       a.material.idShader == b.material.idShader;
+	}
+
+	static void drawSource(const GLBI_Draw_Source& source,unsigned int nb_instances) {
+		if (source.id_index) glDrawElementsInstanced(source.gl_type,source.nb_elts,GL_UNSIGNED_INT,0,nb_instances);
+		else glDrawArraysInstanced(source.gl_type,0,source.nb_elts,nb_instances);
+		glbiStats.countDraw(source.gl_type,source.nb_elts,nb_instances);
+	}
+
+	void GLBI_Draw_List::clear() {
+		items.clear();
+	}
+
+	void GLBI_Draw_List::addItem(const GLBI_Draw_Source& source,const GLBI_Material& material,const Matrix4D& world) {
+		items.push_back({packKey(source,material),source,material,world});
+	}
+
+	void GLBI_Draw_List::addMesh(const StandardMesh& mesh,const GLBI_Material& material,const Matrix4D& world) {
+		addItem({mesh.getIdVAO(),0,mesh.getType(),mesh.getNbElt()},material,world);
+	}
+
+	void GLBI_Draw_List::addMesh(const IndexedMesh& mesh,const GLBI_Material& material,const Matrix4D& world) {
+		addItem({mesh.id_vao,mesh.id_index,mesh.gl_type_mesh,mesh.getNbIndex()},material,world);
+	}
+
+	void GLBI_Draw_List::addShape(const GLBI_Convex_2D_Shape& shape,const GLBI_Material& material,const Matrix4D& world) {
+		addMesh(shape.shape,material,world);
+	}
+
+	void GLBI_Render_Queue::append(const GLBI_Draw_List& list) {
+		items.insert(items.end(),list.items.begin(),list.items.end());
+	}
+
+	unsigned int GLBI_Render_Queue::countStateChanges() const {
+		unsigned int changes = 0;
+		const GLBI_Draw_Item* prev = NULL;
+		for(size_t i=0;i<items.size();i++) {
+			const GLBI_Draw_Item& item = items[i];
+			if (!prev || prev->material.idShader != item.material.idShader) changes++;
+			if (!prev || prev->source.id_vao != item.source.id_vao) changes++;
+			// Without the table, a material is a flat color or a texture set before the draw
+			if (!prev || prev->material.id_material != item.material.id_material) changes++;
+			prev = &item;
+		}
+		return changes;
+	}
+
+	void GLBI_Render_Queue::submit(GLBI_Engine& engine) {
+		upload(engine);
+		draw(engine);
+		endFrame();
+	}
+
+	void GLBI_Render_Queue::upload(GLBI_Engine& engine) {
+		stats = {(unsigned int)items.size(),0,0,0,0,0};
+		nb_views = 0;
+		if (items.empty()) return;
+
+		order.resize(items.size());
+		for(size_t i=0;i<items.size();i++) order[i] = {items[i].key,(unsigned int)i};
+		// Ties are broken by recording order, so the submission is deterministic
+		std::sort(order.begin(),order.end());
+
+		// First pass : gather the world matrix and material of every item in submission order
+		instance_data.resize(order.size()*GLBI_INSTANCE_STRIDE);
+		for(size_t k=0;k<order.size();k++) {
+			const GLBI_Draw_Item& item = items[order[k].second];
+			float* dst = &instance_data[k*GLBI_INSTANCE_STRIDE];
+			std::copy(item.world.mat,item.world.mat+16,dst);
+			memcpy(&dst[16],&item.material.id_material,sizeof(unsigned int));
+		}
+		size_t bytes = instance_data.size()*sizeof(float);
+		if (!instance_ring.id_buffer) {
+			instance_ring.initGL(bytes > GLBI_INSTANCE_RING_BYTES ? bytes : GLBI_INSTANCE_RING_BYTES,engine.procLoader);
+		}
+		instance_ring.beginFrame(bytes);
+		stats.nb_fence_waits = instance_ring.fence_waits;
+		ring_offset = instance_ring.write(instance_data.data(),bytes);
+	}
+
+	void GLBI_Render_Queue::draw(GLBI_Engine& engine) {
+		nb_views++;
+		if (items.empty()) return;
+
+		// Meshes without a color buffer take the material color as is
+		glVertexAttrib3f(GLBI_COLOR_ATTRIB,1.0,1.0,1.0);
+		engine.materials.bindTextures();
+
+		// Second pass : draw, only changing the states that differ from the previous batch
+		int previous_shader = engine.currentShader;
+		int cur_shader = -1;
+		unsigned int cur_vao = 0;
+		const size_t stride = GLBI_INSTANCE_STRIDE*sizeof(float);
+		size_t instance_offset = 0;
+		for(size_t i=0;i<order.size();) {
+			const GLBI_Draw_Item& item = items[order[i].second];
+			size_t j = i+1;
+			while (j<order.size() && sameBatch(item,items[order[j].second])) j++;
+			unsigned int nb_instances = j-i;
+
+			if (item.material.idShader != cur_shader) {
+				cur_shader = item.material.idShader;
+				engine.currentShader = cur_shader;
+				glUseProgram(engine.idShader[cur_shader]);
+				glbiStats.program_switches++;
+				// The object transformation is carried by the instance attributes
+				engine.updateMvMatrix(engine.viewMatrix);
+				stats.nb_state_changes++;
+			}
+			if (item.source.id_vao != cur_vao) {
+				cur_vao = item.source.id_vao;
+				glBindVertexArray(cur_vao);
+				glbiStats.vao_binds++;
+				if (item.source.id_index) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,item.source.id_index);
+				stats.nb_state_changes++;
+			}
+
+			size_t batch_offset = ring_offset+instance_offset*stride;
+			glBindBuffer(GL_ARRAY_BUFFER,instance_ring.id_buffer);
+			for(unsigned int c=0;c<4;c++) {
+				glEnableVertexAttribArray(GLBI_INSTANCE_MATRIX_ATTRIB+c);
+				glVertexAttribPointer(GLBI_INSTANCE_MATRIX_ATTRIB+c,4,GL_FLOAT,GL_FALSE,stride,(void*)(batch_offset+4*c*sizeof(float)));
+				glVertexAttribDivisor(GLBI_INSTANCE_MATRIX_ATTRIB+c,1);
+			}
+			glEnableVertexAttribArray(GLBI_MATERIAL_ATTRIB);
+			glVertexAttribIPointer(GLBI_MATERIAL_ATTRIB,1,GL_UNSIGNED_INT,stride,(void*)(batch_offset+16*sizeof(float)));
+			glVertexAttribDivisor(GLBI_MATERIAL_ATTRIB,1);
+			glBindBuffer(GL_ARRAY_BUFFER,0);
+			drawSource(item.source,nb_instances);
+			// The enabled arrays belong to the VAO of the mesh : leave it as created
+			for(unsigned int c=0;c<4;c++) {
+				glVertexAttribDivisor(GLBI_INSTANCE_MATRIX_ATTRIB+c,0);
+				glDisableVertexAttribArray(GLBI_INSTANCE_MATRIX_ATTRIB+c);
+			}
+			glVertexAttribDivisor(GLBI_MATERIAL_ATTRIB,0);
+			glDisableVertexAttribArray(GLBI_MATERIAL_ATTRIB);
+			instance_offset += nb_instances;
+			if (nb_instances > 1) stats.nb_instanced_draw_calls++;
+			stats.nb_draw_calls++;
+			i = j;
+		}
+
+		glBindVertexArray(0);
+		engine.resetInstanceMatrix();
+		engine.setMaterial(0);
+		if (cur_shader != previous_shader) {
+			engine.currentShader = previous_shader;
+			glUseProgram(engine.idShader[previous_shader]);
+			glbiStats.program_switches++;
+		}
+	}
+
+	void GLBI_Render_Queue::endFrame() {
+		if (items.empty()) return;
+		instance_ring.endFrame();
+		unsigned int naive_changes = countStateChanges()*nb_views;
+		stats.nb_state_changes_avoided = naive_changes > stats.nb_state_changes ? naive_changes - stats.nb_state_changes : 0;
+	}
+
+}
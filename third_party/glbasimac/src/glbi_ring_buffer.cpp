@@ -0,0 +1,131 @@
+#include "glbasimac/glbi_ring_buffer.hpp"
+#include <cstring>
+#include <iostream>
+
+// Not part of the GL 4.0 loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace glbasimac {
+
+	/// Fence waits are split in steps of 1 ms
+	static const GLuint64 FENCE_WAIT_STEP_NS = 1000000;
+
+	static bool hasBufferStorage() {
+		if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4)) return true;
+		int nb_extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS,&nb_extensions);
+		for(int i=0;i<nb_extensions;i++) {
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS,i);
+			if (name && strcmp(name,"GL_ARB_buffer_storage") == 0) return true;
+		}
+		return false;
+	}
+
+	void GLBI_Ring_Buffer::initGL(size_t section_bytes,GLADloadproc loader) {
+		if (loader && hasBufferStorage()) buffer_storage = (Buffer_Storage_Proc)loader("glBufferStorage");
+		create(section_bytes);
+		std::cerr<<"Ring buffer : "<<(persistent ? "persistent mapping" : "glBufferSubData")<<std::endl;
+	}
+
+	void GLBI_Ring_Buffer::create(size_t section_bytes) {
+		// Keep every section start aligned
+		section_size = (section_bytes+255) & ~(size_t)255;
+		size_t total = section_size*GLBI_RING_SECTIONS;
+		glGenBuffers(1,&id_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER,id_buffer);
+		persistent = false;
+		if (buffer_storage) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			buffer_storage(GL_ARRAY_BUFFER,total,NULL,flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER,0,total,flags);
+			persistent = mapped != NULL;
+		}
+		if (!persistent) {
+			if (buffer_storage) {
+				// Storage is immutable : start again with a mutable buffer
+				glBindBuffer(GL_ARRAY_BUFFER,0);
+				glDeleteBuffers(1,&id_buffer);
+				glGenBuffers(1,&id_buffer);
+				glBindBuffer(GL_ARRAY_BUFFER,id_buffer);
+				buffer_storage = NULL;
+			}
+			glBufferData(GL_ARRAY_BUFFER,total,NULL,GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER,0);
+		current = 0;
+		offset = 0;
+	}
+
+	void GLBI_Ring_Buffer::release() {
+		for(int i=0;i<GLBI_RING_SECTIONS;i++) {
+			if (fences[i]) glDeleteSync(fences[i]);
+			fences[i] = NULL;
+		}
+		if (id_buffer) {
+			if (mapped) {
+				glBindBuffer(GL_ARRAY_BUFFER,id_buffer);
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+				glBindBuffer(GL_ARRAY_BUFFER,0);
+			}
+			glDeleteBuffers(1,&id_buffer);
+		}
+		id_buffer = 0;
+		mapped = NULL;
+	}
+
+	void GLBI_Ring_Buffer::beginFrame(size_t bytes) {
+		fence_waits = 0;
+		if (bytes > section_size) {
+			// Rare : wait for every frame in flight and start again with bigger sections
+			glFinish();
+			release();
+			create(bytes > 2*section_size ? bytes : 2*section_size);
+		}
+		else {
+			current = (current+1)%GLBI_RING_SECTIONS;
+		}
+		offset = 0;
+
+		GLsync& fence = fences[current];
+		if (!fence) return;
+		GLenum status = glClientWaitSync(fence,0,0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			fence_waits++;
+			do {
+				status = glClientWaitSync(fence,GL_SYNC_FLUSH_COMMANDS_BIT,FENCE_WAIT_STEP_NS);
+			} while (status == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		fence = NULL;
+	}
+
+	size_t GLBI_Ring_Buffer::write(const void* data,size_t bytes) {
+		if (offset+bytes > section_size) {
+			std::cerr<<"Ring buffer overflow : "<<offset+bytes<<" bytes for a "<<section_size<<" bytes frame"<<std::endl;
+			return current*section_size;
+		}
+		size_t position = current*section_size+offset;
+		if (persistent) {
+			memcpy(mapped+position,data,bytes);
+		}
+		else {
+			glBindBuffer(GL_ARRAY_BUFFER,id_buffer);
+			glBufferSubData(GL_ARRAY_BUFFER,position,bytes,data);
+			glBindBuffer(GL_ARRAY_BUFFER,0);
+		}
+		glbiStats.countUpload(bytes);
+		offset = (offset+bytes+15) & ~(size_t)15;
+		return position;
+	}
+
+	void GLBI_Ring_Buffer::endFrame() {
+		if (fences[current]) glDeleteSync(fences[current]);
+		fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	}
+
+}
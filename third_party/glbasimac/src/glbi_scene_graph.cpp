@@ -0,0 +1,126 @@
+#include "glbasimac/glbi_scene_graph.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace glbasimac {
+
+	void GLBI_Scene_Graph::clear() {
+		parent.clear();
+		local.clear();
+		world_mat.clear();
+		dirty.clear();
+		updated.clear();
+		draws.clear();
+		draw_node.clear();
+	}
+
+	int GLBI_Scene_Graph::addNode(int parent_node,const Matrix4D& local_transform) {
+		parent.push_back(parent_node);
+		local.push_back(local_transform);
+		world_mat.push_back(Matrix4D());
+		dirty.push_back(1);
+		updated.push_back(0);
+		return parent.size()-1;
+	}
+
+	void GLBI_Scene_Graph::setLocal(int node,const Matrix4D& local_transform) {
+		local[node] = local_transform;
+		dirty[node] = 1;
+	}
+
+	void GLBI_Scene_Graph::attachMesh(int node,const StandardMesh& mesh,const GLBI_Material& material) {
+		draws.addMesh(mesh,material,Matrix4D());
+		draw_node.push_back(node);
+	}
+
+	void GLBI_Scene_Graph::attachMesh(int node,const IndexedMesh& mesh,const GLBI_Material& material) {
+		draws.addMesh(mesh,material,Matrix4D());
+		draw_node.push_back(node);
+	}
+
+	void GLBI_Scene_Graph::attachShape(int node,const GLBI_Convex_2D_Shape& shape,const GLBI_Material& material) {
+		draws.addShape(shape,material,Matrix4D());
+		draw_node.push_back(node);
+	}
+
+	unsigned int GLBI_Scene_Graph::update() {
+		unsigned int nb_updated = 0;
+		for(size_t i=0;i<parent.size();i++) {
+			int p = parent[i];
+			updated[i] = dirty[i] || (p >= 0 && updated[p]);
+			if (!updated[i]) continue;
+			world_mat[i] = p >= 0 ? world_mat[p]*local[i] : local[i];
+			dirty[i] = 0;
+			nb_updated++;
+		}
+		return nb_updated;
+	}
+
+	bool GLBI_Scene_Graph::changed(int first,int last) const {
+		return last > first && memchr(&updated[first],1,last-first) != NULL;
+	}
+
+	void GLBI_Scene_Graph::record(GLBI_Draw_List& list,int first,int last) const {
+		for(int i=first;i<last;i++) {
+			list.items.push_back(draws.items[i]);
+			list.items.back().world = world_mat[draw_node[i]];
+		}
+	}
+
+	GLBI_Scene_Builder::GLBI_Scene_Builder(GLBI_Scene_Graph& g,int root_node)
+		:graph(g),root(root_node) {
+		frames.push_back({Matrix4D(),-1});
+	}
+
+	int GLBI_Scene_Builder::node(size_t level) {
+		if (frames[level].node < 0) {
+			int parent = level > 0 ? node(level-1) : root;
+			frames[level].node = graph.addNode(parent,frames[level].local);
+		}
+		return frames[level].node;
+	}
+
+	int GLBI_Scene_Builder::currentNode() {
+		return node(frames.size()-1);
+	}
+
+	void GLBI_Scene_Builder::pushMatrix() {
+		frames.push_back({Matrix4D(),-1});
+	}
+
+	void GLBI_Scene_Builder::popMatrix() {
+		if (frames.size() > 1) frames.pop_back();
+	}
+
+	void GLBI_Scene_Builder::addTransformation(const Matrix4D& transfo) {
+		Frame& f = frames.back();
+		f.local *= transfo;
+		// Draws and children of the node keep its previous transform
+		f.node = -1;
+	}
+
+	void GLBI_Scene_Builder::addTranslation(const Vector3D& trans) {
+		addTransformation(Matrix4D::translation(trans));
+	}
+
+	void GLBI_Scene_Builder::addRotation(float angle,const Vector3D& axe) {
+		addTransformation(Matrix4D::rotation(angle,axe));
+	}
+
+	void GLBI_Scene_Builder::addHomothety(float scale) {
+		addTransformation(Matrix4D::homothety(scale,scale,scale));
+	}
+
+	void GLBI_Scene_Builder::addMesh(const StandardMesh& mesh,const GLBI_Material& material) {
+		graph.attachMesh(currentNode(),mesh,material);
+	}
+
+	void GLBI_Scene_Builder::addMesh(const IndexedMesh& mesh,const GLBI_Material& material) {
+		graph.attachMesh(currentNode(),mesh,material);
+	}
+
+	void GLBI_Scene_Builder::addShape(const GLBI_Convex_2D_Shape& shape,const GLBI_Material& material) {
+		graph.attachShape(currentNode(),shape,material);
+	}
+
+}
@@ -0,0 +1,7 @@
+#include "glbasimac/glbi_stats.hpp"
+
+namespace glbasimac {
+
+	GLBI_Stats glbiStats;
+
+}
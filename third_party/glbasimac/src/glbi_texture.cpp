@@ -15,6 +15,7 @@ namespace glbasimac {
 			exit(1);
 		}
 		glBindTexture(GL_TEXTURE_2D,id_in_GL);
+		glbiStats.texture_binds++;
 	}
 
 	void GLBI_Texture::loadImage(unsigned int w,unsigned int h,unsigned int n_chan,unsigned char* pixels) {
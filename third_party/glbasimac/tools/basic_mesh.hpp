@@ -36,6 +36,9 @@ namespace STP3D {
 	  * Index 1 : normals
 	  * Index 2 : texture coordinates
 	  * Index 3 : colors
+	  * Index 4 to 7 : per-instance transformation (set by GLBI_Render_Queue)
+	  * Buffers are filled in float : call setLayout() on the mesh before createVAO() to store
+	  * them in smaller formats (see VertexLayout::compact()).
 	  */
 
 	/** Frame creation
@@ -21,6 +21,8 @@
 #include <iostream>
 #include <vector>
 #include "globals.hpp"
+#include "vertex_format.hpp"
+#include "glbasimac/glbi_stats.hpp"
 
 
 namespace STP3D {
@@ -73,12 +75,16 @@ namespace STP3D {
 		std::vector<std::string> attr_semantic;
 		/// Attribute semantic corresponding to each buffer
 		unsigned int gl_type_mesh;
+		/// GPU format of each attribute, used by createVAO()
+		VertexLayout layout;
 
 		//  GL defined members
 		/// Id of all VBO. Created by the GL API
 		std::vector<unsigned int> vbo_id;
 		/// Id of the corresponding VAO
 		unsigned int id_vao;
+		/// Bytes of vertex data uploaded by createVAO() (indices excluded)
+		size_t vertex_bytes = 0;
 
 		/// Set the number of elements in each buffers
 		void setNbElt(unsigned int elts) {nb_elts = elts;};
@@ -91,7 +97,15 @@ namespace STP3D {
 		 *                      GL RELATED FUNCTIONS
 		 *****************************************************************/
 		void changeType(unsigned int new_gl_type) {gl_type_mesh = new_gl_type;};
+		void setLayout(const VertexLayout& new_layout) {layout = new_layout;};
 		bool createVAO();
+		/// Number of indices sent by one draw call
+		unsigned int getNbIndex() const {return nb_primitive*nb_idx_per_primitive;};
+		/// True if one of the buffers feeds attribute id
+		bool hasAttribute(unsigned int id) const {
+			for(unsigned int a : attr_id) if (a == id) return true;
+			return false;
+		};
 		void draw();
 
 	private:
@@ -107,6 +121,9 @@ namespace STP3D {
 			}
 		}
 		if (index_buffer) delete[](index_buffer);
+		if (!vbo_id.empty()) glDeleteBuffers(vbo_id.size(),vbo_id.data());
+		if (id_index) glDeleteBuffers(1,&id_index);
+		if (id_vao) glDeleteVertexArrays(1,&id_vao);
 	}
 
 	inline unsigned int IndexedMesh::getNbIdxPerPrimitive() {
@@ -147,15 +164,14 @@ namespace STP3D {
 		if (id_index==0) {STP3D::setError("Unable to find an empty VBO for index buffer");return false;}
 
 
-		// Transfer all data for all VBO from CPU to GPU
+		// Transfer all data for all VBO from CPU to GPU, converted to the format of their attribute
+		vertex_bytes = 0;
 		for(std::vector<int>::size_type i = 0; i < buffers.size(); ++i) {
 			glEnableVertexAttribArray(attr_id[i]);
 
 			glBindBuffer(GL_ARRAY_BUFFER,vbo_id[i]);
 
-			glBufferData(GL_ARRAY_BUFFER,nb_elts*size_one_elt[i]*sizeof(GLfloat),buffers[i],GL_STATIC_DRAW);
-
-			glVertexAttribPointer(attr_id[i], size_one_elt[i], GL_FLOAT, GL_FALSE, 0, 0);
+			vertex_bytes += uploadVertexAttribute(attr_id[i],layout.of(attr_id[i]),size_one_elt[i],buffers[i],nb_elts);
 
 			glBindBuffer(GL_ARRAY_BUFFER,0);
 		}
@@ -194,8 +210,10 @@ namespace STP3D {
 	inline void IndexedMesh::draw() {
 		glBindVertexArray(id_vao);
 
+		glbasimac::glbiStats.vao_binds++;
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,id_index);
 		glDrawElements(gl_type_mesh,nb_primitive*nb_idx_per_primitive,GL_UNSIGNED_INT,0);
+		glbasimac::glbiStats.countDraw(gl_type_mesh,nb_primitive*nb_idx_per_primitive);
 
 		glBindVertexArray(0);
 	}
@@ -26,6 +26,8 @@
 #include <string>
 #include <vector>
 #include "gl_tools.hpp"
+#include "vertex_format.hpp"
+#include "glbasimac/glbi_stats.hpp"
 
 namespace STP3D {
 
@@ -61,9 +63,26 @@ namespace STP3D {
 		 *                      GL RELATED FUNCTIONS
 		 *****************************************************************/
 		void changeType(unsigned int new_gl_type) {gl_type_mesh = new_gl_type;};
+		/// Format of each attribute in the VBOs. Used by the next createVAO()
+		void setLayout(const VertexLayout& new_layout) {layout = new_layout;};
+		const VertexLayout& getLayout() const {return layout;};
 		bool createVAO();
-		unsigned int getIdVAO();
+		/// Bytes of vertex data uploaded by createVAO()
+		size_t getVertexBytes() const {return vertex_bytes;};
+		unsigned int getIdVAO() const {return id_vao;};
+		unsigned int getNbElt() const {return nb_elts;};
+		unsigned int getType() const {return gl_type_mesh;};
+		/// True if one of the buffers feeds attribute id
+		bool hasAttribute(unsigned int id) const {
+			for(unsigned int a : attr_id) if (a == id) return true;
+			return false;
+		};
 		void draw() const;
+		/// CPU buffers (NULL once released or if not copied and forgotten)
+		unsigned int getNbBuffers() const {return buffers.size();};
+		const float* getBuffer(unsigned int i) const {return buffers[i];};
+		unsigned int getAttributeId(unsigned int i) const {return attr_id[i];};
+		unsigned int getEltSize(unsigned int i) const {return size_one_elt[i];};
 private:
 		//  User defined members
 		/// All the data in CPU buffers
@@ -80,12 +99,15 @@ private:
 		std::vector<bool> copied;
 		/// Attribute semantic corresponding to each buffer
 		unsigned int gl_type_mesh;
+		/// GPU format of each attribute
+		VertexLayout layout;
 
 		//  GL defined members
 		/// Id of all VBO. Created by the GL API
 		std::vector<unsigned int> vbo_id;
 		/// Id of the corresponding VAO
 		unsigned int id_vao;
+		size_t vertex_bytes = 0;
 
 	};
 
@@ -96,9 +118,10 @@ private:
  		size_one_elt.clear();
 		attr_id.clear();
 		attr_semantic.clear();
-		glDeleteBuffers(vbo_id.size(),&(vbo_id[0]));
+		if (!vbo_id.empty()) glDeleteBuffers(vbo_id.size(),vbo_id.data());
 		vbo_id.clear();
-		glDeleteVertexArrays(1,&id_vao);
+		if (id_vao) glDeleteVertexArrays(1,&id_vao);
+		id_vao = 0;
 	}
 
 	inline bool StandardMesh::createVAO() {
@@ -121,16 +144,15 @@ private:
 
 		glGenBuffers(buffers.size(),&(vbo_id[0]));
 
-		// Transfer all data for all VBO from CPU to GPU
+		// Transfer all data for all VBO from CPU to GPU, converted to the format of their attribute
+		vertex_bytes = 0;
 		for(std::vector<int>::size_type i = 0; i < buffers.size(); ++i) {
 			std::cerr<<"Id VBO for "<<attr_semantic[i]<<" : "<<vbo_id[i]<<std::endl;
 			glBindBuffer(GL_ARRAY_BUFFER,vbo_id[i]);
 
-			glBufferData(GL_ARRAY_BUFFER,nb_elts*size_one_elt[i]*sizeof(GLfloat),buffers[i],GL_STATIC_DRAW);
-
 			glEnableVertexAttribArray(attr_id[i]);
 
-			glVertexAttribPointer(attr_id[i], size_one_elt[i], GL_FLOAT, GL_FALSE, 0, 0);
+			vertex_bytes += uploadVertexAttribute(attr_id[i],layout.of(attr_id[i]),size_one_elt[i],buffers[i],nb_elts);
 
 			glBindBuffer(GL_ARRAY_BUFFER,0);
 		}
@@ -158,8 +180,10 @@ private:
 
 	inline void StandardMesh::draw() const {
 		glBindVertexArray(id_vao);
+		glbasimac::glbiStats.vao_binds++;
 
 		glDrawArrays(gl_type_mesh,0,nb_elts);
+		glbasimac::glbiStats.countDraw(gl_type_mesh,nb_elts);
 
 		glBindVertexArray(0);
 	}
@@ -173,9 +197,10 @@ private:
  		size_one_elt.clear();
 		attr_id.clear();
 		attr_semantic.clear();
-		glDeleteBuffers(vbo_id.size(),&(vbo_id[0]));
+		if (!vbo_id.empty()) glDeleteBuffers(vbo_id.size(),vbo_id.data());
 		vbo_id.clear();
-		glDeleteVertexArrays(1,&id_vao);
+		if (id_vao) glDeleteVertexArrays(1,&id_vao);
+		id_vao = 0;
 	}
 
 	inline void StandardMesh::releaseCPUMemory() {
@@ -0,0 +1,175 @@
+/***************************************************************************
+                      vertex_format.hpp  -  description
+                             -------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _STP3D_VERTEX_FORMAT_HPP_
+#define _STP3D_VERTEX_FORMAT_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "gl_tools.hpp"
+
+namespace STP3D {
+
+	/**
+	  * Storage of one vertex attribute in its VBO.
+	  * Meshes always keep their CPU buffers in float; createVAO converts each buffer to the
+	  * format chosen for its attribute, and the vertex shader still reads floats.
+	  * Rows of the compressed formats are padded to 4 bytes.
+	  */
+	enum VertexFormat {
+		VTX_FLOAT,          ///< GL_FLOAT, 4 bytes per component
+		VTX_HALF,           ///< GL_HALF_FLOAT, 2 bytes per component. 11 bits of precision : small local coordinates
+		VTX_INT_2_10_10_10, ///< GL_INT_2_10_10_10_REV normalized, up to 3 components in [-1,1] in 4 bytes : normals
+		VTX_UNORM16,        ///< GL_UNSIGNED_SHORT normalized, components clamped to [0,1] : texture coordinates
+		VTX_UNORM8          ///< GL_UNSIGNED_BYTE normalized, up to 4 components clamped to [0,1] : colors
+	};
+
+	/// Attribute ids a layout can set (coordinates, normals, texture coordinates, colors)
+	#define STP3D_LAYOUT_ATTRIBUTES 4
+
+	/**
+	  * Format of each attribute of a mesh, by attribute id. Other ids are always in float.
+	  */
+	struct VertexLayout {
+		VertexFormat format[STP3D_LAYOUT_ATTRIBUTES] = {VTX_FLOAT,VTX_FLOAT,VTX_FLOAT,VTX_FLOAT};
+
+		VertexLayout& set(unsigned int id_attribute,VertexFormat f) {
+			if (id_attribute < STP3D_LAYOUT_ATTRIBUTES) format[id_attribute] = f;
+			return *this;
+		};
+		VertexFormat of(unsigned int id_attribute) const {
+			return id_attribute < STP3D_LAYOUT_ATTRIBUTES ? format[id_attribute] : VTX_FLOAT;
+		};
+		/// Half coordinates, packed normals, 16 bits texture coordinates and 8 bits colors :
+		/// 16 bytes per vertex instead of 32 for coordinates, normals and texture coordinates
+		static VertexLayout compact() {
+			return VertexLayout().set(0,VTX_HALF).set(1,VTX_INT_2_10_10_10).set(2,VTX_UNORM16).set(3,VTX_UNORM8);
+		};
+	};
+
+	/// IEEE 754 half of f, rounded to nearest even (overflow gives an infinity)
+	inline uint16_t floatToHalf(float f) {
+		uint32_t x;
+		memcpy(&x,&f,sizeof(x));
+		uint32_t sign = (x>>16) & 0x8000;
+		uint32_t f_exp = (x>>23) & 0xff;
+		uint32_t mant = x & 0x7fffff;
+		if (f_exp == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0);
+		int exp = (int)f_exp-127+15;
+		if (exp >= 31) return sign | 0x7c00;
+		if (exp <= 0) {
+			// Subnormal half
+			if (exp < -10) return sign;
+			mant |= 0x800000;
+			uint32_t shift = 14-exp;
+			uint32_t h = mant>>shift;
+			uint32_t rest = mant & ((1u<<shift)-1);
+			uint32_t halfway = 1u<<(shift-1);
+			if (rest > halfway || (rest == halfway && (h & 1))) h++;
+			return sign | h;
+		}
+		uint32_t h = ((uint32_t)exp<<10) | (mant>>13);
+		uint32_t rest = mant & 0x1fff;
+		// A carry out of the mantissa correctly increments the exponent
+		if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+		return sign | h;
+	}
+
+	/// Components given to glVertexAttribPointer for one_elt_size floats in format
+	inline unsigned int vertexComponents(VertexFormat format,unsigned int one_elt_size) {
+		return format == VTX_INT_2_10_10_10 ? 4 : one_elt_size;
+	}
+
+	/// Bytes of one element of one_elt_size floats stored in format
+	inline unsigned int vertexStride(VertexFormat format,unsigned int one_elt_size) {
+		switch(format) {
+			case VTX_HALF:
+			case VTX_UNORM16: return (one_elt_size*2+3) & ~3u;
+			case VTX_INT_2_10_10_10:
+			case VTX_UNORM8: return 4;
+			default: return one_elt_size*4;
+		}
+	}
+
+	/// nb_elts elements of one_elt_size floats converted to format (padding bytes are 0)
+	inline std::vector<unsigned char> packVertices(VertexFormat format,unsigned int one_elt_size,
+	                                               const float* data,unsigned int nb_elts) {
+		const unsigned int stride = vertexStride(format,one_elt_size);
+		std::vector<unsigned char> packed((size_t)nb_elts*stride,0);
+		for(unsigned int e=0;e<nb_elts;e++) {
+			const float* src = data+(size_t)e*one_elt_size;
+			unsigned char* dst = &packed[(size_t)e*stride];
+			switch(format) {
+				case VTX_HALF:
+					for(unsigned int c=0;c<one_elt_size;c++) {
+						uint16_t h = floatToHalf(src[c]);
+						memcpy(dst+2*c,&h,2);
+					}
+					break;
+				case VTX_INT_2_10_10_10: {
+					uint32_t word = 0;
+					for(unsigned int c=0;c<std::min(one_elt_size,3u);c++) {
+						int32_t v = (int32_t)std::lround(std::max(-1.0f,std::min(1.0f,src[c]))*511.0f);
+						word |= ((uint32_t)v & 0x3ff)<<(10*c);
+					}
+					memcpy(dst,&word,4);
+					break;
+				}
+				case VTX_UNORM16:
+					for(unsigned int c=0;c<one_elt_size;c++) {
+						uint16_t v = (uint16_t)std::lround(std::max(0.0f,std::min(1.0f,src[c]))*65535.0f);
+						memcpy(dst+2*c,&v,2);
+					}
+					break;
+				case VTX_UNORM8:
+					for(unsigned int c=0;c<std::min(one_elt_size,4u);c++) {
+						dst[c] = (unsigned char)std::lround(std::max(0.0f,std::min(1.0f,src[c]))*255.0f);
+					}
+					break;
+				default:
+					memcpy(dst,src,one_elt_size*sizeof(float));
+			}
+		}
+		return packed;
+	}
+
+	/// Upload nb_elts elements of one_elt_size floats in the bound GL_ARRAY_BUFFER, as format,
+	/// and point id_attribute to it (in the bound VAO). Returns the number of bytes uploaded
+	inline size_t uploadVertexAttribute(unsigned int id_attribute,VertexFormat format,unsigned int one_elt_size,
+	                                    const float* data,unsigned int nb_elts) {
+		const unsigned int stride = vertexStride(format,one_elt_size);
+		const unsigned int size = vertexComponents(format,one_elt_size);
+		if (format == VTX_FLOAT) {
+			glBufferData(GL_ARRAY_BUFFER,(size_t)nb_elts*stride,data,GL_STATIC_DRAW);
+		}
+		else {
+			std::vector<unsigned char> packed = packVertices(format,one_elt_size,data,nb_elts);
+			glBufferData(GL_ARRAY_BUFFER,packed.size(),packed.data(),GL_STATIC_DRAW);
+		}
+		switch(format) {
+			case VTX_HALF: glVertexAttribPointer(id_attribute,size,GL_HALF_FLOAT,GL_FALSE,stride,0); break;
+			case VTX_INT_2_10_10_10: glVertexAttribPointer(id_attribute,size,GL_INT_2_10_10_10_REV,GL_TRUE,stride,0); break;
+			case VTX_UNORM16: glVertexAttribPointer(id_attribute,size,GL_UNSIGNED_SHORT,GL_TRUE,stride,0); break;
+			case VTX_UNORM8: glVertexAttribPointer(id_attribute,size,GL_UNSIGNED_BYTE,GL_TRUE,stride,0); break;
+			default: glVertexAttribPointer(id_attribute,size,GL_FLOAT,GL_FALSE,stride,0);
+		}
+		return (size_t)nb_elts*stride;
+	}
+
+};
+
+#endif